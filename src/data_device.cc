@@ -0,0 +1,468 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "data_device.h"
+#include "json.h"
+#include "trace.h"
+
+namespace flutter {
+
+// in order of preference
+static const char *const kTextMimeTypes[] = {"text/plain;charset=utf-8", "text/plain", "UTF8_STRING", "STRING", "TEXT"};
+static const char kUriListMimeType[]      = "text/uri-list";
+
+static inline DataDevice *get_data_device(void *data) {
+  return static_cast<DataDevice *>(data);
+}
+
+const wl_data_device_listener DataDevice::kDataDeviceListener = {
+    .data_offer =
+        [](void *data, struct wl_data_device *wl_data_device, struct wl_data_offer *offer) {
+          DataDevice *const dd = get_data_device(data);
+
+          // the mime types follow, then enter or selection tells what it is for
+          dd->offers_[offer] = {};
+          wl_data_offer_add_listener(offer, &kDataOfferListener, dd);
+        },
+
+    .enter =
+        [](void *data, struct wl_data_device *wl_data_device, uint32_t serial, struct wl_surface *surface, wl_fixed_t x, wl_fixed_t y, struct wl_data_offer *offer) {
+          DataDevice *const dd = get_data_device(data);
+
+          dd->drag_offer_ = offer;
+          dd->drag_x_     = wl_fixed_to_double(x);
+          dd->drag_y_     = wl_fixed_to_double(y);
+          dd->drag_mime_type_.clear();
+
+          if (offer == nullptr || surface != dd->surface_) {
+            return;
+          }
+
+          const auto &mime_types = dd->offers_[offer];
+
+          if (std::find(mime_types.begin(), mime_types.end(), kUriListMimeType) != mime_types.end()) {
+            dd->drag_mime_type_ = kUriListMimeType;
+          } else if (const char *mime_type = dd->TextMimeType(offer)) {
+            dd->drag_mime_type_ = mime_type;
+          }
+
+          if (dd->drag_mime_type_.empty()) {
+            wl_data_offer_accept(offer, serial, nullptr);
+            return;
+          }
+
+          wl_data_offer_accept(offer, serial, dd->drag_mime_type_.c_str());
+          wl_data_offer_set_actions(offer, WL_DATA_DEVICE_MANAGER_DND_ACTION_COPY, WL_DATA_DEVICE_MANAGER_DND_ACTION_COPY);
+        },
+
+    .leave =
+        [](void *data, struct wl_data_device *wl_data_device) {
+          DataDevice *const dd = get_data_device(data);
+
+          // a dropped offer belongs to its transfer by now
+          if (dd->drag_offer_) {
+            dd->DestroyOffer(dd->drag_offer_);
+            dd->drag_offer_ = nullptr;
+          }
+        },
+
+    .motion =
+        [](void *data, struct wl_data_device *wl_data_device, uint32_t time, wl_fixed_t x, wl_fixed_t y) {
+          DataDevice *const dd = get_data_device(data);
+
+          dd->drag_x_ = wl_fixed_to_double(x);
+          dd->drag_y_ = wl_fixed_to_double(y);
+        },
+
+    .drop =
+        [](void *data, struct wl_data_device *wl_data_device) {
+          get_data_device(data)->Drop();
+        },
+
+    .selection =
+        [](void *data, struct wl_data_device *wl_data_device, struct wl_data_offer *offer) {
+          DataDevice *const dd = get_data_device(data);
+
+          if (dd->selection_offer_ && dd->selection_offer_ != offer) {
+            dd->DestroyOffer(dd->selection_offer_);
+          }
+
+          dd->selection_offer_ = offer;
+        },
+};
+
+const wl_data_offer_listener DataDevice::kDataOfferListener = {
+    .offer =
+        [](void *data, struct wl_data_offer *offer, const char *mime_type) {
+          get_data_device(data)->offers_[offer].push_back(mime_type);
+        },
+
+    .source_actions = [](void *data, struct wl_data_offer *offer, uint32_t source_actions) {},
+
+    .action = [](void *data, struct wl_data_offer *offer, uint32_t dnd_action) {},
+};
+
+const wl_data_source_listener DataDevice::kDataSourceListener = {
+    .target = [](void *data, struct wl_data_source *source, const char *mime_type) {},
+
+    .send =
+        [](void *data, struct wl_data_source *source, const char *mime_type, int32_t fd) {
+          get_data_device(data)->Send(fd);
+        },
+
+    .cancelled =
+        [](void *data, struct wl_data_source *source) {
+          DataDevice *const dd = get_data_device(data);
+
+          // another client owns the selection now
+          if (source == dd->source_) {
+            dd->source_ = nullptr;
+            dd->source_text_.reset();
+          }
+
+          wl_data_source_destroy(source);
+        },
+
+    .dnd_drop_performed = [](void *data, struct wl_data_source *source) {},
+
+    .dnd_finished = [](void *data, struct wl_data_source *source) {},
+
+    .action = [](void *data, struct wl_data_source *source, uint32_t dnd_action) {},
+};
+
+DataDevice::~DataDevice() {
+  Detach();
+  Unbind();
+}
+
+void DataDevice::Unbind() {
+  if (source_) {
+    wl_data_source_destroy(source_);
+    source_ = nullptr;
+  }
+
+  for (auto &offer : offers_) {
+    wl_data_offer_destroy(offer.first);
+  }
+
+  offers_.clear();
+
+  if (device_) {
+    wl_data_device_release(device_);
+    device_ = nullptr;
+  }
+
+  if (manager_) {
+    wl_data_device_manager_destroy(manager_);
+    manager_ = nullptr;
+  }
+}
+
+void DataDevice::Bind(wl_data_device_manager *manager, wl_seat *seat, wl_surface *surface) {
+  manager_ = manager;
+  surface_ = surface;
+
+  if (manager_ == nullptr || seat == nullptr) {
+    return;
+  }
+
+  device_ = wl_data_device_manager_get_data_device(manager_, seat);
+  wl_data_device_add_listener(device_, &kDataDeviceListener, this);
+}
+
+void DataDevice::Attach(uv_loop_t *loop) {
+  loop_ = loop;
+}
+
+void DataDevice::Detach() {
+  const std::vector<Transfer *> transfers = transfers_;
+
+  for (auto transfer : transfers) {
+    transfer->done = nullptr;
+    Finish(transfer);
+  }
+
+  loop_ = nullptr;
+}
+
+void DataDevice::Start(Application *application) {
+  application_ = application;
+}
+
+void DataDevice::Stop() {
+  // their response handles went with the engine
+  for (auto transfer : transfers_) {
+    transfer->done = nullptr;
+  }
+
+  application_ = nullptr;
+}
+
+const char *DataDevice::TextMimeType(wl_data_offer *offer) const {
+  auto offered = offers_.find(offer);
+
+  if (offered == offers_.end()) {
+    return nullptr;
+  }
+
+  for (auto mime_type : kTextMimeTypes) {
+    if (std::find(offered->second.begin(), offered->second.end(), mime_type) != offered->second.end()) {
+      return mime_type;
+    }
+  }
+
+  return nullptr;
+}
+
+void DataDevice::DestroyOffer(wl_data_offer *offer) {
+  if (offer == selection_offer_) {
+    selection_offer_ = nullptr;
+  }
+
+  offers_.erase(offer);
+  wl_data_offer_destroy(offer);
+}
+
+DataDevice::Transfer *DataDevice::Receive(wl_data_offer *offer, const char *mime_type, std::function<void(bool success, std::string *data)> done) {
+  if (loop_ == nullptr) {
+    return nullptr;
+  }
+
+  int fds[2];
+
+  if (pipe2(fds, O_CLOEXEC) != 0) {
+    FL_ERROR("Could not create a pipe: %s", strerror(errno));
+    return nullptr;
+  }
+
+  // the request goes out when the loop flushes the connection, before it polls
+  wl_data_offer_receive(offer, mime_type, fds[1]);
+  close(fds[1]);
+
+  Transfer *transfer  = new Transfer;
+  transfer->device    = this;
+  transfer->done      = std::move(done);
+  transfer->pipe.data = transfer;
+  uv_pipe_init(loop_, &transfer->pipe, 0);
+
+  if (uv_pipe_open(&transfer->pipe, fds[0]) != 0) {
+    close(fds[0]);
+    uv_close(reinterpret_cast<uv_handle_t *>(&transfer->pipe), [](uv_handle_t *handle) { delete static_cast<Transfer *>(handle->data); });
+    return nullptr;
+  }
+
+  transfers_.push_back(transfer);
+
+  uv_read_start(
+      reinterpret_cast<uv_stream_t *>(&transfer->pipe),
+      [](uv_handle_t *handle, size_t suggested_size, uv_buf_t *buffer) {
+        Transfer *const transfer = static_cast<Transfer *>(handle->data);
+
+        // doubling, a paste of n bytes is moved O(log n) times
+        if (transfer->data.size() - transfer->size < suggested_size) {
+          transfer->data.resize(std::max(transfer->data.size() * 2, transfer->size + suggested_size));
+        }
+
+        *buffer = uv_buf_init(&transfer->data[transfer->size], transfer->data.size() - transfer->size);
+      },
+      [](uv_stream_t *stream, ssize_t nread, const uv_buf_t *buffer) {
+        Transfer *const transfer = static_cast<Transfer *>(stream->data);
+
+        if (nread >= 0) {
+          transfer->size += nread;
+          return;
+        }
+
+        const bool success = nread == UV_EOF;
+
+        if (!success) {
+          FL_ERROR("Could not read an offer: %s", uv_strerror(nread));
+        }
+
+        transfer->data.resize(transfer->size);
+
+        if (transfer->done) {
+          transfer->done(success, &transfer->data);
+        }
+
+        transfer->device->Finish(transfer);
+      });
+
+  return transfer;
+}
+
+void DataDevice::Send(int fd) {
+  if (!source_text_ || loop_ == nullptr) {
+    close(fd);
+    return;
+  }
+
+  Transfer *transfer   = new Transfer;
+  transfer->device     = this;
+  transfer->source     = source_text_;
+  transfer->pipe.data  = transfer;
+  transfer->write.data = transfer;
+  uv_pipe_init(loop_, &transfer->pipe, 0);
+
+  if (uv_pipe_open(&transfer->pipe, fd) != 0) {
+    close(fd);
+    uv_close(reinterpret_cast<uv_handle_t *>(&transfer->pipe), [](uv_handle_t *handle) { delete static_cast<Transfer *>(handle->data); });
+    return;
+  }
+
+  transfers_.push_back(transfer);
+
+  // straight from the shared buffer, which lives as long as any writer needs it
+  uv_buf_t buffer = uv_buf_init(const_cast<char *>(transfer->source->data()), transfer->source->size());
+
+  const int result = uv_write(&transfer->write, reinterpret_cast<uv_stream_t *>(&transfer->pipe), &buffer, 1, [](uv_write_t *request, int status) {
+    Transfer *const transfer = static_cast<Transfer *>(request->data);
+
+    if (status != 0) {
+      FL_WARN("Could not send the selection: %s", uv_strerror(status));
+    }
+
+    transfer->device->Finish(transfer);
+  });
+
+  if (result != 0) {
+    FL_WARN("Could not send the selection: %s", uv_strerror(result));
+    Finish(transfer);
+  }
+}
+
+void DataDevice::Finish(Transfer *transfer) {
+  // the source learns the drop ended, also when the engine stopped meanwhile
+  if (transfer->drop_offer != nullptr) {
+    wl_data_offer_finish(transfer->drop_offer);
+    DestroyOffer(transfer->drop_offer);
+  }
+
+  transfers_.erase(std::remove(transfers_.begin(), transfers_.end(), transfer), transfers_.end());
+  uv_close(reinterpret_cast<uv_handle_t *>(&transfer->pipe), [](uv_handle_t *handle) { delete static_cast<Transfer *>(handle->data); });
+}
+
+void DataDevice::HandleMessage(const FlutterPlatformMessage *message) {
+  FLWAY_TRACE_SCOPE("DataDevice.HandleMessage");
+
+  const JsonValue call    = JsonValue::Parse(message->message, message->message_size);
+  const std::string &name = call["method"].AsString();
+
+  if (name == "Clipboard.setData") {
+    SetData(call["args"]["text"].AsString());
+    Respond(message->response_handle, JsonValue());
+  } else if (name == "Clipboard.getData") {
+    GetData(message->response_handle);
+  } else if (name == "Clipboard.hasStrings") {
+    const bool has_strings = source_text_ ? !source_text_->empty() : selection_offer_ != nullptr && TextMimeType(selection_offer_) != nullptr;
+    Respond(message->response_handle, JsonValue::Object().Set("value", has_strings));
+  } else {
+    application_->respondPlatformMessage(message->response_handle, nullptr, 0);
+  }
+}
+
+void DataDevice::GetData(const FlutterPlatformMessageResponseHandle *response_handle) {
+  // our own selection does not take the way through the compositor
+  if (source_text_) {
+    Respond(response_handle, JsonValue::Object().Set("text", *source_text_));
+    return;
+  }
+
+  const char *mime_type = selection_offer_ ? TextMimeType(selection_offer_) : nullptr;
+
+  auto done = [this, response_handle](bool success, std::string *data) {
+    if (!success) {
+      Respond(response_handle, JsonValue());
+      return;
+    }
+
+    Respond(response_handle, JsonValue::Object().Set("text", std::move(*data)));
+  };
+
+  if (mime_type == nullptr || !Receive(selection_offer_, mime_type, done)) {
+    Respond(response_handle, JsonValue());
+  }
+}
+
+void DataDevice::SetData(const std::string &text) {
+  source_text_ = std::make_shared<const std::string>(text);
+
+  if (manager_ == nullptr || device_ == nullptr) {
+    return; // the clipboard stays within the application
+  }
+
+  if (source_) {
+    wl_data_source_destroy(source_);
+  }
+
+  source_ = wl_data_device_manager_create_data_source(manager_);
+  wl_data_source_add_listener(source_, &kDataSourceListener, this);
+
+  for (auto mime_type : kTextMimeTypes) {
+    wl_data_source_offer(source_, mime_type);
+  }
+
+  wl_data_device_set_selection(device_, source_, input_serial_);
+}
+
+void DataDevice::Drop() {
+  wl_data_offer *const offer = drag_offer_;
+  drag_offer_                = nullptr;
+
+  if (offer == nullptr) {
+    return;
+  }
+
+  if (drag_mime_type_.empty() || application_ == nullptr) {
+    DestroyOffer(offer);
+    return;
+  }
+
+  // Finish() finishes and destroys the offer
+  auto done = [this, mime_type = drag_mime_type_, x = drag_x_, y = drag_y_](bool success, std::string *data) {
+    if (!success) {
+      return;
+    }
+
+    JsonValue args = JsonValue::Object();
+    args.Set("mimeType", mime_type).Set("data", std::move(*data)).Set("x", x).Set("y", y);
+
+    const std::string message = JsonValue::Object().Set("method", "drop").Set("args", std::move(args)).Serialize();
+
+    if (!application_->sendPlatformMessage(kDropChannel, reinterpret_cast<const uint8_t *>(message.data()), message.size())) {
+      FL_ERROR("Error sending PlatformMessage: %s", kDropChannel);
+    }
+  };
+
+  Transfer *const transfer = Receive(offer, drag_mime_type_.c_str(), done);
+
+  if (transfer == nullptr) {
+    DestroyOffer(offer);
+    return;
+  }
+
+  transfer->drop_offer = offer;
+}
+
+void DataDevice::Respond(const FlutterPlatformMessageResponseHandle *response_handle, const JsonValue &result) {
+  if (application_ == nullptr) {
+    return;
+  }
+
+  // JSONMethodCodec success envelope
+  const std::string message = "[" + result.Serialize() + "]";
+
+  if (!application_->respondPlatformMessage(response_handle, reinterpret_cast<const uint8_t *>(message.data()), message.size())) {
+    FL_ERROR("Could not respond to a clipboard request");
+  }
+}
+
+} // namespace flutter
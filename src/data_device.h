@@ -0,0 +1,119 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <flutter_embedder.h>
+#include <uv.h>
+#include <wayland-client.h>
+
+#include "macros.h"
+#include "flutter_application.h"
+#include "json.h"
+
+namespace flutter {
+
+// Clipboard (Clipboard.getData/setData/hasStrings on flutter/platform) and
+// drops of text or URIs through wl_data_device.
+//
+// Transfers never block the platform thread: offers are read through a
+// non-blocking pipe on the uv loop into a buffer growing as data arrives, and
+// the reply is sent when the other side closed the pipe. Our own selection is
+// kept in one shared buffer, written to readers straight from it and handed
+// to Clipboard.getData without going through the compositor.
+//
+// Drops are sent on flutter_wayland/drop as a JSONMethodCodec call
+// {"method":"drop","args":{"mimeType":...,"data":...,"x":...,"y":...}}.
+class DataDevice {
+public:
+  static constexpr const char *kDropChannel = "flutter_wayland/drop";
+
+  DataDevice() = default;
+
+  ~DataDevice();
+
+  // After the registry roundtrip, takes the manager; without one the
+  // clipboard stays within the application. Unbind() before the connection
+  // goes away.
+  void Bind(wl_data_device_manager *manager, wl_seat *seat, wl_surface *surface);
+  void Unbind();
+
+  void Attach(uv_loop_t *loop);
+  void Detach();
+
+  // Between the engine start and its stop; transfers still running when the
+  // engine stops are dropped without a reply.
+  void Start(Application *application);
+  void Stop();
+
+  // Serial of the latest input event, setting the selection needs one.
+  void SetInputSerial(uint32_t serial) {
+    input_serial_ = serial;
+  }
+
+  void HandleMessage(const FlutterPlatformMessage *message);
+
+private:
+  static const wl_data_device_listener kDataDeviceListener;
+  static const wl_data_offer_listener kDataOfferListener;
+  static const wl_data_source_listener kDataSourceListener;
+
+  struct Transfer {
+    DataDevice *device;
+    uv_pipe_t pipe;
+    // reading an offer
+    std::string data;
+    size_t size = 0;
+    std::function<void(bool success, std::string *data)> done;
+    wl_data_offer *drop_offer = nullptr; // finished and destroyed with the transfer, whatever its outcome
+    // serving our selection
+    uv_write_t write;
+    std::shared_ptr<const std::string> source;
+  };
+
+  wl_data_device_manager *manager_ = nullptr;
+  wl_data_device *device_          = nullptr;
+  wl_surface *surface_             = nullptr;
+  uv_loop_t *loop_                 = nullptr;
+  Application *application_        = nullptr;
+  uint32_t input_serial_           = 0;
+
+  std::map<wl_data_offer *, std::vector<std::string>> offers_; // with their mime types
+  wl_data_offer *selection_offer_ = nullptr;
+  wl_data_offer *drag_offer_      = nullptr;
+  std::string drag_mime_type_;
+  double drag_x_ = 0.;
+  double drag_y_ = 0.;
+
+  wl_data_source *source_ = nullptr; // while we own the selection
+  std::shared_ptr<const std::string> source_text_;
+
+  std::vector<Transfer *> transfers_;
+
+  const char *TextMimeType(wl_data_offer *offer) const;
+  void DestroyOffer(wl_data_offer *offer);
+
+  // The transfer, nullptr when it could not start.
+  Transfer *Receive(wl_data_offer *offer, const char *mime_type, std::function<void(bool success, std::string *data)> done);
+  void Send(int fd);
+  void Finish(Transfer *transfer);
+
+  void GetData(const FlutterPlatformMessageResponseHandle *response_handle);
+  void SetData(const std::string &text);
+  void Drop();
+
+  void Respond(const FlutterPlatformMessageResponseHandle *response_handle, const JsonValue &result);
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(DataDevice)
+};
+
+} // namespace flutter
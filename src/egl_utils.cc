@@ -3,9 +3,12 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <string.h>
+#include <map>
 #include <wayland-egl.h>
 #include <EGL/egl.h>
 #include "egl_utils.h"
+#include "metrics.h"
 #include "utils.h"
 
 namespace flutter {
@@ -19,7 +22,7 @@ void LogLastEGLError() {
 #define _EGL_ERROR_DESC(a)                                                                                                                                                                                                                     \
   { #a, a }
 
-  const EGLNameErrorPair pairs[] = {
+  static const EGLNameErrorPair pairs[] = {
       _EGL_ERROR_DESC(EGL_SUCCESS),     _EGL_ERROR_DESC(EGL_NOT_INITIALIZED), _EGL_ERROR_DESC(EGL_BAD_ACCESS),          _EGL_ERROR_DESC(EGL_BAD_ALLOC),         _EGL_ERROR_DESC(EGL_BAD_ATTRIBUTE),
       _EGL_ERROR_DESC(EGL_BAD_CONTEXT), _EGL_ERROR_DESC(EGL_BAD_CONFIG),      _EGL_ERROR_DESC(EGL_BAD_CURRENT_SURFACE), _EGL_ERROR_DESC(EGL_BAD_DISPLAY),       _EGL_ERROR_DESC(EGL_BAD_SURFACE),
       _EGL_ERROR_DESC(EGL_BAD_MATCH),   _EGL_ERROR_DESC(EGL_BAD_PARAMETER),   _EGL_ERROR_DESC(EGL_BAD_NATIVE_PIXMAP),   _EGL_ERROR_DESC(EGL_BAD_NATIVE_WINDOW), _EGL_ERROR_DESC(EGL_CONTEXT_LOST),
@@ -29,16 +32,161 @@ void LogLastEGLError() {
 
   const auto count = sizeof(pairs) / sizeof(EGLNameErrorPair);
 
+  auto counter = [](const std::string &error) { return Metrics::Instance().GetCounter("flutter_wayland_egl_errors_total", "EGL errors logged.", Metrics::Label("error", error)); };
+
+  // resolved once, the raster thread must not wait for a metrics scrape
+  static Counter *const *const counters = [&counter]() {
+    static Counter *resolved[count];
+
+    for (size_t i = 0; i < count; i++) {
+      resolved[i] = counter(pairs[i].name);
+    }
+
+    return resolved;
+  }();
+
   EGLint last_error = eglGetError();
 
   for (size_t i = 0; i < count; i++) {
     if (last_error == pairs[i].code) {
+      counters[i]->Add();
       FL_ERROR("EGL Error: %s (%d)", pairs[i].name, pairs[i].code);
       return;
     }
   }
 
+  thread_local std::map<EGLint, Counter *> unknown_counters;
+  Counter *&unknown = unknown_counters[last_error];
+
+  if (unknown == nullptr) {
+    unknown = counter(std::to_string(last_error));
+  }
+
+  unknown->Add();
   FL_ERROR("Unknown EGL Error");
 }
 
+bool EGLFramebufferConfig::HasAlpha() const {
+  return format == Format::RGBA8888;
+}
+
+std::vector<EGLint> EGLFramebufferConfig::Attribs() const {
+  const bool rgb565 = format == Format::RGB565;
+
+  std::vector<EGLint> attribs = {
+      // clang-format off
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+    EGL_SURFACE_TYPE,    surface_type,
+    EGL_RED_SIZE,        rgb565 ? 5 : 8,
+    EGL_GREEN_SIZE,      rgb565 ? 6 : 8,
+    EGL_BLUE_SIZE,       rgb565 ? 5 : 8,
+    EGL_ALPHA_SIZE,      HasAlpha() ? 8 : 0,
+    EGL_DEPTH_SIZE,      depth_size,
+    EGL_STENCIL_SIZE,    stencil_size,
+      // clang-format on
+  };
+
+  if (samples > 0) {
+    attribs.insert(attribs.end(), {EGL_SAMPLE_BUFFERS, 1, EGL_SAMPLES, samples});
+  }
+
+  attribs.push_back(EGL_NONE); // termination sentinel
+
+  return attribs;
+}
+
+bool EGLFramebufferConfig::Matches(EGLDisplay display, EGLConfig config) const {
+  const bool rgb565 = format == Format::RGB565;
+
+  const struct {
+    EGLint attrib;
+    EGLint value;
+  } expected[] = {
+      {EGL_RED_SIZE, rgb565 ? 5 : 8},
+      {EGL_GREEN_SIZE, rgb565 ? 6 : 8},
+      {EGL_BLUE_SIZE, rgb565 ? 5 : 8},
+      {EGL_ALPHA_SIZE, HasAlpha() ? 8 : 0},
+  };
+
+  for (const auto &e : expected) {
+    EGLint value = -1;
+
+    if (eglGetConfigAttrib(display, config, e.attrib, &value) != EGL_TRUE || value != e.value) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+std::string EGLFramebufferConfig::ToString() const {
+  static const char *const names[] = {"rgba8888", "xrgb8888", "rgb565"};
+
+  return std::string(names[static_cast<int>(format)]) + " depth: " + std::to_string(depth_size) + " stencil: " + std::to_string(stencil_size) + " samples: " + std::to_string(samples) + (opaque ? " opaque" : "");
+}
+
+bool EGLFramebufferConfig::ParseFormat(const std::string &name, Format *format) {
+  if (name == "rgba8888") {
+    *format = Format::RGBA8888;
+  } else if (name == "xrgb8888") {
+    *format = Format::XRGB8888;
+  } else if (name == "rgb565") {
+    *format = Format::RGB565;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+bool HasEGLExtension(EGLDisplay display, const char *name) {
+  const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+  const size_t length    = strlen(name);
+
+  for (const char *p = extensions; p && (p = strstr(p, name)) != nullptr; p += length) {
+    const bool starts = p == extensions || p[-1] == ' ';
+    const bool ends   = p[length] == ' ' || p[length] == '\0';
+
+    if (starts && ends) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+EGLConfig ChooseEGLConfig(EGLDisplay display, const EGLFramebufferConfig &framebuffer_config) {
+  const auto attribs  = framebuffer_config.Attribs();
+  EGLint config_count = 0;
+
+  if (eglChooseConfig(display, attribs.data(), nullptr, 0, &config_count) != EGL_TRUE) {
+    LogLastEGLError();
+    FL_ERROR("Error when attempting to choose an EGL surface config.");
+    return nullptr;
+  }
+
+  if (config_count == 0) {
+    FL_ERROR("No matching configs for: %s", framebuffer_config.ToString().c_str());
+    return nullptr;
+  }
+
+  std::vector<EGLConfig> configs(config_count);
+
+  if (eglChooseConfig(display, attribs.data(), configs.data(), config_count, &config_count) != EGL_TRUE) {
+    LogLastEGLError();
+    FL_ERROR("Error when attempting to choose an EGL surface config.");
+    return nullptr;
+  }
+
+  for (EGLint i = 0; i < config_count; i++) {
+    if (framebuffer_config.Matches(display, configs[i])) {
+      return configs[i];
+    }
+  }
+
+  FL_WARN("No exact match for: %s, using the closest config", framebuffer_config.ToString().c_str());
+
+  return configs[0];
+}
+
 } // namespace flutter
@@ -5,10 +5,40 @@
 
 #pragma once
 
+#include <string>
+#include <vector>
+#include <EGL/egl.h>
+
 #include "macros.h"
 
 namespace flutter {
 
 void LogLastEGLError();
 
+// Framebuffer format of the onscreen EGL surface.
+struct EGLFramebufferConfig {
+  enum class Format { RGBA8888, XRGB8888, RGB565 };
+
+  Format format       = Format::RGBA8888;
+  bool opaque         = false; // marks the whole surface as opaque region
+  EGLint depth_size   = 0;
+  EGLint stencil_size = 0;
+  EGLint samples      = 0; // MSAA samples, 0 disables multisampling
+  EGLint surface_type = EGL_WINDOW_BIT;
+
+  bool HasAlpha() const;
+  std::vector<EGLint> Attribs() const;
+  bool Matches(EGLDisplay display, EGLConfig config) const;
+  std::string ToString() const;
+
+  static bool ParseFormat(const std::string &name, Format *format);
+};
+
+// Exact match in the EGL_EXTENSIONS list, not a prefix of a longer name.
+bool HasEGLExtension(EGLDisplay display, const char *name);
+
+// Picks the config matching the requested format exactly, eglChooseConfig() on its own
+// prefers deeper formats (e.g. RGBA8888 over RGB565).
+EGLConfig ChooseEGLConfig(EGLDisplay display, const EGLFramebufferConfig &framebuffer_config);
+
 } // namespace flutter
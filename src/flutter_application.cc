@@ -2,10 +2,21 @@
 #include "macros.h"
 #include "utils.h"
 #include "elf.h"
-#include "cify.h"
+#include "input_log.h"
+#include "json.h"
+#include "keys.h"
+#include "metrics.h"
+#include "platform_task_runner.h"
+#include "semantics.h"
+#include "thread_policy.h"
+#include "trace.h"
 
 namespace flutter {
 
+static Counter *InputEventCounter(const char *type) {
+  return Metrics::Instance().GetCounter("flutter_wayland_input_events_total", "Input events sent to the engine.", Metrics::Label("type", type));
+}
+
 static double get_pixel_ratio(int32_t physical_width, int32_t physical_height, int32_t pixels_width, int32_t pixels_height) {
 
   if (pixels_width == 0 || physical_height == 0 || pixels_width == 0 || pixels_height == 0) {
@@ -16,7 +27,9 @@ static double get_pixel_ratio(int32_t physical_width, int32_t physical_height, i
   return 1.0;
 }
 
-FlutterApplication::FlutterApplication(RenderDisplay* display, const std::string &bundle_path, const std::vector<std::string> &command_line_args) : Application(display) {
+FlutterApplication::FlutterApplication(RenderDisplay* display, const std::string &bundle_path, const std::vector<std::string> &command_line_args) : Application(display), display_(display), text_input_(this, display), plugins_(this) {
+      message_handlers_[TextInputPlugin::kChannel] = [this](const FlutterPlatformMessage *message) { text_input_.HandleMessage(message); };
+
       FlutterRendererConfig config = display->renderEngineConfig();
       
       auto icu_data_path = GetICUDataPath();
@@ -38,7 +51,8 @@ FlutterApplication::FlutterApplication(RenderDisplay* display, const std::string
         .icu_data_path     = icu_data_path.c_str(),
         .command_line_argc = static_cast<int>(command_line_args_c.size()),
         .command_line_argv = command_line_args_c.data(),
-        .vsync_callback    = cify([display](void *data, intptr_t baton){ display->vsync_callback(data, baton); }),
+        .platform_message_callback = [](const FlutterPlatformMessage *message, void *data) { static_cast<FlutterApplication *>(static_cast<RenderDisplay *>(data)->application)->onPlatformMessage(message); },
+        .vsync_callback    = [](void *data, intptr_t baton) { static_cast<RenderDisplay *>(data)->vsync_callback(data, baton); }, // data is the display passed to FlutterEngineRun()
         .compute_platform_resolved_locale_callback = [](const FlutterLocale **supported_locales, size_t number_of_locales) -> const FlutterLocale * {
           FL_DEBUG("compute_platform_resolved_locale_callback: number_of_locales: %zu", number_of_locales);
 
@@ -48,8 +62,34 @@ FlutterApplication::FlutterApplication(RenderDisplay* display, const std::string
 
           return nullptr;
         },
+        .update_semantics_callback2 = [](const FlutterSemanticsUpdate2 *update, void *data) { static_cast<FlutterApplication *>(static_cast<RenderDisplay *>(data)->application)->onSemanticsUpdate(update); },
     };
     
+    // platform tasks (and so platform messages) run on the loop of this thread
+    const FlutterTaskRunnerDescription platform_task_runner = PlatformTaskRunner::Instance().Description(&engine_);
+
+    // the engine calls thread_priority_setter on its UI, raster and IO threads when they start
+    const FlutterCustomTaskRunners task_runners = {
+        .struct_size            = sizeof(FlutterCustomTaskRunners),
+        .platform_task_runner   = &platform_task_runner,
+        .render_task_runner     = nullptr,
+        .thread_priority_setter = [](FlutterThreadPriority priority) {
+          switch (priority) {
+          case kDisplay:
+            ThreadPolicy::Instance().Apply(ThreadPolicy::Role::UI);
+            break;
+          case kRaster:
+            ThreadPolicy::Instance().Apply(ThreadPolicy::Role::RASTER);
+            break;
+          default:
+            ThreadPolicy::Instance().Apply(ThreadPolicy::Role::IO);
+            break;
+          }
+        },
+    };
+
+    args.custom_task_runners = &task_runners;
+
     std::string libapp_aot_path = bundle_path + "/" + FlutterGetAppAotElfName(); // dw: TODO: There seems to be no convention name we could use, so let's temporary hardcode the path.
 
     if (FlutterEngineRunsAOTCompiledDartCode()) {
@@ -73,20 +113,35 @@ FlutterApplication::FlutterApplication(RenderDisplay* display, const std::string
     if (result != kSuccess) {
         FL_ERROR("Could not run the Flutter engine");
         engine_ = nullptr;
+        PlatformTaskRunner::Instance().Forget(&engine_);
         return;
     }
 
+    // handlers of the manifest's channels, preloads are initialized with the running engine
+    plugins_.Load(bundle_path);
+
+    // semantics stay off until an accessibility bridge connects
+    SemanticsServer::Instance().Add(this);
+
     display->onEngineStarted();
 }
 
 FlutterApplication::~FlutterApplication() {
     if (engine_) {
+        SemanticsServer::Instance().Remove(this);
+        display_->onEngineStopping();
+
         auto result = FlutterEngineShutdown(engine_);
         if (result == kSuccess) {
             engine_ = nullptr;
         } else {
             FL_ERROR("Could not shutdown the Flutter engine.");
         }
+
+        // engine_ is about to go away, whatever it posted is stale
+        PlatformTaskRunner::Instance().Forget(&engine_);
+
+        display_->onEngineStopped();
     }
 }
 
@@ -95,36 +150,148 @@ bool FlutterApplication::isStarted() const
     return engine_ != nullptr;
 }
 
-bool FlutterApplication::sendWindowMetrics(int32_t physical_width, int32_t physical_height, int32_t screen_width, int32_t screen_height)
+bool FlutterApplication::scheduleFrame()
+{
+    return FlutterEngineScheduleFrame(engine_) == kSuccess;
+}
+
+bool FlutterApplication::sendWindowMetrics(int32_t physical_width, int32_t physical_height, int32_t screen_width, int32_t screen_height, double render_scale)
 {
+    if (InputRecorder::Instance().IsRecording()) {
+      InputRecorder::Instance().WindowMetrics(physical_width, physical_height, screen_width, screen_height, render_scale);
+    }
+
     FlutterWindowMetricsEvent event = {};
     event.struct_size               = sizeof(event);
     event.width                     = screen_width;
     event.height                    = screen_height;
-    event.pixel_ratio               = get_pixel_ratio(physical_width, physical_height, screen_width, screen_height);
+    event.pixel_ratio               = get_pixel_ratio(physical_width, physical_height, screen_width, screen_height) * render_scale; // keeps the logical size when rendering scaled down
 
     auto success = FlutterEngineSendWindowMetricsEvent(engine_, &event) == kSuccess;
 
+    if (success) {
+      render_scale_ = render_scale;
+      view_width_   = screen_width;
+      view_height_  = screen_height;
+    }
+
     FL_DEBUG("flutter window metric: %zux%zu par: %f status: %s", event.width, event.height, event.pixel_ratio, (success ? "success" : "failed"));
 
     return success;
 }
 
-void FlutterApplication::keyboardKey(const GdkEventType type, const xkb_keycode_t hardware_keycode, const xkb_keysym_t keysym, guint state, const uint32_t utf32)
+void FlutterApplication::keyboardKey(const GdkEventType type, const xkb_keycode_t hardware_keycode, const xkb_keysym_t keysym, guint state, const uint32_t utf32, bool repeat)
 {
+  FLWAY_TRACE_SCOPE("FlutterApplication.keyboardKey");
+
+  static Counter *const key_down_events   = InputEventCounter("key_down");
+  static Counter *const key_up_events     = InputEventCounter("key_up");
+  static Counter *const key_repeat_events = InputEventCounter("key_repeat");
+
+  (repeat ? key_repeat_events : type == GDK_KEY_PRESS ? key_down_events : key_up_events)->Add();
+
+  if (InputRecorder::Instance().IsRecording()) {
+    InputRecorder::Instance().Key(type, hardware_keycode, keysym, state, utf32, repeat);
+  }
+
   if (utf32) {
     if (utf32 >= 0x21 && utf32 <= 0x7E) {
-      FL_DEBUG("the key %c was %s", (char)utf32, type == GDK_KEY_PRESS ? "pressed" : "released");
+      FL_DEBUG("the key %c was %s", (char)utf32, repeat ? "repeated" : type == GDK_KEY_PRESS ? "pressed" : "released");
     } else {
-      FL_DEBUG("the key U+%04X was %s", utf32, type == GDK_KEY_PRESS ? "pressed" : "released");
+      FL_DEBUG("the key U+%04X was %s", utf32, repeat ? "repeated" : type == GDK_KEY_PRESS ? "pressed" : "released");
     }
   } else {
     char name[64];
     xkb_keysym_get_name(keysym, name, sizeof(name));
 
-    FL_DEBUG("the key %s was %s", name, type == GDK_KEY_PRESS ? "pressed" : "released");
+    FL_DEBUG("the key %s was %s", name, repeat ? "repeated" : type == GDK_KEY_PRESS ? "pressed" : "released");
+  }
+
+  // Both paths are timed, the numbers show what the JSON encoding and the
+  // platform message round trip cost compared to the binary key data.
+  auto timed = [](KeyTiming &timing, const char *name, auto &&send) {
+    const uint64_t start_ns = FlutterEngineGetCurrentTime();
+    const bool success      = send();
+    timing.total_ns += FlutterEngineGetCurrentTime() - start_ns;
+
+    if (++timing.events % 100 == 0) {
+      FL_DEBUG("%s: %.1f us per keystroke", name, timing.total_ns / 1000.0 / timing.events);
+    }
+
+    return success;
+  };
+
+  // text goes into a focused text field from here, once the framework let the key through
+  PendingKeyPress *const pending = type == GDK_KEY_PRESS ? new PendingKeyPress{this, keysym, utf32, state} : nullptr;
+
+  if (key_event_api_) {
+    key_event_api_ = timed(key_event_timing_, "FlutterEngineSendKeyEvent", [&] { return sendKeyEvent(type, hardware_keycode, keysym, utf32, repeat, pending); });
+
+    if (!key_event_api_) {
+      FL_WARN("FlutterEngineSendKeyEvent failed, falling back to flutter/keyevent only");
+    }
   }
 
+  timed(legacy_key_event_timing_, "flutter/keyevent", [&] { return sendLegacyKeyEvent(type, hardware_keycode, keysym, state, utf32, pending); });
+
+  if (pending != nullptr) {
+    onKeyReply(pending, false);
+  }
+}
+
+void FlutterApplication::onKeyReply(PendingKeyPress *pending, bool handled)
+{
+  pending->handled |= handled;
+
+  if (--pending->replies > 0) {
+    return;
+  }
+
+  if (!pending->handled) {
+    pending->application->text_input_.KeyPress(pending->keysym, pending->utf32, pending->state);
+  }
+
+  delete pending;
+}
+
+bool FlutterApplication::sendKeyEvent(const GdkEventType type, const xkb_keycode_t hardware_keycode, const xkb_keysym_t keysym, const uint32_t utf32, bool repeat, PendingKeyPress *pending)
+{
+  char character[8] = {};
+
+  // only key downs carry the produced character, control characters are not text
+  if (type == GDK_KEY_PRESS && utf32 >= 0x20 && utf32 != 0x7f) {
+    xkb_keysym_to_utf8(keysym, character, sizeof(character));
+  }
+
+  const FlutterKeyEvent event = {
+      .struct_size = sizeof(event),
+      .timestamp   = FlutterEngineGetCurrentTime() / 1000.0,
+      .type        = repeat ? kFlutterKeyEventTypeRepeat : type == GDK_KEY_PRESS ? kFlutterKeyEventTypeDown : kFlutterKeyEventTypeUp,
+      .physical    = EvdevToPhysicalKey(hardware_keycode - 8),
+      .logical     = KeysymToLogicalKey(keysym, utf32),
+      .character   = character[0] ? character : nullptr,
+      .synthesized = false,
+      .device_type = kFlutterKeyEventDeviceTypeKeyboard,
+  };
+
+  if (pending == nullptr) {
+    return FlutterEngineSendKeyEvent(engine_, &event, nullptr, nullptr) == kSuccess;
+  }
+
+  pending->replies++;
+
+  const bool success = FlutterEngineSendKeyEvent(
+                           engine_, &event, [](bool handled, void *user_data) { onKeyReply(static_cast<PendingKeyPress *>(user_data), handled); }, pending) == kSuccess;
+
+  if (!success) {
+    pending->replies--;
+  }
+
+  return success;
+}
+
+bool FlutterApplication::sendLegacyKeyEvent(const GdkEventType type, const xkb_keycode_t hardware_keycode, const xkb_keysym_t keysym, guint state, const uint32_t utf32, PendingKeyPress *pending)
+{
   std::string message;
 
   // dw: if you do not like so many backslashes,
@@ -142,23 +309,52 @@ void FlutterApplication::keyboardKey(const GdkEventType type, const xkb_keycode_
 
   message += "}";
 
-  if (!message.empty()) {
-    bool success = FlutterSendMessage(engine_, "flutter/keyevent", reinterpret_cast<const uint8_t *>(message.c_str()), message.size());
+  // the reply is {"handled":bool}
+  FlutterDataCallback reply = nullptr;
 
-    if (!success) {
-      FL_ERROR("Error sending PlatformMessage: %s", message.c_str());
+  if (pending != nullptr) {
+    pending->replies++;
+    reply = [](const uint8_t *data, size_t size, void *user_data) {
+      onKeyReply(static_cast<PendingKeyPress *>(user_data), data != nullptr && JsonValue::Parse(data, size)["handled"].AsBool());
+    };
+  }
+
+  bool success = FlutterSendMessage(engine_, "flutter/keyevent", reinterpret_cast<const uint8_t *>(message.c_str()), message.size(), reply, pending);
+
+  if (!success) {
+    FL_ERROR("Error sending PlatformMessage: %s", message.c_str());
+
+    if (pending != nullptr) {
+      pending->replies--;
     }
   }
+
+  return success;
 }
 
 void FlutterApplication::onPointerEvent(const FlutterPointerPhase phase, uint32_t time, double x, double y)
 {
+    FLWAY_TRACE_SCOPE("FlutterApplication.onPointerEvent");
+
+    static Counter *const pointer_events[] = {
+        InputEventCounter("pointer_cancel"), InputEventCounter("pointer_up"),     InputEventCounter("pointer_down"),  InputEventCounter("pointer_move"),
+        InputEventCounter("pointer_add"),    InputEventCounter("pointer_remove"), InputEventCounter("pointer_hover"),
+    };
+
+    if (static_cast<size_t>(phase) < std::size(pointer_events)) {
+      pointer_events[phase]->Add();
+    }
+
+    if (InputRecorder::Instance().IsRecording()) {
+      InputRecorder::Instance().Pointer(phase, x, y);
+    }
+
     FlutterPointerEvent event = {
         .struct_size    = sizeof(event),
         .phase          = phase,
         .timestamp      = time * 1000,
-        .x              = x,
-        .y              = y,
+        .x              = x * render_scale_, // the view is rendered at RenderWidth() x RenderHeight()
+        .y              = y * render_scale_,
         .device         = 0,
         .signal_kind    = kFlutterPointerSignalKindNone,
         .scroll_delta_x = 0,
@@ -170,6 +366,91 @@ void FlutterApplication::onPointerEvent(const FlutterPointerPhase phase, uint32_
     FlutterEngineSendPointerEvent(engine_, &event, 1);
 }
 
+bool FlutterApplication::sendLifecycleState(const AppLifecycleState state)
+{
+    static const char *const names[] = {
+        "AppLifecycleState.resumed",
+        "AppLifecycleState.inactive",
+        "AppLifecycleState.paused",
+        "AppLifecycleState.detached",
+    };
+
+    const char *message = names[static_cast<int>(state)];
+
+    // flutter/lifecycle uses StringCodec, i.e. plain UTF-8 without any framing
+    bool success = FlutterSendMessage(engine_, "flutter/lifecycle", reinterpret_cast<const uint8_t *>(message), strlen(message));
+
+    if (!success) {
+      FL_ERROR("Error sending PlatformMessage: %s", message);
+    }
+
+    return success;
+}
+
+void FlutterApplication::notifyLowMemory(size_t skia_cache_bytes)
+{
+    // Also sends {"type":"memoryPressure"} over flutter/system to the framework.
+    if (FlutterEngineNotifyLowMemoryWarning(engine_) != kSuccess) {
+      FL_ERROR("Could not notify the engine about low memory");
+    }
+
+    if (skia_cache_bytes == 0) {
+      return;
+    }
+
+    // repeated warnings keep the limit from before the first one
+    if (!skia_cache_lowered_) {
+      skia_cache_bytes_restored_ = skia_cache_bytes_;
+    }
+
+    skia_cache_lowered_ = setSkiaCacheMaxBytes(skia_cache_bytes) || skia_cache_lowered_;
+}
+
+void FlutterApplication::notifyMemoryRelieved()
+{
+    if (!skia_cache_lowered_) {
+      return;
+    }
+
+    // there is no way back to the engine's own limit, it is set explicitly for the current view size
+    const size_t bytes = skia_cache_bytes_restored_ != 0 ? skia_cache_bytes_restored_ : static_cast<size_t>(view_width_) * view_height_ * kSkiaCacheBytesPerPixel;
+
+    if (bytes != 0 && setSkiaCacheMaxBytes(bytes)) {
+      FL_INFO("Skia resource cache limit restored to %zu kB", bytes / 1024);
+    }
+
+    skia_cache_lowered_ = false;
+}
+
+bool FlutterApplication::setSkiaCacheMaxBytes(size_t bytes)
+{
+    const std::string message = "{\"method\":\"Skia.setResourceCacheMaxBytes\",\"args\":" + std::to_string(bytes) + "}";
+
+    if (!FlutterSendMessage(engine_, "flutter/skia", reinterpret_cast<const uint8_t *>(message.c_str()), message.size())) {
+      FL_ERROR("Error sending PlatformMessage: %s", message.c_str());
+      return false;
+    }
+
+    skia_cache_bytes_ = bytes;
+
+    return true;
+}
+
+bool FlutterApplication::registerExternalTexture(int64_t texture_id)
+{
+    return FlutterEngineRegisterExternalTexture(engine_, texture_id) == kSuccess;
+}
+
+bool FlutterApplication::unregisterExternalTexture(int64_t texture_id)
+{
+    return FlutterEngineUnregisterExternalTexture(engine_, texture_id) == kSuccess;
+}
+
+bool FlutterApplication::markExternalTextureFrameAvailable(int64_t texture_id)
+{
+    return FlutterEngineMarkExternalTextureFrameAvailable(engine_, texture_id) == kSuccess;
+}
+
 FlutterEngineResult FlutterApplication::onVsync(const intptr_t baton, const uint64_t current_ns, const uint64_t finish_time_ns)
 {
     return FlutterEngineOnVsync(engine_, baton, current_ns, finish_time_ns);
@@ -180,4 +461,73 @@ uint64_t FlutterApplication::getCurrentTime()
     return FlutterEngineGetCurrentTime();
 }
 
+bool FlutterApplication::sendPlatformMessage(const char *channel, const uint8_t *data, size_t size)
+{
+    return FlutterSendMessage(engine_, channel, data, size);
+}
+
+bool FlutterApplication::respondPlatformMessage(const FlutterPlatformMessageResponseHandle *handle, const uint8_t *data, size_t size)
+{
+    if (handle == nullptr) {
+      return true; // the sender wants no reply
+    }
+
+    return FlutterEngineSendPlatformMessageResponse(engine_, handle, data, size) == kSuccess;
+}
+
+void FlutterApplication::setPlatformMessageHandler(const std::string &channel, PlatformMessageHandler handler)
+{
+    if (handler) {
+      message_handlers_[channel] = std::move(handler);
+    } else {
+      message_handlers_.erase(channel);
+    }
+}
+
+TextInputPlugin *FlutterApplication::textInput()
+{
+    return &text_input_;
+}
+
+bool FlutterApplication::setSemanticsEnabled(bool enabled)
+{
+    if (!enabled) {
+      semantics_.Clear();
+    }
+
+    return FlutterEngineUpdateSemanticsEnabled(engine_, enabled) == kSuccess;
+}
+
+bool FlutterApplication::dispatchSemanticsAction(int32_t id, FlutterSemanticsAction action)
+{
+    return FlutterEngineDispatchSemanticsAction(engine_, id, action, nullptr, 0) == kSuccess;
+}
+
+const SemanticsTree *FlutterApplication::semantics() const
+{
+    return &semantics_;
+}
+
+void FlutterApplication::onSemanticsUpdate(const FlutterSemanticsUpdate2 *update)
+{
+    FLWAY_TRACE_SCOPE("semantics.update");
+
+    SemanticsServer::Instance().Publish(this, semantics_.Apply(update));
+}
+
+void FlutterApplication::onPlatformMessage(const FlutterPlatformMessage *message)
+{
+    auto handler = message_handlers_.find(message->channel);
+
+    if (handler != message_handlers_.end()) {
+      handler->second(message);
+      return;
+    }
+
+    FL_DEBUG("No handler for a message on %s", message->channel);
+
+    // the framework completes the call with null (MissingPluginException for method channels)
+    respondPlatformMessage(message->response_handle, nullptr, 0);
+}
+
 }
\ No newline at end of file
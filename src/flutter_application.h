@@ -1,6 +1,8 @@
 
 #pragma once
 
+#include <functional>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -8,31 +10,64 @@
 #include <gdk/gdk.h>
 #include <xkbcommon/xkbcommon.h>
 
+#include "plugin_loader.h"
+#include "semantics.h"
+#include "text_input.h"
+
 namespace flutter {
 
 class Application;
 
+// Mirrors AppLifecycleState from dart:ui, sent over flutter/lifecycle.
+enum class AppLifecycleState { resumed, inactive, paused, detached };
+
 class RenderDisplay {
 public:
     virtual void vsync_callback(void *data, intptr_t baton) = 0;
     virtual FlutterRendererConfig renderEngineConfig() = 0;
     virtual void onEngineStarted() = 0;
+    // Around FlutterEngineShutdown(): no calls into the application from
+    // onEngineStopping() until the next onEngineStarted().
+    virtual void onEngineStopping() = 0;
+    virtual void onEngineStopped() = 0;
+    // The focused text field changed in a way the input method should know.
+    virtual void onTextInputChanged(TextInputPlugin *text_input) {}
     Application* application = nullptr;
 };
 
 class Application
 {
 public:
+    // Must respond to the message, possibly later, on the platform thread.
+    using PlatformMessageHandler = std::function<void(const FlutterPlatformMessage *message)>;
+
     Application(RenderDisplay* display) {
         display->application = this;
     }
 
-    virtual bool sendWindowMetrics(int32_t physical_width_, int32_t physical_height_, int32_t screen_width_, int32_t screen_height_) = 0;
-    virtual void keyboardKey(const GdkEventType type, const xkb_keycode_t hardware_keycode, const xkb_keysym_t keysym, guint state, const uint32_t utf32) = 0;
+    virtual bool sendWindowMetrics(int32_t physical_width_, int32_t physical_height_, int32_t screen_width_, int32_t screen_height_, double render_scale = 1.0) = 0;
+    virtual void keyboardKey(const GdkEventType type, const xkb_keycode_t hardware_keycode, const xkb_keysym_t keysym, guint state, const uint32_t utf32, bool repeat = false) = 0;
+    // x, y in surface coordinates, scaled like the view by the render scale of the last window metrics.
     virtual void onPointerEvent(const FlutterPointerPhase phase, uint32_t time, double x, double y) = 0;
+    virtual bool sendLifecycleState(const AppLifecycleState state) = 0;
+    virtual void notifyLowMemory(size_t skia_cache_bytes) = 0;
+    // The memory pressure is over, restores what notifyLowMemory() lowered.
+    virtual void notifyMemoryRelieved() = 0;
+    virtual bool registerExternalTexture(int64_t texture_id) = 0;
+    virtual bool unregisterExternalTexture(int64_t texture_id) = 0;
+    virtual bool markExternalTextureFrameAvailable(int64_t texture_id) = 0;
     virtual FlutterEngineResult onVsync(const intptr_t baton, const uint64_t current_ns, const uint64_t finish_time_ns) = 0;
     virtual uint64_t getCurrentTime() = 0;
     virtual bool isStarted() const = 0;
+    // Platform thread, a frame even when nothing changed.
+    virtual bool scheduleFrame() = 0;
+    virtual bool sendPlatformMessage(const char *channel, const uint8_t *data, size_t size) = 0;
+    virtual bool respondPlatformMessage(const FlutterPlatformMessageResponseHandle *handle, const uint8_t *data, size_t size) = 0;
+    virtual void setPlatformMessageHandler(const std::string &channel, PlatformMessageHandler handler) = 0;
+    virtual TextInputPlugin *textInput() = 0;
+    virtual bool setSemanticsEnabled(bool enabled) = 0;
+    virtual bool dispatchSemanticsAction(int32_t id, FlutterSemanticsAction action) = 0;
+    virtual const SemanticsTree *semantics() const = 0;
 };
 
 class FlutterApplication : public Application {
@@ -40,14 +75,75 @@ public:
     FlutterApplication(RenderDisplay* display, const std::string &bundle_path, const std::vector<std::string> &command_line_args);
     ~FlutterApplication();
 
-    bool sendWindowMetrics(int32_t physical_width_, int32_t physical_height_, int32_t screen_width_, int32_t screen_height_) override;
-    void keyboardKey(const GdkEventType type, const xkb_keycode_t hardware_keycode, const xkb_keysym_t keysym, guint state, const uint32_t utf32) override;
+    bool sendWindowMetrics(int32_t physical_width_, int32_t physical_height_, int32_t screen_width_, int32_t screen_height_, double render_scale = 1.0) override;
+    void keyboardKey(const GdkEventType type, const xkb_keycode_t hardware_keycode, const xkb_keysym_t keysym, guint state, const uint32_t utf32, bool repeat = false) override;
     void onPointerEvent(const FlutterPointerPhase phase, uint32_t time, double x, double y) override;
+    bool sendLifecycleState(const AppLifecycleState state) override;
+    void notifyLowMemory(size_t skia_cache_bytes) override;
+    void notifyMemoryRelieved() override;
+    bool registerExternalTexture(int64_t texture_id) override;
+    bool unregisterExternalTexture(int64_t texture_id) override;
+    bool markExternalTextureFrameAvailable(int64_t texture_id) override;
     FlutterEngineResult onVsync(const intptr_t baton, const uint64_t current_ns, const uint64_t finish_time_ns) override;
     uint64_t getCurrentTime() override;
     bool isStarted() const override;
+    bool scheduleFrame() override;
+    bool sendPlatformMessage(const char *channel, const uint8_t *data, size_t size) override;
+    bool respondPlatformMessage(const FlutterPlatformMessageResponseHandle *handle, const uint8_t *data, size_t size) override;
+    void setPlatformMessageHandler(const std::string &channel, PlatformMessageHandler handler) override;
+    TextInputPlugin *textInput() override;
+    bool setSemanticsEnabled(bool enabled) override;
+    bool dispatchSemanticsAction(int32_t id, FlutterSemanticsAction action) override;
+    const SemanticsTree *semantics() const override;
 private:
+    RenderDisplay *display_ = nullptr;
+
+    // platform channels {
+    std::map<std::string, PlatformMessageHandler> message_handlers_;
+    TextInputPlugin text_input_;
+    PluginLoader plugins_; // destroyed after the engine shut down
+    void onPlatformMessage(const FlutterPlatformMessage *message);
+    // }
+
+    SemanticsTree semantics_;
+    void onSemanticsUpdate(const FlutterSemanticsUpdate2 *update);
+
+    // A key press waiting for the framework's replies, the text field only gets
+    // it when neither FlutterEngineSendKeyEvent nor flutter/keyevent handled it.
+    struct PendingKeyPress {
+      FlutterApplication *application;
+      xkb_keysym_t keysym;
+      uint32_t utf32;
+      guint state;
+      int replies  = 1; // one held by keyboardKey() until both are sent
+      bool handled = false;
+    };
+    static void onKeyReply(PendingKeyPress *pending, bool handled);
+
+    bool sendKeyEvent(const GdkEventType type, const xkb_keycode_t hardware_keycode, const xkb_keysym_t keysym, const uint32_t utf32, bool repeat, PendingKeyPress *pending);
+    bool sendLegacyKeyEvent(const GdkEventType type, const xkb_keycode_t hardware_keycode, const xkb_keysym_t keysym, guint state, const uint32_t utf32, PendingKeyPress *pending);
+
     FlutterEngine engine_ = nullptr;
+    double render_scale_  = 1.0; // of the last window metrics
+
+    // memory pressure {
+    // the engine's own limit when nobody set one, Shell::OnPlatformViewSetViewportMetrics()
+    static constexpr size_t kSkiaCacheBytesPerPixel = 4 * 12;
+    int32_t view_width_               = 0;
+    int32_t view_height_              = 0;
+    size_t skia_cache_bytes_          = 0; // set over flutter/skia, 0 while the engine derives it from the view size
+    size_t skia_cache_bytes_restored_ = 0; // to restore once the pressure is over
+    bool skia_cache_lowered_          = false;
+    bool setSkiaCacheMaxBytes(size_t bytes);
+    // }
+
+    // keyboard {
+    bool key_event_api_ = true; // cleared when the engine predates FlutterEngineSendKeyEvent
+    struct KeyTiming {
+      uint64_t events   = 0;
+      uint64_t total_ns = 0;
+    } key_event_timing_, legacy_key_event_timing_;
+    // }
 };
 
 }
@@ -0,0 +1,50 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// The interface of native plugin modules, shared objects the embedder loads
+// when the first message on one of their channels arrives (see
+// src/plugin_loader.h for the manifest listing them). A module exports
+//
+//   bool FlutterWaylandPluginInit(const FlutterWaylandPluginHost *host, FlutterWaylandPlugin *plugin);
+//
+// called once per engine, on the platform thread, like every other call in
+// either direction.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <flutter_embedder.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLUTTER_WAYLAND_PLUGIN_INIT "FlutterWaylandPluginInit"
+
+// Valid until the plugin's destroy().
+typedef struct {
+  size_t struct_size;
+  void *host_data;
+  bool (*send_message)(void *host_data, const char *channel, const uint8_t *message, size_t message_size);
+  // Every message handed to the plugin is responded to exactly once, possibly later.
+  bool (*respond)(void *host_data, const FlutterPlatformMessageResponseHandle *response_handle, const uint8_t *message, size_t message_size);
+} FlutterWaylandPluginHost;
+
+// Filled in by FlutterWaylandPluginInit().
+typedef struct {
+  size_t struct_size;
+  void *user_data;
+  void (*handle_message)(void *user_data, const FlutterPlatformMessage *message);
+  // The engine is gone, pending responses are dropped. May be null.
+  void (*destroy)(void *user_data);
+} FlutterWaylandPlugin;
+
+typedef bool (*FlutterWaylandPluginInitFn)(const FlutterWaylandPluginHost *host, FlutterWaylandPlugin *plugin);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,463 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "frame_capture.h"
+#include "utils.h"
+
+namespace flutter {
+
+static std::atomic<unsigned> next_instance = 0;
+
+FrameCapture::FrameCapture()
+    : instance_(next_instance++), directory_(getEnv("FLUTTER_WAYLAND_CAPTURE_DIR", std::string(""))), shm_name_(getEnv("FLUTTER_WAYLAND_CAPTURE_SHM", std::string(""))),
+      socket_path_(getEnv("FLUTTER_WAYLAND_CAPTURE_SOCKET", std::string(""))), every_(static_cast<uint64_t>(getEnv("FLUTTER_WAYLAND_CAPTURE_EVERY", 0.))) {
+  const auto format = getEnv("FLUTTER_WAYLAND_CAPTURE_FORMAT", std::string("ppm"));
+
+  if (format == "raw") {
+    format_ = Format::RAW;
+  } else if (format != "ppm") {
+    FL_WARN("Unknown FLUTTER_WAYLAND_CAPTURE_FORMAT: %s, using ppm", format.c_str());
+  }
+
+  if (instance_ != 0 && !shm_name_.empty()) {
+    // one region per window
+    shm_name_ += "-" + std::to_string(instance_);
+  }
+
+  if (instance_ != 0 && !socket_path_.empty()) {
+    socket_path_ += "-" + std::to_string(instance_);
+  }
+
+  if (IsEnabled()) {
+    thread_ = std::thread(&FrameCapture::Run, this);
+
+    FL_INFO("Frame capture:%s%s%s, every %ju frames and on SIGUSR1%s%s", directory_.empty() ? "" : " into ", directory_.c_str(), shm_name_.empty() ? "" : (" shm " + shm_name_).c_str(), every_,
+            socket_path_.empty() ? "" : " or a connection to ", socket_path_.c_str());
+  }
+}
+
+FrameCapture::~FrameCapture() {
+  // the pixel buffers go with the onscreen context
+  Stop();
+}
+
+bool FrameCapture::IsEnabled() const {
+  return !directory_.empty() || !shm_name_.empty();
+}
+
+bool FrameCapture::Attach(uv_loop_t *loop, ScheduleFrameCallback schedule_frame) {
+  if (!IsEnabled()) {
+    return true;
+  }
+
+  schedule_frame_ = std::move(schedule_frame);
+
+  signal_handle_       = new uv_signal_t;
+  signal_handle_->data = this;
+  uv_signal_init(loop, signal_handle_);
+  uv_signal_start(signal_handle_, [](uv_signal_t *handle, int signum) { static_cast<FrameCapture *>(handle->data)->Request(); }, SIGUSR1);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    schedule_frame_async_       = new uv_async_t;
+    schedule_frame_async_->data = this;
+    uv_async_init(loop, schedule_frame_async_, [](uv_async_t *handle) { static_cast<FrameCapture *>(handle->data)->schedule_frame_(); });
+  }
+
+  if (socket_path_.empty()) {
+    return true;
+  }
+
+  // left behind by a previous instance which did not exit cleanly
+  unlink(socket_path_.c_str());
+
+  server_handle_       = new uv_pipe_t;
+  server_handle_->data = this;
+  uv_pipe_init(loop, server_handle_, 0);
+
+  int status = uv_pipe_bind(server_handle_, socket_path_.c_str());
+
+  if (status == 0) {
+    status = uv_listen(reinterpret_cast<uv_stream_t *>(server_handle_), 4, [](uv_stream_t *handle, int status) { static_cast<FrameCapture *>(handle->data)->OnConnection(status); });
+  }
+
+  if (status != 0) {
+    FL_ERROR("Could not take capture requests on %s: %s", socket_path_.c_str(), uv_strerror(status));
+    Detach();
+    return false;
+  }
+
+  return true;
+}
+
+void FrameCapture::Detach() {
+  if (signal_handle_ == nullptr) {
+    return;
+  }
+
+  uv_signal_stop(signal_handle_);
+  uv_close(reinterpret_cast<uv_handle_t *>(signal_handle_), [](uv_handle_t *handle) { delete reinterpret_cast<uv_signal_t *>(handle); });
+  signal_handle_ = nullptr;
+
+  {
+    // the raster thread may still present
+    std::lock_guard<std::mutex> lock(mutex_);
+    uv_close(reinterpret_cast<uv_handle_t *>(schedule_frame_async_), [](uv_handle_t *handle) { delete reinterpret_cast<uv_async_t *>(handle); });
+    schedule_frame_async_ = nullptr;
+  }
+
+  if (server_handle_ != nullptr) {
+    uv_close(reinterpret_cast<uv_handle_t *>(server_handle_), [](uv_handle_t *handle) { delete reinterpret_cast<uv_pipe_t *>(handle); });
+    server_handle_ = nullptr;
+    unlink(socket_path_.c_str());
+  }
+}
+
+void FrameCapture::OnConnection(int status) {
+  if (status != 0) {
+    FL_WARN("Capture connection failed: %s", uv_strerror(status));
+    return;
+  }
+
+  // nothing is read or written, the connection itself is the request
+  uv_pipe_t *client = new uv_pipe_t;
+  uv_pipe_init(server_handle_->loop, client, 0);
+
+  if (uv_accept(reinterpret_cast<uv_stream_t *>(server_handle_), reinterpret_cast<uv_stream_t *>(client)) == 0) {
+    Request();
+  }
+
+  uv_close(reinterpret_cast<uv_handle_t *>(client), [](uv_handle_t *handle) { delete reinterpret_cast<uv_pipe_t *>(handle); });
+}
+
+void FrameCapture::Request() {
+  requested_ = true;
+
+  // a static UI presents nothing by itself
+  if (schedule_frame_) {
+    schedule_frame_();
+  }
+}
+
+void FrameCapture::OnPresent(uint32_t width, uint32_t height, uint64_t now_ns) {
+  if (!IsEnabled() || !supported_) {
+    return;
+  }
+
+  if (!checked_) {
+    const char *version = reinterpret_cast<const char *>(glGetString(GL_VERSION));
+    int major           = 0;
+
+    checked_   = true;
+    supported_ = version && sscanf(version, "OpenGL ES %d", &major) == 1 && major >= 3;
+
+    if (!supported_) {
+      FL_WARN("Frame capture needs OpenGL ES 3.0 for pixel buffers, got %s, disabled", version ? version : "?");
+      return;
+    }
+  }
+
+  // the next frame maps or unmaps what is in flight, it has to come
+  if (Harvest()) {
+    ScheduleHarvest();
+  }
+
+  frames_++;
+
+  if (!requested_.exchange(false) && (every_ == 0 || frames_ % every_ != 0)) {
+    return;
+  }
+
+  Slot *slot = nullptr;
+
+  for (auto &candidate : slots_) {
+    if (candidate.state.load(std::memory_order_acquire) == SlotState::FREE) {
+      slot = &candidate;
+      break;
+    }
+  }
+
+  if (slot == nullptr) {
+    // the worker (or the GPU) did not keep up, never wait for it here
+    if (++skipped_ % 100 == 1) {
+      FL_WARN("Frame capture: %ju frames skipped, no free pixel buffer", skipped_);
+    }
+    return;
+  }
+
+  if (slot->buffer == 0) {
+    glGenBuffers(1, &slot->buffer);
+  }
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+
+  if (slot->width != width || slot->height != height) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(width) * height * 4, nullptr, GL_STREAM_READ);
+    slot->width  = width;
+    slot->height = height;
+  }
+
+  // the back buffer of the default framebuffer, the swap follows
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  slot->fence    = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot->frame_ns = now_ns;
+  slot->sequence = ++captures_;
+  slot->state.store(SlotState::READING, std::memory_order_release);
+
+  ScheduleHarvest();
+}
+
+void FrameCapture::ScheduleHarvest() {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (schedule_frame_async_ != nullptr) {
+    uv_async_send(schedule_frame_async_);
+  }
+}
+
+// Raster thread: maps what the GPU finished and unmaps what the worker wrote.
+bool FrameCapture::Harvest() {
+  for (auto &slot : slots_) {
+    switch (slot.state.load(std::memory_order_acquire)) {
+    case SlotState::WRITTEN:
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+      slot.pixels = nullptr;
+      slot.state.store(SlotState::FREE, std::memory_order_release);
+      break;
+
+    case SlotState::READING: {
+      const GLenum status = glClientWaitSync(slot.fence, 0, 0);
+
+      if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+        break;
+      }
+
+      glDeleteSync(slot.fence);
+      slot.fence = nullptr;
+
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+      slot.pixels = static_cast<const uint8_t *>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(slot.width) * slot.height * 4, GL_MAP_READ_BIT));
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+      if (slot.pixels == nullptr) {
+        FL_ERROR("Frame capture: could not map a pixel buffer (0x%x)", glGetError());
+        slot.state.store(SlotState::FREE, std::memory_order_release);
+        break;
+      }
+
+      slot.state.store(SlotState::MAPPED, std::memory_order_release);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(&slot);
+      }
+
+      condition_.notify_one();
+      break;
+    }
+
+    default:
+      break;
+    }
+  }
+
+  return std::any_of(std::begin(slots_), std::end(slots_), [](const Slot &slot) { return slot.state.load(std::memory_order_acquire) != SlotState::FREE; });
+}
+
+void FrameCapture::Stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+
+  condition_.notify_one();
+  thread_.join();
+
+  if (shm_ != nullptr) {
+    munmap(shm_, shm_size_);
+    shm_ = nullptr;
+  }
+
+  if (shm_fd_ != -1) {
+    // a co-process keeps its mapping
+    close(shm_fd_);
+    shm_unlink(shm_name_.c_str());
+    shm_fd_ = -1;
+  }
+}
+
+void FrameCapture::Run() {
+  pthread_setname_np(pthread_self(), "capture");
+
+  // captures already mapped are still written on stop
+  while (true) {
+    Slot *slot;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      condition_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+
+      if (queue_.empty()) {
+        break;
+      }
+
+      slot = queue_.front();
+      queue_.pop_front();
+    }
+
+    Write(slot);
+    slot->state.store(SlotState::WRITTEN, std::memory_order_release);
+  }
+}
+
+void FrameCapture::Write(Slot *slot) {
+  const uint64_t start_ns = FlutterEngineGetCurrentTime();
+
+  if (!directory_.empty()) {
+    WriteFile(*slot);
+  }
+
+  if (!shm_name_.empty()) {
+    WriteShm(*slot);
+  }
+
+  FL_DEBUG("Frame capture %u: %ux%u written in %.1f ms", slot->sequence, slot->width, slot->height, (FlutterEngineGetCurrentTime() - start_ns) / 1e6);
+}
+
+void FrameCapture::WriteFile(const Slot &slot) {
+  char name[64];
+  snprintf(name, sizeof(name), "/window%u-%06u.%s", instance_, slot.sequence, format_ == Format::PPM ? "ppm" : "rgba");
+
+  const std::string path = directory_ + name;
+  FILE *file             = fopen(path.c_str(), "wb");
+
+  if (file == nullptr) {
+    FL_ERROR("Frame capture: could not write %s: %s", path.c_str(), strerror(errno));
+    return;
+  }
+
+  const size_t stride = slot.width * 4;
+  std::vector<uint8_t> row(format_ == Format::PPM ? slot.width * 3 : 0);
+
+  if (format_ == Format::PPM) {
+    fprintf(file, "P6\n%u %u\n255\n", slot.width, slot.height);
+  }
+
+  // GL rows start at the bottom
+  for (uint32_t y = slot.height; y-- > 0;) {
+    const uint8_t *pixels = slot.pixels + y * stride;
+
+    if (format_ == Format::RAW) {
+      fwrite(pixels, 1, stride, file);
+      continue;
+    }
+
+    for (uint32_t x = 0; x < slot.width; x++) {
+      row[x * 3 + 0] = pixels[x * 4 + 0];
+      row[x * 3 + 1] = pixels[x * 4 + 1];
+      row[x * 3 + 2] = pixels[x * 4 + 2];
+    }
+
+    fwrite(row.data(), 1, row.size(), file);
+  }
+
+  if (fclose(file) != 0) {
+    FL_ERROR("Frame capture: could not write %s: %s", path.c_str(), strerror(errno));
+  }
+}
+
+void FrameCapture::WriteShm(const Slot &slot) {
+  const size_t stride = slot.width * 4;
+  const size_t size   = sizeof(FrameCaptureShmHeader) + stride * slot.height;
+  bool full           = false;
+
+  if (shm_fd_ == -1) {
+    shm_fd_ = shm_open(shm_name_.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0600);
+
+    if (shm_fd_ == -1) {
+      FL_ERROR("Frame capture: could not open shm %s: %s", shm_name_.c_str(), strerror(errno));
+      shm_name_.clear();
+      return;
+    }
+  }
+
+  if (size != shm_size_) {
+    if (shm_ != nullptr) {
+      munmap(shm_, shm_size_);
+      shm_      = nullptr;
+      shm_size_ = 0;
+    }
+
+    if (ftruncate(shm_fd_, size) != 0) {
+      FL_ERROR("Frame capture: could not resize shm %s: %s", shm_name_.c_str(), strerror(errno));
+      return;
+    }
+
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd_, 0);
+
+    if (memory == MAP_FAILED) {
+      FL_ERROR("Frame capture: could not map shm %s: %s", shm_name_.c_str(), strerror(errno));
+      return;
+    }
+
+    shm_         = static_cast<FrameCaptureShmHeader *>(memory);
+    shm_size_    = size;
+    shm_->magic  = FrameCaptureShmHeader::kMagic;
+    shm_->width  = slot.width;
+    shm_->height = slot.height;
+    shm_->stride = stride;
+    full         = true;
+  }
+
+  uint8_t *rows           = reinterpret_cast<uint8_t *>(shm_ + 1);
+  uint32_t top            = slot.height;
+  uint32_t bottom         = 0;
+  const uint32_t sequence = shm_->sequence.load(std::memory_order_relaxed);
+
+  shm_->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  // only rows which changed are copied, a static UI costs a compare per row
+  for (uint32_t y = 0; y < slot.height; y++) {
+    const uint8_t *source = slot.pixels + (slot.height - 1 - y) * stride;
+    uint8_t *target       = rows + y * stride;
+
+    if (!full && memcmp(target, source, stride) == 0) {
+      continue;
+    }
+
+    memcpy(target, source, stride);
+    top    = std::min(top, y);
+    bottom = y + 1;
+  }
+
+  shm_->damage_top    = top < bottom ? top : 0;
+  shm_->damage_bottom = bottom;
+  shm_->frame_time_ns = slot.frame_ns;
+
+  shm_->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+} // namespace flutter
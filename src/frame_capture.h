@@ -0,0 +1,144 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <GLES3/gl3.h>
+#include <uv.h>
+
+#include "macros.h"
+
+namespace flutter {
+
+// Layout of the shared memory region (FLUTTER_WAYLAND_CAPTURE_SHM) for a
+// co-process, followed by height rows of RGBA pixels, top row first. sequence
+// is odd while a frame is being written, readers retry when it changed.
+struct FrameCaptureShmHeader {
+  static constexpr uint32_t kMagic = 0x46435031; // "FCP1"
+
+  uint32_t magic;
+  uint32_t width;
+  uint32_t height;
+  uint32_t stride;
+  std::atomic<uint32_t> sequence;
+  uint32_t damage_top; // rows [damage_top, damage_bottom) changed with the last frame
+  uint32_t damage_bottom;
+  uint64_t frame_time_ns;
+};
+
+// Captures rendered frames without stalling the raster thread: glReadPixels()
+// goes into a ring of pixel buffer objects, which are mapped once their fence
+// signalled, usually a frame or two later. A worker thread writes the mapped
+// pixels out, the raster thread unmaps them when the worker is done. A frame
+// finding no free buffer is skipped. Needs an OpenGL ES 3.0 context.
+//
+// A request schedules a frame, so a static UI gets captured too, and frames
+// keep being scheduled while a capture is in flight, until it is written.
+//
+// Configured through the environment:
+//   FLUTTER_WAYLAND_CAPTURE_DIR    - writes captures into this directory
+//   FLUTTER_WAYLAND_CAPTURE_FORMAT - ppm (default) or raw (RGBA, top row first)
+//   FLUTTER_WAYLAND_CAPTURE_SHM    - shm_open() name of a region the latest capture is
+//                                    copied into, only the rows which changed
+//   FLUTTER_WAYLAND_CAPTURE_EVERY  - captures every n-th frame, 0 only on request (default: 0)
+//   FLUTTER_WAYLAND_CAPTURE_SOCKET - path of a Unix domain socket, every connection requests
+//                                    a capture, e.g. socat -u /dev/null UNIX-CONNECT:path
+//
+// SIGUSR1 requests a capture as well.
+class FrameCapture {
+public:
+  using ScheduleFrameCallback = std::function<void()>;
+
+  FrameCapture();
+
+  ~FrameCapture();
+
+  bool IsEnabled() const;
+
+  // Platform thread, the request triggers live on the loop.
+  bool Attach(uv_loop_t *loop, ScheduleFrameCallback schedule_frame);
+  void Detach();
+
+  // Platform thread, captures the next frame.
+  void Request();
+
+  // Raster thread, right before the swap.
+  void OnPresent(uint32_t width, uint32_t height, uint64_t now_ns);
+
+  void Stop();
+
+private:
+  enum class SlotState { FREE, READING, MAPPED, WRITTEN };
+
+  struct Slot {
+    GLuint buffer                = 0;
+    GLsync fence                 = nullptr;
+    uint32_t width               = 0;
+    uint32_t height              = 0;
+    uint64_t frame_ns            = 0;
+    uint32_t sequence            = 0;
+    const uint8_t *pixels        = nullptr; // mapped while MAPPED and WRITTEN
+    std::atomic<SlotState> state = SlotState::FREE;
+  };
+
+  static constexpr size_t kSlots = 3;
+
+  enum class Format { PPM, RAW };
+
+  const unsigned instance_;
+  std::string directory_;
+  Format format_ = Format::PPM;
+  std::string shm_name_;
+  std::string socket_path_;
+  uint64_t every_ = 0;
+
+  // platform thread {
+  ScheduleFrameCallback schedule_frame_;
+  uv_signal_t *signal_handle_ = nullptr;
+  uv_pipe_t *server_handle_   = nullptr;
+  void OnConnection(int status);
+  // }
+
+  uv_async_t *schedule_frame_async_ = nullptr; // guarded by mutex_, the raster thread asks for frames to harvest
+
+  bool supported_              = true; // turned off when the context is not ES 3
+  bool checked_                = false;
+  uint64_t frames_             = 0;
+  uint32_t captures_           = 0;
+  uint64_t skipped_            = 0;
+  std::atomic<bool> requested_ = false;
+  Slot slots_[kSlots];
+
+  // worker {
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::deque<Slot *> queue_;
+  bool stopping_              = false;
+  int shm_fd_                 = -1;
+  FrameCaptureShmHeader *shm_ = nullptr;
+  size_t shm_size_            = 0;
+  void Run();
+  void Write(Slot *slot);
+  void WriteFile(const Slot &slot);
+  void WriteShm(const Slot &slot);
+  // }
+
+  bool Harvest(); // true while a capture is in flight
+  void ScheduleHarvest();
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(FrameCapture)
+};
+
+} // namespace flutter
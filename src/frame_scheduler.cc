@@ -0,0 +1,102 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+
+#include "utils.h"
+#include "frame_scheduler.h"
+
+namespace flutter {
+
+FrameScheduler::FrameScheduler()
+    : low_latency_(getEnv("FLUTTER_WAYLAND_FRAME_SCHEDULE", std::string("throughput")) == "latency")
+    , margin_ns_(std::max(0., getEnv("FLUTTER_WAYLAND_FRAME_MARGIN_US", 3000.)) * 1000) {
+  FL_INFO("Frame schedule: %s, margin: %ju us", low_latency_ ? "latency" : "throughput", margin_ns_ / 1000);
+}
+
+bool FrameScheduler::IsLowLatency() const {
+  return low_latency_;
+}
+
+FrameScheduler::Slot FrameScheduler::Schedule(uint64_t now_ns, uint64_t last_vsync_ns, uint64_t period_ns) const {
+  const uint64_t after_vsync_time_ns       = (now_ns - last_vsync_ns) % period_ns;
+  const uint64_t before_next_vsync_time_ns = period_ns - after_vsync_time_ns;
+  const uint64_t next_vsync_ns             = now_ns + before_next_vsync_time_ns;
+  const uint64_t work_ns                   = work_ns_;
+
+  if (!low_latency_ || work_ns == 0) {
+    return {now_ns, next_vsync_ns, next_vsync_ns + period_ns};
+  }
+
+  // the first vsync we can still make, a frame longer than a period keeps being pipelined
+  const uint64_t needed_ns = work_ns + margin_ns_;
+  uint64_t target_ns       = next_vsync_ns;
+
+  while (target_ns < now_ns + needed_ns) {
+    target_ns += period_ns;
+  }
+
+  const uint64_t deliver_ns = std::max(now_ns, target_ns - needed_ns);
+
+  return {deliver_ns, deliver_ns, target_ns};
+}
+
+void FrameScheduler::FrameDelivered(uint64_t now_ns) {
+  delivered_ns_ = now_ns;
+
+  // the first frame started after an input is the one showing it
+  if (frame_input_ns_ == 0) {
+    const uint64_t input_ns = input_ns_.exchange(0);
+
+    if (input_ns != 0) {
+      frame_input_swapped_ = false;
+      frame_input_ns_      = input_ns;
+    }
+  }
+}
+
+void FrameScheduler::FrameSwapped(uint64_t now_ns) {
+  const uint64_t delivered_ns = delivered_ns_;
+
+  if (delivered_ns != 0 && now_ns > delivered_ns) {
+    work_samples_[next_work_sample_] = now_ns - delivered_ns;
+    next_work_sample_                = (next_work_sample_ + 1) % kWorkSamples;
+    work_ns_                         = *std::max_element(std::begin(work_samples_), std::end(work_samples_));
+  }
+
+  if (frame_input_ns_ != 0) {
+    frame_input_swapped_ = true;
+  }
+}
+
+void FrameScheduler::FrameShown(uint64_t shown_ns) {
+  const uint64_t input_ns = frame_input_ns_;
+
+  if (input_ns == 0 || !frame_input_swapped_ || shown_ns < input_ns) {
+    return;
+  }
+
+  frame_input_ns_ = 0;
+
+  const uint64_t latency_ns = shown_ns - input_ns;
+  latency_total_ns_ += latency_ns;
+  latency_max_ns_ = std::max(latency_max_ns_, latency_ns);
+
+  if (++latency_samples_ == kLatencyReportAt) {
+    FL_INFO("Frame schedule %s: input-to-photon avg: %.2f ms max: %.2f ms, frame time: %.2f ms", low_latency_ ? "latency" : "throughput", latency_total_ns_ / 1e6 / latency_samples_, latency_max_ns_ / 1e6, work_ns_ / 1e6);
+
+    latency_total_ns_ = 0;
+    latency_max_ns_   = 0;
+    latency_samples_  = 0;
+  }
+}
+
+void FrameScheduler::InputReceived(uint64_t now_ns) {
+  uint64_t expected = 0;
+
+  // the oldest input not yet on screen counts
+  input_ns_.compare_exchange_strong(expected, now_ns);
+}
+
+} // namespace flutter
@@ -0,0 +1,75 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "macros.h"
+
+namespace flutter {
+
+// Decides when the engine's vsync request is answered and which frame times
+// it gets.
+//
+// throughput: answered right away, the frame starts at the next vsync and is
+//             due one period later (pipelined, a frame of latency to spare).
+// latency:    answered as late as the measured frame time (vsync answer to
+//             buffer swap) allows, so the frame is swapped just before the
+//             compositor latches for the next vsync.
+//
+// The input-to-photon latency (input event to presentation of the first frame
+// started after it) is measured in both modes and logged periodically.
+//
+// Configured through the environment:
+//   FLUTTER_WAYLAND_FRAME_SCHEDULE  - throughput or latency (default: throughput)
+//   FLUTTER_WAYLAND_FRAME_MARGIN_US - time the swap has to happen before the vsync (default: 3000)
+class FrameScheduler {
+public:
+  struct Slot {
+    uint64_t deliver_ns;      // when to answer the vsync request
+    uint64_t frame_start_ns;  // frame_start_time_nanos for the engine
+    uint64_t frame_target_ns; // frame_target_time_nanos for the engine
+  };
+
+  FrameScheduler();
+
+  bool IsLowLatency() const;
+
+  // Vsync thread.
+  Slot Schedule(uint64_t now_ns, uint64_t last_vsync_ns, uint64_t period_ns) const;
+  void FrameDelivered(uint64_t now_ns);
+  void FrameShown(uint64_t shown_ns);
+
+  // Raster thread, after the buffer swap.
+  void FrameSwapped(uint64_t now_ns);
+
+  // Platform thread.
+  void InputReceived(uint64_t now_ns);
+
+private:
+  static constexpr size_t kWorkSamples       = 8;
+  static constexpr uint32_t kLatencyReportAt = 50;
+
+  bool low_latency_;
+  uint64_t margin_ns_;
+
+  std::atomic<uint64_t> delivered_ns_  = 0;
+  std::atomic<uint64_t> work_ns_       = 0; // longest of the recent frames, 0 until measured
+  uint64_t work_samples_[kWorkSamples] = {};
+  size_t next_work_sample_             = 0;
+
+  // input-to-photon, an input waits for the next delivered frame, then for it to be swapped and shown
+  std::atomic<uint64_t> input_ns_        = 0;
+  std::atomic<uint64_t> frame_input_ns_  = 0;
+  std::atomic<bool> frame_input_swapped_ = false;
+  uint64_t latency_total_ns_             = 0;
+  uint64_t latency_max_ns_               = 0;
+  uint32_t latency_samples_              = 0;
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(FrameScheduler)
+};
+
+} // namespace flutter
@@ -0,0 +1,461 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <signal.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+
+#include <GLES2/gl2.h>
+
+#include <uv.h>
+
+#include "headless_display.h"
+#include "input_log.h"
+#include "platform_task_runner.h"
+#include "semantics.h"
+#include "thread_policy.h"
+#include "utils.h"
+
+namespace flutter {
+
+static inline HeadlessDisplay *get_headless_display(void *data) {
+  HeadlessDisplay *const hd = static_cast<HeadlessDisplay *>(data);
+
+  if (hd == nullptr) {
+    abort();
+  }
+
+  return hd;
+}
+
+HeadlessDisplay::HeadlessDisplay(size_t width, size_t height, double refresh_hz, const EGLFramebufferConfig &framebuffer_config)
+    : width_(width), height_(height), period_ns_(refresh_hz > 0 ? static_cast<uint64_t>(1e9 / refresh_hz) : 0), frame_limit_(static_cast<uint64_t>(getEnv("FLUTTER_WAYLAND_HEADLESS_FRAMES", 0.))), framebuffer_config_(framebuffer_config) {
+  framebuffer_config_.surface_type = EGL_PBUFFER_BIT;
+
+  if (!SetupEGL()) {
+    return;
+  }
+
+  if (refresh_hz > 0) {
+    FL_INFO("Headless: %dx%d, synthetic vsync at %.2f Hz", width_, height_, refresh_hz);
+  } else {
+    FL_INFO("Headless: %dx%d, benchmark mode, vsync requests are answered right away", width_, height_);
+  }
+
+  clock_start_ns_ = FlutterEngineGetCurrentTime();
+  vsync_thread_   = std::thread(&HeadlessDisplay::VsyncThreadMain, this);
+  valid_          = true;
+}
+
+HeadlessDisplay::~HeadlessDisplay() {
+  if (vsync_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(vsync_mutex_);
+      vsync_stop_ = true;
+    }
+
+    vsync_condition_.notify_one();
+    vsync_thread_.join();
+  }
+
+  frame_capture_.Stop();
+
+  if (frame_fence_ != EGL_NO_SYNC_KHR) {
+    egl_destroy_sync_(egl_display_, frame_fence_);
+    frame_fence_ = EGL_NO_SYNC_KHR;
+  }
+
+  if (egl_display_ != EGL_NO_DISPLAY) {
+    // destroys the surfaces and contexts with it
+    eglTerminate(egl_display_);
+    egl_display_ = EGL_NO_DISPLAY;
+  }
+}
+
+bool HeadlessDisplay::IsValid() const {
+  return valid_;
+}
+
+bool HeadlessDisplay::SetupEGL() {
+  // client extensions, EGL_NO_DISPLAY lists those
+  if (HasEGLExtension(EGL_NO_DISPLAY, "EGL_MESA_platform_surfaceless")) {
+    auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+
+    if (get_platform_display != nullptr) {
+      egl_display_ = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+  }
+
+  if (egl_display_ == EGL_NO_DISPLAY) {
+    FL_INFO("Headless: no surfaceless platform, using the default EGL display");
+    egl_display_ = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+
+  if (egl_display_ == EGL_NO_DISPLAY) {
+    LogLastEGLError();
+    FL_ERROR("Could not access EGL display.");
+    return false;
+  }
+
+  if (eglInitialize(egl_display_, nullptr, nullptr) != EGL_TRUE) {
+    LogLastEGLError();
+    FL_ERROR("Could not initialize EGL display.");
+    egl_display_ = EGL_NO_DISPLAY;
+    return false;
+  }
+
+  if (eglBindAPI(EGL_OPENGL_ES_API) != EGL_TRUE) {
+    LogLastEGLError();
+    FL_ERROR("Could not bind the ES API.");
+    return false;
+  }
+
+  FL_INFO("EGL framebuffer: %s", framebuffer_config_.ToString().c_str());
+
+  EGLConfig egl_config = ChooseEGLConfig(egl_display_, framebuffer_config_);
+
+  if (egl_config == nullptr) {
+    FL_ERROR("Could not choose an EGL config.");
+    return false;
+  }
+
+  const EGLint ctx_attribs[]     = {EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE};
+  const EGLint pbuffer_attribs[] = {EGL_WIDTH, width_, EGL_HEIGHT, height_, EGL_NONE};
+
+  egl_context_          = eglCreateContext(egl_display_, egl_config, nullptr /* share group */, ctx_attribs);
+  resource_egl_context_ = eglCreateContext(egl_display_, egl_config, egl_context_ /* share group */, ctx_attribs);
+
+  if (egl_context_ == EGL_NO_CONTEXT || resource_egl_context_ == EGL_NO_CONTEXT) {
+    LogLastEGLError();
+    FL_ERROR("Could not create the EGL contexts.");
+    return false;
+  }
+
+  egl_surface_ = eglCreatePbufferSurface(egl_display_, egl_config, pbuffer_attribs);
+
+  if (egl_surface_ == EGL_NO_SURFACE) {
+    LogLastEGLError();
+    FL_ERROR("Could not create the %dx%d pbuffer.", width_, height_);
+    return false;
+  }
+
+  if (!HasEGLExtension(egl_display_, "EGL_KHR_surfaceless_context")) {
+    const EGLint resource_attribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+    resource_egl_surface_           = eglCreatePbufferSurface(egl_display_, egl_config, resource_attribs);
+  }
+
+  if (HasEGLExtension(egl_display_, "EGL_KHR_fence_sync")) {
+    egl_create_sync_      = reinterpret_cast<PFNEGLCREATESYNCKHRPROC>(eglGetProcAddress("eglCreateSyncKHR"));
+    egl_destroy_sync_     = reinterpret_cast<PFNEGLDESTROYSYNCKHRPROC>(eglGetProcAddress("eglDestroySyncKHR"));
+    egl_client_wait_sync_ = reinterpret_cast<PFNEGLCLIENTWAITSYNCKHRPROC>(eglGetProcAddress("eglClientWaitSyncKHR"));
+  }
+
+  return true;
+}
+
+void HeadlessDisplay::onEngineStarted() {
+  application->sendWindowMetrics(0, 0, width_, height_);
+  application->sendLifecycleState(AppLifecycleState::resumed);
+
+  std::lock_guard<std::mutex> lock(vsync_mutex_);
+  engine_running_ = true;
+
+  // a baton the engine sent while starting was held back
+  vsync_condition_.notify_one();
+}
+
+void HeadlessDisplay::onEngineStopping() {
+  std::lock_guard<std::mutex> lock(vsync_mutex_);
+  engine_running_ = false;
+  application     = nullptr;
+}
+
+void HeadlessDisplay::onEngineStopped() {
+  {
+    std::lock_guard<std::mutex> lock(vsync_mutex_);
+    baton_ = 0;
+  }
+
+  // the raster thread is gone with the engine
+  ReportFrameTimes();
+}
+
+void HeadlessDisplay::vsync_callback(void *data, intptr_t baton) {
+  {
+    std::lock_guard<std::mutex> lock(vsync_mutex_);
+
+    if (baton_ != 0) {
+      FL_ERROR("vsync.wait: New baton arrived, but old was not sent.");
+      exit(1);
+    }
+
+    baton_ = baton;
+  }
+
+  vsync_condition_.notify_one();
+}
+
+void HeadlessDisplay::VsyncThreadMain() {
+  pthread_setname_np(pthread_self(), "vsync");
+  ThreadPolicy::Instance().Apply(ThreadPolicy::Role::VSYNC);
+
+  std::unique_lock<std::mutex> lock(vsync_mutex_);
+
+  while (true) {
+    vsync_condition_.wait(lock, [this] { return vsync_stop_ || (baton_ != 0 && engine_running_); });
+
+    if (vsync_stop_) {
+      break;
+    }
+
+    uint64_t now_ns = FlutterEngineGetCurrentTime();
+    uint64_t vsync_ns, target_ns;
+
+    if (period_ns_ == 0) {
+      // a nominal 60 Hz budget, the engine schedules idle work with it
+      vsync_ns  = now_ns;
+      target_ns = now_ns + 1000000000 / 60;
+    } else {
+      // the next tick of a clock which started with the display
+      vsync_ns  = clock_start_ns_ + ((now_ns - clock_start_ns_) / period_ns_ + 1) * period_ns_;
+      target_ns = vsync_ns + period_ns_;
+
+      vsync_condition_.wait_for(lock, std::chrono::nanoseconds(vsync_ns - now_ns), [this] { return vsync_stop_ || !engine_running_; });
+
+      if (vsync_stop_) {
+        break;
+      }
+
+      if (!engine_running_) {
+        continue;
+      }
+    }
+
+    const intptr_t baton = baton_;
+    baton_               = 0;
+
+    vsync_delivered_ns_ = FlutterEngineGetCurrentTime();
+
+    if (application->onVsync(baton, vsync_ns, target_ns) != kSuccess) {
+      FL_ERROR("vsync.ntfy: FlutterEngineOnVsync failed: baton: %p", reinterpret_cast<void *>(baton));
+    }
+  }
+}
+
+// Raster thread, after the swap.
+void HeadlessDisplay::OnPresent() {
+  const uint64_t now_ns       = FlutterEngineGetCurrentTime();
+  const uint64_t delivered_ns = vsync_delivered_ns_;
+
+  if (last_present_ns_ != 0) {
+    frame_intervals_.Add(static_cast<uint32_t>((now_ns - last_present_ns_) / 1000));
+  }
+
+  if (delivered_ns != 0 && delivered_ns < now_ns) {
+    frame_latencies_.Add(static_cast<uint32_t>((now_ns - delivered_ns) / 1000));
+  }
+
+  last_present_ns_ = now_ns;
+  frames_++;
+
+  InputReplay::FramePresented();
+}
+
+void HeadlessDisplay::FrameTimes::Add(uint32_t us) {
+  buckets[std::min<size_t>(us / kBucketUs, kBuckets)]++;
+  count++;
+  total_us += us;
+  max_us = std::max(max_us, us);
+}
+
+double HeadlessDisplay::FrameTimes::PercentileMs(double p) const {
+  const uint64_t rank = std::min<uint64_t>(count - 1, static_cast<uint64_t>(p * count));
+  uint64_t seen       = 0;
+
+  for (size_t i = 0; i < kBuckets; i++) {
+    seen += buckets[i];
+
+    if (seen > rank) {
+      return std::min<uint32_t>((i + 1) * kBucketUs, max_us) / 1000.0;
+    }
+  }
+
+  return max_us / 1000.0;
+}
+
+void HeadlessDisplay::ReportFrameTimes() {
+  auto report = [](const char *name, const FrameTimes &times) {
+    if (times.count == 0) {
+      return;
+    }
+
+    FL_INFO("Headless: %s ms: p50 %.2f, p90 %.2f, p99 %.2f, max %.2f (%ju frames)", name, times.PercentileMs(0.5), times.PercentileMs(0.9), times.PercentileMs(0.99), times.max_us / 1000.0, times.count);
+  };
+
+  if (frame_intervals_.count == 0) {
+    FL_INFO("Headless: %ju frames", frames_.load());
+    return;
+  }
+
+  FL_INFO("Headless: %ju frames, %.1f frames/s", frames_.load(), frame_intervals_.count * 1e6 / std::max<uint64_t>(frame_intervals_.total_us, 1));
+
+  report("frame interval", frame_intervals_);
+  report("vsync to present", frame_latencies_);
+}
+
+bool HeadlessDisplay::Run() {
+  uv_loop_t loop;
+  uv_loop_init(&loop);
+
+  uv_signal_t signal_handles[2];
+  const int signums[] = {SIGINT, SIGTERM};
+
+  for (size_t i = 0; i < std::size(signal_handles); i++) {
+    signal_handles[i].data = this;
+    uv_signal_init(&loop, &signal_handles[i]);
+    uv_signal_start(&signal_handles[i],
+                    [](uv_signal_t *handle, int signum) {
+                      FL_INFO("stop signal = %d", signum);
+                      uv_stop(handle->loop);
+                    },
+                    signums[i]);
+  }
+
+  // polled, the raster thread keeps presenting until the engine is shut down
+  uv_timer_t frame_limit_timer;
+  frame_limit_timer.data = this;
+  uv_timer_init(&loop, &frame_limit_timer);
+
+  if (frame_limit_ != 0) {
+    uv_timer_start(&frame_limit_timer,
+                   [](uv_timer_t *handle) {
+                     HeadlessDisplay *const hd = get_headless_display(handle->data);
+
+                     if (hd->frames_ >= hd->frame_limit_) {
+                       FL_INFO("Headless: frame limit reached");
+                       uv_stop(handle->loop);
+                     }
+                   },
+                   10, 10);
+  }
+
+  PlatformTaskRunner::Instance().Attach(&loop);
+
+  bool success = frame_capture_.Attach(&loop, [this]() {
+    if (application && application->isStarted()) {
+      application->scheduleFrame();
+    }
+  });
+
+  InputReplay input_replay;
+  success = success && input_replay.Start(&loop, this);
+
+  // accessibility cost shows up in benchmark runs with a bridge connected
+  SemanticsServer::Instance().Start(&loop);
+
+  if (success) {
+    uv_run(&loop, UV_RUN_DEFAULT);
+  }
+
+  input_replay.Stop();
+  SemanticsServer::Instance().Stop();
+  PlatformTaskRunner::Instance().Detach();
+  frame_capture_.Detach();
+  uv_timer_stop(&frame_limit_timer);
+  uv_close(reinterpret_cast<uv_handle_t *>(&frame_limit_timer), nullptr);
+
+  for (auto &handle : signal_handles) {
+    uv_signal_stop(&handle);
+    uv_close(reinterpret_cast<uv_handle_t *>(&handle), nullptr);
+  }
+
+  uv_run(&loop, UV_RUN_NOWAIT); // let the handles close
+  uv_loop_close(&loop);
+
+  return success;
+}
+
+FlutterRendererConfig HeadlessDisplay::renderEngineConfig() {
+  FlutterRendererConfig config = {};
+  config.type                  = kOpenGL;
+  config.open_gl.struct_size   = sizeof(config.open_gl);
+  config.open_gl.make_current  = [](void *data) -> bool {
+    HeadlessDisplay *const hd = get_headless_display(data);
+
+    if (eglMakeCurrent(hd->egl_display_, hd->egl_surface_, hd->egl_surface_, hd->egl_context_) != EGL_TRUE) {
+      LogLastEGLError();
+      FL_ERROR("Could not make the onscreen context current");
+      return false;
+    }
+
+    return true;
+  };
+  config.open_gl.clear_current = [](void *data) -> bool {
+    HeadlessDisplay *const hd = get_headless_display(data);
+
+    if (eglMakeCurrent(hd->egl_display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT) != EGL_TRUE) {
+      LogLastEGLError();
+      FL_ERROR("Could not clear the context.");
+      return false;
+    }
+
+    return true;
+  };
+  config.open_gl.present = [](void *data) -> bool {
+    HeadlessDisplay *const hd = get_headless_display(data);
+
+    hd->frame_capture_.OnPresent(hd->width_, hd->height_, FlutterEngineGetCurrentTime());
+
+    if (eglSwapBuffers(hd->egl_display_, hd->egl_surface_) != EGL_TRUE) {
+      LogLastEGLError();
+      FL_ERROR("Could not swap the EGL buffer.");
+      return false;
+    }
+
+    // what a compositor's buffer release would do: the GPU is at most a frame behind
+    if (hd->egl_create_sync_) {
+      if (hd->frame_fence_ != EGL_NO_SYNC_KHR) {
+        hd->egl_client_wait_sync_(hd->egl_display_, hd->frame_fence_, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+        hd->egl_destroy_sync_(hd->egl_display_, hd->frame_fence_);
+      }
+
+      hd->frame_fence_ = hd->egl_create_sync_(hd->egl_display_, EGL_SYNC_FENCE_KHR, nullptr);
+    } else {
+      glFinish();
+    }
+
+    hd->OnPresent();
+
+    return true;
+  };
+  config.open_gl.fbo_callback          = [](void *data) -> uint32_t { return 0; };
+  config.open_gl.make_resource_current = [](void *data) -> bool {
+    HeadlessDisplay *const hd = get_headless_display(data);
+
+    if (eglMakeCurrent(hd->egl_display_, hd->resource_egl_surface_, hd->resource_egl_surface_, hd->resource_egl_context_) != EGL_TRUE) {
+      LogLastEGLError();
+      FL_ERROR("Could not make the RESOURCE context current");
+      return false;
+    }
+
+    return true;
+  };
+  config.open_gl.gl_proc_resolver = [](void *data, const char *name) -> void * {
+    auto address = eglGetProcAddress(name);
+
+    if (address != nullptr) {
+      return reinterpret_cast<void *>(address);
+    }
+
+    return dlsym(RTLD_DEFAULT, name);
+  };
+
+  return config;
+}
+
+} // namespace flutter
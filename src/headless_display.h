@@ -0,0 +1,110 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "macros.h"
+#include "egl_utils.h"
+#include "flutter_application.h"
+#include "frame_capture.h"
+
+namespace flutter {
+
+// Renders without a compositor into an EGL pbuffer, on Mesa's surfaceless
+// platform when available (llvmpipe needs neither a GPU nor a display server),
+// paced by a synthetic vsync clock. Frame intervals and vsync to present times
+// are reported when it stops; frame capture works as with a window.
+//
+// Configured through the environment:
+//   FLUTTER_WAYLAND_HEADLESS        - vsync rate in Hz, or "benchmark" to answer every vsync request right away
+//   FLUTTER_WAYLAND_HEADLESS_FRAMES - stops after this many frames, 0 runs until SIGINT/SIGTERM (default: 0)
+class HeadlessDisplay : public RenderDisplay {
+public:
+  // refresh_hz 0 is the benchmark mode.
+  HeadlessDisplay(size_t width, size_t height, double refresh_hz, const EGLFramebufferConfig &framebuffer_config = {});
+
+  ~HeadlessDisplay();
+
+  bool IsValid() const;
+  void onEngineStarted() override;
+  void onEngineStopping() override;
+  void onEngineStopped() override;
+  void vsync_callback(void *data, intptr_t baton) override;
+  bool Run();
+
+  FlutterRendererConfig renderEngineConfig() override;
+
+private:
+  const int width_;
+  const int height_;
+  const uint64_t period_ns_; // 0 in benchmark mode
+  const uint64_t frame_limit_;
+  EGLFramebufferConfig framebuffer_config_;
+
+  bool valid_                      = false;
+  EGLDisplay egl_display_          = EGL_NO_DISPLAY;
+  EGLSurface egl_surface_          = EGL_NO_SURFACE;
+  EGLContext egl_context_          = EGL_NO_CONTEXT;
+  EGLSurface resource_egl_surface_ = EGL_NO_SURFACE;
+  EGLContext resource_egl_context_ = EGL_NO_CONTEXT;
+  bool SetupEGL();
+
+  // A swap does not wait for a pbuffer, the previous frame's fence keeps the
+  // GPU at most one frame behind.
+  PFNEGLCREATESYNCKHRPROC egl_create_sync_          = nullptr;
+  PFNEGLDESTROYSYNCKHRPROC egl_destroy_sync_        = nullptr;
+  PFNEGLCLIENTWAITSYNCKHRPROC egl_client_wait_sync_ = nullptr;
+  EGLSyncKHR frame_fence_                           = EGL_NO_SYNC_KHR;
+
+  // synthetic vsync {
+  std::thread vsync_thread_;
+  std::mutex vsync_mutex_; // also held while calling into the engine
+  std::condition_variable vsync_condition_;
+  intptr_t baton_          = 0;     // guarded by vsync_mutex_
+  bool engine_running_     = false; // guarded by vsync_mutex_
+  bool vsync_stop_         = false; // guarded by vsync_mutex_
+  uint64_t clock_start_ns_ = 0;
+  void VsyncThreadMain();
+  // }
+
+  // frame statistics, raster thread, reported once the engine stopped {
+  // Fixed 10 us buckets up to 100 ms, so a long benchmark run takes no more
+  // memory than a short one; the percentiles are bucket upper bounds.
+  struct FrameTimes {
+    static constexpr uint32_t kBucketUs = 10;
+    static constexpr size_t kBuckets    = 10000; // and one for longer ones
+
+    std::vector<uint32_t> buckets = std::vector<uint32_t>(kBuckets + 1);
+    uint64_t count                = 0;
+    uint64_t total_us             = 0;
+    uint32_t max_us               = 0;
+
+    void Add(uint32_t us);
+    double PercentileMs(double p) const;
+  };
+
+  std::atomic<uint64_t> vsync_delivered_ns_ = 0;
+  uint64_t last_present_ns_                 = 0;
+  FrameTimes frame_intervals_;
+  FrameTimes frame_latencies_; // vsync answered to present
+  std::atomic<uint64_t> frames_ = 0;
+  void OnPresent();
+  void ReportFrameTimes();
+  // }
+
+  FrameCapture frame_capture_;
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(HeadlessDisplay)
+};
+
+} // namespace flutter
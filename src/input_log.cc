@@ -0,0 +1,308 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <string.h>
+
+#include "input_log.h"
+#include "utils.h"
+
+namespace flutter {
+
+InputRecorder &InputRecorder::Instance() {
+  static InputRecorder recorder;
+  return recorder;
+}
+
+bool InputRecorder::Start(const std::string &path) {
+  if (path.empty()) {
+    return true;
+  }
+
+  FILE *file = fopen(path.c_str(), "wb");
+
+  if (file == nullptr) {
+    FL_ERROR("Could not record input into %s: %s", path.c_str(), strerror(errno));
+    return false;
+  }
+
+  const InputLogHeader header = {InputLogHeader::kMagic, InputLogHeader::kVersion};
+  fwrite(&header, sizeof(header), 1, file);
+
+  start_ns_ = FlutterEngineGetCurrentTime();
+  file_     = file;
+
+  FL_INFO("Recording input into %s", path.c_str());
+
+  return true;
+}
+
+void InputRecorder::Stop() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  FILE *file = file_.exchange(nullptr);
+
+  if (file == nullptr) {
+    return;
+  }
+
+  if (fclose(file) != 0) {
+    FL_ERROR("Could not write the input log: %s", strerror(errno));
+    return;
+  }
+
+  FL_INFO("Input log: %ju events recorded", records_);
+}
+
+void InputRecorder::Write(InputLogRecord *record, const std::string &payload) {
+  static const uint8_t kPadding[sizeof(InputLogRecord)] = {};
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  FILE *file = file_;
+
+  if (file == nullptr) {
+    return;
+  }
+
+  record->time_ns = FlutterEngineGetCurrentTime() - start_ns_;
+
+  // buffered by stdio, written out in blocks
+  fwrite(record, sizeof(*record), 1, file);
+  fwrite(payload.data(), 1, payload.size(), file);
+  fwrite(kPadding, 1, record->PayloadRecords() * sizeof(InputLogRecord) - payload.size(), file);
+  records_++;
+}
+
+void InputRecorder::Key(GdkEventType type, xkb_keycode_t hardware_keycode, xkb_keysym_t keysym, guint state, uint32_t utf32, bool repeat) {
+  InputLogRecord record = {};
+  record.type           = InputLogRecord::KEY;
+  record.phase          = static_cast<uint8_t>(type);
+  record.repeat         = repeat;
+  record.key            = {hardware_keycode, keysym, state, utf32};
+
+  Write(&record);
+}
+
+void InputRecorder::Pointer(FlutterPointerPhase phase, double x, double y) {
+  InputLogRecord record = {};
+  record.type           = InputLogRecord::POINTER;
+  record.phase          = static_cast<uint8_t>(phase);
+  record.pointer        = {static_cast<float>(x), static_cast<float>(y)};
+
+  Write(&record);
+}
+
+void InputRecorder::WindowMetrics(int32_t physical_width, int32_t physical_height, int32_t screen_width, int32_t screen_height, double render_scale) {
+  InputLogRecord record = {};
+  record.type           = InputLogRecord::METRICS;
+  record.metrics        = {physical_width, physical_height, screen_width, screen_height, static_cast<float>(render_scale)};
+
+  Write(&record);
+}
+
+void InputRecorder::InputMethodEdit(const TextInputPlugin::InputMethodEdit &edit) {
+  InputLogRecord record = {};
+  record.type           = InputLogRecord::TEXT;
+  record.text           = {static_cast<uint32_t>(edit.preedit.size()), static_cast<uint32_t>(edit.commit.size()), edit.delete_before, edit.delete_after};
+
+  const int32_t cursor[] = {edit.preedit_cursor_begin, edit.preedit_cursor_end};
+  std::string payload(reinterpret_cast<const char *>(cursor), sizeof(cursor));
+  payload += edit.preedit;
+  payload += edit.commit;
+
+  Write(&record, payload);
+}
+
+std::atomic<bool> InputReplay::frame_presented_ = false;
+std::mutex InputReplay::mutex_;
+uv_async_t *InputReplay::waiting_ = nullptr;
+
+InputReplay::InputReplay()
+    : path_(getEnv("FLUTTER_WAYLAND_INPUT_REPLAY", std::string(""))), speed_(getEnv("FLUTTER_WAYLAND_INPUT_REPLAY_SPEED", 1.)), exit_(getEnv("FLUTTER_WAYLAND_INPUT_REPLAY_EXIT", 0.) != 0.) {
+}
+
+InputReplay::~InputReplay() {
+  Stop();
+}
+
+bool InputReplay::IsEnabled() const {
+  return !path_.empty();
+}
+
+bool InputReplay::Load() {
+  FILE *file = fopen(path_.c_str(), "rb");
+
+  if (file == nullptr) {
+    FL_ERROR("Could not open the input log %s: %s", path_.c_str(), strerror(errno));
+    return false;
+  }
+
+  InputLogHeader header = {};
+
+  if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != InputLogHeader::kMagic || header.version == 0 || header.version > InputLogHeader::kVersion) {
+    FL_ERROR("Not an input log (or another version): %s", path_.c_str());
+    fclose(file);
+    return false;
+  }
+
+  InputLogRecord record;
+
+  while (fread(&record, sizeof(record), 1, file) == 1) {
+    records_.push_back(record);
+  }
+
+  fclose(file);
+
+  // a payload cut off at the end is dropped with its record
+  for (size_t i = 0; i < records_.size(); i += 1 + records_[i].PayloadRecords()) {
+    if (i + records_[i].PayloadRecords() >= records_.size()) {
+      records_.resize(i);
+      break;
+    }
+  }
+
+  return true;
+}
+
+bool InputReplay::Start(uv_loop_t *loop, RenderDisplay *display) {
+  if (!IsEnabled()) {
+    return true;
+  }
+
+  if (!Load()) {
+    return false;
+  }
+
+  display_ = display;
+  next_    = 0;
+
+  timer_handle_       = new uv_timer_t;
+  timer_handle_->data = this;
+  uv_timer_init(loop, timer_handle_);
+
+  first_frame_handle_       = new uv_async_t;
+  first_frame_handle_->data = this;
+  uv_async_init(loop, first_frame_handle_, [](uv_async_t *handle) { static_cast<InputReplay *>(handle->data)->Begin(); });
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (frame_presented_) {
+      uv_async_send(first_frame_handle_);
+    } else {
+      waiting_ = first_frame_handle_;
+    }
+  }
+
+  FL_INFO("Replaying %zu input events from %s at %.2fx speed once a frame is presented", records_.size(), path_.c_str(), speed_);
+
+  return true;
+}
+
+void InputReplay::FirstFramePresented() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  frame_presented_ = true;
+
+  if (waiting_) {
+    uv_async_send(waiting_);
+    waiting_ = nullptr;
+  }
+}
+
+void InputReplay::Begin() {
+  if (start_ns_ != 0) {
+    return;
+  }
+
+  start_ns_ = FlutterEngineGetCurrentTime();
+  OnTimer();
+}
+
+void InputReplay::Stop() {
+  if (timer_handle_ == nullptr) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    waiting_ = nullptr;
+  }
+
+  uv_close(reinterpret_cast<uv_handle_t *>(first_frame_handle_), [](uv_handle_t *handle) { delete reinterpret_cast<uv_async_t *>(handle); });
+  first_frame_handle_ = nullptr;
+
+  uv_timer_stop(timer_handle_);
+  uv_close(reinterpret_cast<uv_handle_t *>(timer_handle_), [](uv_handle_t *handle) { delete reinterpret_cast<uv_timer_t *>(handle); });
+  timer_handle_ = nullptr;
+}
+
+void InputReplay::OnTimer() {
+  const uint64_t elapsed_ns = FlutterEngineGetCurrentTime() - start_ns_;
+
+  // everything which is due, then sleep until the next event
+  while (next_ < records_.size()) {
+    const uint64_t due_ns = speed_ > 0. ? static_cast<uint64_t>(records_[next_].time_ns / speed_) : 0;
+
+    if (due_ns > elapsed_ns) {
+      uv_timer_start(timer_handle_, [](uv_timer_t *handle) { static_cast<InputReplay *>(handle->data)->OnTimer(); }, (due_ns - elapsed_ns + 999999) / 1000000, 0);
+      return;
+    }
+
+    Dispatch(next_);
+    next_ += 1 + records_[next_].PayloadRecords();
+
+    if (speed_ <= 0.) {
+      // one event per loop iteration, so frames get a chance in between
+      uv_timer_start(timer_handle_, [](uv_timer_t *handle) { static_cast<InputReplay *>(handle->data)->OnTimer(); }, 0, 0);
+      return;
+    }
+  }
+
+  FL_INFO("Input replay finished after %.1f ms", elapsed_ns / 1e6);
+
+  if (exit_) {
+    uv_stop(timer_handle_->loop);
+  }
+}
+
+void InputReplay::Dispatch(size_t index) {
+  const InputLogRecord &record   = records_[index];
+  Application *const application = display_->application;
+
+  if (application == nullptr) {
+    return;
+  }
+
+  switch (record.type) {
+  case InputLogRecord::KEY:
+    application->keyboardKey(static_cast<GdkEventType>(record.phase), record.key.hardware_keycode, record.key.keysym, record.key.state, record.key.utf32, record.repeat);
+    break;
+  case InputLogRecord::POINTER:
+    application->onPointerEvent(static_cast<FlutterPointerPhase>(record.phase), static_cast<uint32_t>(FlutterEngineGetCurrentTime() / 1000000), record.pointer.x, record.pointer.y);
+    break;
+  case InputLogRecord::METRICS:
+    application->sendWindowMetrics(record.metrics.physical_width, record.metrics.physical_height, record.metrics.screen_width, record.metrics.screen_height, record.metrics.render_scale);
+    break;
+  case InputLogRecord::TEXT: {
+    const char *payload = reinterpret_cast<const char *>(&records_[index + 1]);
+    int32_t cursor[2];
+    memcpy(cursor, payload, sizeof(cursor));
+
+    TextInputPlugin::InputMethodEdit edit;
+    edit.preedit_cursor_begin = cursor[0];
+    edit.preedit_cursor_end   = cursor[1];
+    edit.preedit.assign(payload + sizeof(cursor), record.text.preedit_length);
+    edit.commit.assign(payload + sizeof(cursor) + record.text.preedit_length, record.text.commit_length);
+    edit.delete_before = record.text.delete_before;
+    edit.delete_after  = record.text.delete_after;
+
+    application->textInput()->ApplyInputMethodEdit(edit);
+    break;
+  }
+  default:
+    FL_WARN("Input replay: unknown record type %u", record.type);
+    break;
+  }
+}
+
+} // namespace flutter
@@ -0,0 +1,169 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <flutter_embedder.h>
+#include <gdk/gdk.h>
+#include <uv.h>
+#include <xkbcommon/xkbcommon.h>
+
+#include "macros.h"
+#include "flutter_application.h"
+#include "text_input.h"
+
+namespace flutter {
+
+// Binary input log: a header, then fixed size records in host byte order.
+// Version 2 added input method edits, version 1 logs replay as they are.
+struct InputLogHeader {
+  static constexpr uint32_t kMagic   = 0x52494c46; // "FLIR"
+  static constexpr uint32_t kVersion = 2;
+
+  uint32_t magic;
+  uint32_t version;
+};
+
+// A TEXT record is followed by its payload, padded to whole records: the
+// preedit cursor begin and end as int32_t, then the preedit and the commit.
+struct InputLogRecord {
+  enum Type : uint8_t { KEY, POINTER, METRICS, TEXT };
+
+  uint64_t time_ns; // since the recording started
+  uint8_t type;
+  uint8_t phase;  // GdkEventType for keys, FlutterPointerPhase for pointers
+  uint8_t repeat; // keys
+  uint8_t reserved;
+
+  union {
+    struct {
+      uint32_t hardware_keycode;
+      uint32_t keysym;
+      uint32_t state;
+      uint32_t utf32;
+    } key;
+    struct {
+      float x;
+      float y;
+    } pointer;
+    struct {
+      int32_t physical_width;
+      int32_t physical_height;
+      int32_t screen_width;
+      int32_t screen_height;
+      float render_scale;
+    } metrics;
+    struct {
+      uint32_t preedit_length;
+      uint32_t commit_length;
+      uint32_t delete_before;
+      uint32_t delete_after;
+    } text;
+  };
+
+  // records taken by a TEXT record's payload
+  size_t PayloadRecords() const {
+    return type == TEXT ? (2 * sizeof(int32_t) + text.preedit_length + text.commit_length + sizeof(InputLogRecord) - 1) / sizeof(InputLogRecord) : 0;
+  }
+};
+
+static_assert(sizeof(InputLogRecord) == 32, "InputLogRecord is part of the file format");
+
+// Records every input event, input method edit and window metrics change
+// reaching the application, across engine restarts. Costs one branch when
+// not recording.
+//
+// Configured through the environment:
+//   FLUTTER_WAYLAND_INPUT_RECORD - file to record into
+class InputRecorder {
+public:
+  static InputRecorder &Instance();
+
+  bool Start(const std::string &path);
+  void Stop();
+
+  bool IsRecording() const {
+    return __builtin_expect(file_.load(std::memory_order_relaxed) != nullptr, false);
+  }
+
+  void Key(GdkEventType type, xkb_keycode_t hardware_keycode, xkb_keysym_t keysym, guint state, uint32_t utf32, bool repeat);
+  void Pointer(FlutterPointerPhase phase, double x, double y);
+  void WindowMetrics(int32_t physical_width, int32_t physical_height, int32_t screen_width, int32_t screen_height, double render_scale);
+  void InputMethodEdit(const TextInputPlugin::InputMethodEdit &edit);
+
+private:
+  InputRecorder() = default;
+
+  std::atomic<FILE *> file_ = nullptr;
+  std::mutex mutex_;
+  uint64_t start_ns_ = 0;
+  uint64_t records_  = 0;
+
+  void Write(InputLogRecord *record, const std::string &payload = std::string());
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(InputRecorder)
+};
+
+// Feeds a recorded log into the application of a display from the platform
+// loop, without any seat. Pointer events get current timestamps. The log's
+// clock starts with the first frame a window presented, so a run does not
+// depend on how long the engine took to start.
+//
+// Configured through the environment:
+//   FLUTTER_WAYLAND_INPUT_REPLAY       - log to replay
+//   FLUTTER_WAYLAND_INPUT_REPLAY_SPEED - 1 keeps the original timing, 2 replays twice as fast,
+//                                        0 as fast as the loop goes (default: 1)
+//   FLUTTER_WAYLAND_INPUT_REPLAY_EXIT  - 1 stops the loop once the log is through (default: 0)
+class InputReplay {
+public:
+  InputReplay();
+
+  ~InputReplay();
+
+  bool IsEnabled() const;
+
+  bool Start(uv_loop_t *loop, RenderDisplay *display);
+  void Stop();
+
+  // Raster thread, after every present.
+  static void FramePresented() {
+    if (__builtin_expect(!frame_presented_.load(std::memory_order_relaxed), false)) {
+      FirstFramePresented();
+    }
+  }
+
+private:
+  static std::atomic<bool> frame_presented_;
+  static std::mutex mutex_;
+  static uv_async_t *waiting_; // guarded by mutex_, the replay waiting for the first frame
+
+  const std::string path_;
+  const double speed_;
+  const bool exit_;
+
+  std::vector<InputLogRecord> records_;
+  size_t next_                    = 0;
+  uint64_t start_ns_              = 0; // 0 until the first frame was presented
+  RenderDisplay *display_         = nullptr;
+  uv_timer_t *timer_handle_       = nullptr;
+  uv_async_t *first_frame_handle_ = nullptr;
+
+  static void FirstFramePresented();
+  bool Load();
+  void Begin();
+  void OnTimer();
+  void Dispatch(size_t index);
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(InputReplay)
+};
+
+} // namespace flutter
@@ -0,0 +1,480 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+
+namespace flutter {
+
+static const JsonValue kNull;
+
+class JsonParser {
+public:
+  JsonParser(const uint8_t *data, size_t size) : p_(reinterpret_cast<const char *>(data)), end_(p_ + size) {}
+
+  bool Parse(JsonValue *value) {
+    return ParseValue(value, 0) && (SkipSpace(), p_ == end_);
+  }
+
+private:
+  static constexpr int kMaxDepth = 64;
+
+  const char *p_;
+  const char *const end_;
+
+  void SkipSpace() {
+    while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) {
+      p_++;
+    }
+  }
+
+  bool Consume(const char *literal) {
+    const size_t length = strlen(literal);
+
+    if (static_cast<size_t>(end_ - p_) < length || memcmp(p_, literal, length) != 0) {
+      return false;
+    }
+
+    p_ += length;
+    return true;
+  }
+
+  bool ParseValue(JsonValue *value, int depth) {
+    SkipSpace();
+
+    if (p_ == end_ || depth > kMaxDepth) {
+      return false;
+    }
+
+    switch (*p_) {
+    case '{':
+      return ParseObject(value, depth);
+    case '[':
+      return ParseArray(value, depth);
+    case '"':
+      value->type_ = JsonValue::Type::STRING;
+      return ParseString(&value->string_);
+    case 't':
+      *value = JsonValue(true);
+      return Consume("true");
+    case 'f':
+      *value = JsonValue(false);
+      return Consume("false");
+    case 'n':
+      *value = JsonValue();
+      return Consume("null");
+    default:
+      return ParseNumber(value);
+    }
+  }
+
+  bool ParseNumber(JsonValue *value) {
+    // strtod() needs a terminator, numbers are short
+    char buffer[64];
+    size_t length = 0;
+
+    while (p_ + length < end_ && length < sizeof(buffer) - 1 && strchr("+-.0123456789eE", p_[length]) != nullptr) {
+      buffer[length] = p_[length];
+      length++;
+    }
+
+    buffer[length] = '\0';
+    char *number_end;
+    const double number = strtod(buffer, &number_end);
+
+    if (length == 0 || number_end != buffer + length) {
+      return false;
+    }
+
+    *value = JsonValue(number);
+    p_ += length;
+    return true;
+  }
+
+  bool ParseHex4(uint32_t *code) {
+    if (end_ - p_ < 4) {
+      return false;
+    }
+
+    *code = 0;
+
+    for (int i = 0; i < 4; i++) {
+      const char c = *p_++;
+      *code <<= 4;
+
+      if (c >= '0' && c <= '9') {
+        *code |= c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        *code |= c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        *code |= c - 'A' + 10;
+      } else {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  static void AppendUtf8(uint32_t code, std::string *out) {
+    if (code < 0x80) {
+      out->push_back(static_cast<char>(code));
+    } else if (code < 0x800) {
+      out->push_back(static_cast<char>(0xc0 | (code >> 6)));
+      out->push_back(static_cast<char>(0x80 | (code & 0x3f)));
+    } else if (code < 0x10000) {
+      out->push_back(static_cast<char>(0xe0 | (code >> 12)));
+      out->push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+      out->push_back(static_cast<char>(0x80 | (code & 0x3f)));
+    } else {
+      out->push_back(static_cast<char>(0xf0 | (code >> 18)));
+      out->push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3f)));
+      out->push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+      out->push_back(static_cast<char>(0x80 | (code & 0x3f)));
+    }
+  }
+
+  bool ParseString(std::string *out) {
+    p_++; // "
+
+    while (p_ < end_) {
+      // copy the plain run at once
+      const char *run = p_;
+
+      while (p_ < end_ && *p_ != '"' && *p_ != '\\') {
+        p_++;
+      }
+
+      out->append(run, p_ - run);
+
+      if (p_ == end_) {
+        return false;
+      }
+
+      if (*p_++ == '"') {
+        return true;
+      }
+
+      if (p_ == end_) {
+        return false;
+      }
+
+      const char escape = *p_++;
+
+      switch (escape) {
+      case '"':
+      case '\\':
+      case '/':
+        out->push_back(escape);
+        break;
+      case 'b':
+        out->push_back('\b');
+        break;
+      case 'f':
+        out->push_back('\f');
+        break;
+      case 'n':
+        out->push_back('\n');
+        break;
+      case 'r':
+        out->push_back('\r');
+        break;
+      case 't':
+        out->push_back('\t');
+        break;
+      case 'u': {
+        uint32_t code;
+
+        if (!ParseHex4(&code)) {
+          return false;
+        }
+
+        // a surrogate pair is one code point
+        if (code >= 0xd800 && code < 0xdc00 && Consume("\\u")) {
+          uint32_t low;
+
+          if (!ParseHex4(&low) || low < 0xdc00 || low >= 0xe000) {
+            return false;
+          }
+
+          code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+        }
+
+        AppendUtf8(code, out);
+        break;
+      }
+      default:
+        return false;
+      }
+    }
+
+    return false;
+  }
+
+  bool ParseArray(JsonValue *value, int depth) {
+    p_++; // [
+    *value = JsonValue::Array();
+    SkipSpace();
+
+    if (p_ < end_ && *p_ == ']') {
+      p_++;
+      return true;
+    }
+
+    while (true) {
+      value->elements_.emplace_back();
+
+      if (!ParseValue(&value->elements_.back(), depth + 1)) {
+        return false;
+      }
+
+      SkipSpace();
+
+      if (p_ == end_) {
+        return false;
+      }
+
+      const char c = *p_++;
+
+      if (c == ']') {
+        return true;
+      }
+
+      if (c != ',') {
+        return false;
+      }
+    }
+  }
+
+  bool ParseObject(JsonValue *value, int depth) {
+    p_++; // {
+    *value = JsonValue::Object();
+    SkipSpace();
+
+    if (p_ < end_ && *p_ == '}') {
+      p_++;
+      return true;
+    }
+
+    while (true) {
+      SkipSpace();
+
+      if (p_ == end_ || *p_ != '"') {
+        return false;
+      }
+
+      value->keys_.emplace_back();
+
+      if (!ParseString(&value->keys_.back())) {
+        return false;
+      }
+
+      SkipSpace();
+
+      if (!Consume(":")) {
+        return false;
+      }
+
+      value->elements_.emplace_back();
+
+      if (!ParseValue(&value->elements_.back(), depth + 1)) {
+        return false;
+      }
+
+      SkipSpace();
+
+      if (p_ == end_) {
+        return false;
+      }
+
+      const char c = *p_++;
+
+      if (c == '}') {
+        return true;
+      }
+
+      if (c != ',') {
+        return false;
+      }
+    }
+  }
+};
+
+JsonValue JsonValue::Array() {
+  JsonValue value;
+  value.type_ = Type::ARRAY;
+  return value;
+}
+
+JsonValue JsonValue::Object() {
+  JsonValue value;
+  value.type_ = Type::OBJECT;
+  return value;
+}
+
+JsonValue JsonValue::Parse(const uint8_t *data, size_t size) {
+  JsonValue value;
+
+  if (!JsonParser(data, size).Parse(&value)) {
+    return JsonValue();
+  }
+
+  return value;
+}
+
+bool JsonValue::AsBool(bool default_value) const {
+  return type_ == Type::BOOL ? bool_ : default_value;
+}
+
+double JsonValue::AsNumber(double default_value) const {
+  return type_ == Type::NUMBER ? number_ : default_value;
+}
+
+int64_t JsonValue::AsInt(int64_t default_value) const {
+  return type_ == Type::NUMBER ? static_cast<int64_t>(number_) : default_value;
+}
+
+const std::string &JsonValue::AsString() const {
+  return string_;
+}
+
+size_t JsonValue::size() const {
+  return elements_.size();
+}
+
+const JsonValue &JsonValue::operator[](size_t index) const {
+  if (type_ != Type::ARRAY || index >= elements_.size()) {
+    return kNull;
+  }
+
+  return elements_[index];
+}
+
+const JsonValue &JsonValue::operator[](const char *key) const {
+  if (type_ != Type::OBJECT) {
+    return kNull;
+  }
+
+  for (size_t i = 0; i < keys_.size(); i++) {
+    if (keys_[i] == key) {
+      return elements_[i];
+    }
+  }
+
+  return kNull;
+}
+
+JsonValue &JsonValue::Append(JsonValue value) {
+  elements_.push_back(std::move(value));
+  return *this;
+}
+
+JsonValue &JsonValue::Set(const char *key, JsonValue value) {
+  keys_.push_back(key);
+  elements_.push_back(std::move(value));
+  return *this;
+}
+
+std::string JsonValue::Serialize() const {
+  std::string out;
+  SerializeTo(&out);
+  return out;
+}
+
+void JsonValue::SerializeString(const std::string &value, std::string *out) {
+  out->push_back('"');
+
+  for (const char c : value) {
+    switch (c) {
+    case '"':
+      out->append("\\\"");
+      break;
+    case '\\':
+      out->append("\\\\");
+      break;
+    case '\n':
+      out->append("\\n");
+      break;
+    case '\r':
+      out->append("\\r");
+      break;
+    case '\t':
+      out->append("\\t");
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        char escape[8];
+        snprintf(escape, sizeof(escape), "\\u%04x", c);
+        out->append(escape);
+      } else {
+        out->push_back(c); // UTF-8 goes through as is
+      }
+      break;
+    }
+  }
+
+  out->push_back('"');
+}
+
+void JsonValue::SerializeTo(std::string *out) const {
+  switch (type_) {
+  case Type::NUL:
+    out->append("null");
+    break;
+  case Type::BOOL:
+    out->append(bool_ ? "true" : "false");
+    break;
+  case Type::NUMBER: {
+    char number[32];
+
+    if (number_ == trunc(number_) && fabs(number_) < 1e15) {
+      snprintf(number, sizeof(number), "%lld", static_cast<long long>(number_));
+    } else if (isfinite(number_)) {
+      snprintf(number, sizeof(number), "%.17g", number_);
+    } else {
+      snprintf(number, sizeof(number), "null");
+    }
+
+    out->append(number);
+    break;
+  }
+  case Type::STRING:
+    SerializeString(string_, out);
+    break;
+  case Type::ARRAY:
+    out->push_back('[');
+
+    for (size_t i = 0; i < elements_.size(); i++) {
+      if (i > 0) {
+        out->push_back(',');
+      }
+
+      elements_[i].SerializeTo(out);
+    }
+
+    out->push_back(']');
+    break;
+  case Type::OBJECT:
+    out->push_back('{');
+
+    for (size_t i = 0; i < elements_.size(); i++) {
+      if (i > 0) {
+        out->push_back(',');
+      }
+
+      SerializeString(keys_[i], out);
+      out->push_back(':');
+      elements_[i].SerializeTo(out);
+    }
+
+    out->push_back('}');
+    break;
+  }
+}
+
+} // namespace flutter
@@ -0,0 +1,75 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace flutter {
+
+// Just enough JSON for the method channels of JSONMethodCodec: parses
+// messages from the framework and serializes replies. Objects keep their
+// members in order, lookups are linear.
+class JsonValue {
+public:
+  enum class Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+  JsonValue() = default;
+  JsonValue(bool value) : type_(Type::BOOL), bool_(value) {}
+  JsonValue(int value) : type_(Type::NUMBER), number_(value) {}
+  JsonValue(int64_t value) : type_(Type::NUMBER), number_(static_cast<double>(value)) {}
+  JsonValue(double value) : type_(Type::NUMBER), number_(value) {}
+  JsonValue(const char *value) : type_(Type::STRING), string_(value) {}
+  JsonValue(std::string value) : type_(Type::STRING), string_(std::move(value)) {}
+
+  static JsonValue Array();
+  static JsonValue Object();
+
+  // Null on malformed input.
+  static JsonValue Parse(const uint8_t *data, size_t size);
+
+  Type type() const { return type_; }
+  bool IsNull() const { return type_ == Type::NUL; }
+  bool IsString() const { return type_ == Type::STRING; }
+  bool IsObject() const { return type_ == Type::OBJECT; }
+
+  bool AsBool(bool default_value = false) const;
+  double AsNumber(double default_value = 0.) const;
+  int64_t AsInt(int64_t default_value = 0) const;
+  const std::string &AsString() const; // empty unless a string
+
+  size_t size() const; // elements or members
+
+  // A null value when out of range, missing or not an array/object.
+  const JsonValue &operator[](size_t index) const;
+  const JsonValue &operator[](int index) const { return (*this)[static_cast<size_t>(index)]; } // args[0] is no null pointer
+  const JsonValue &operator[](const char *key) const;
+
+  JsonValue &Append(JsonValue value);
+  JsonValue &Set(const char *key, JsonValue value);
+
+  std::string Serialize() const;
+
+  // Appends value as a JSON string literal.
+  static void SerializeString(const std::string &value, std::string *out);
+
+private:
+  Type type_     = Type::NUL;
+  bool bool_     = false;
+  double number_ = 0.;
+  std::string string_;
+  std::vector<JsonValue> elements_; // also the values of an object's members
+  std::vector<std::string> keys_;
+
+  void SerializeTo(std::string *out) const;
+
+  friend class JsonParser;
+};
+
+} // namespace flutter
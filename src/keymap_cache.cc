@@ -0,0 +1,218 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+
+#include "utils.h"
+#include "keymap_cache.h"
+#include "trace.h"
+
+namespace flutter {
+
+static uint64_t MonotonicNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+KeymapCache &KeymapCache::Instance() {
+  static KeymapCache cache;
+  return cache;
+}
+
+KeymapCache::KeymapCache() : directory_(getEnv("FLUTTER_WAYLAND_KEYMAP_CACHE_DIR", DefaultDirectory())) {
+}
+
+KeymapCache::~KeymapCache() {
+  CollectPrewarm();
+
+  for (auto &entry : entries_) {
+    xkb_keymap_unref(entry.keymap);
+  }
+
+  FL_DEBUG("keymap cache: %u hits, %u misses, %.2f ms compiling", hits_, misses_, compile_ns_ / 1e6);
+}
+
+std::string KeymapCache::DefaultDirectory() {
+  const std::string cache_home = getEnv("XDG_CACHE_HOME", std::string(""));
+
+  if (!cache_home.empty()) {
+    return cache_home + "/flutter-wayland";
+  }
+
+  const std::string home = getEnv("HOME", std::string(""));
+
+  return home.empty() ? "" : home + "/.cache/flutter-wayland";
+}
+
+std::string KeymapCache::FilePath() const {
+  return directory_ + "/keymap.xkb";
+}
+
+// FNV-1a, the text is compared on a hash match anyway
+uint64_t KeymapCache::Hash(const std::string &text) {
+  uint64_t hash = 0xcbf29ce484222325;
+
+  for (const unsigned char c : text) {
+    hash = (hash ^ c) * 0x100000001b3;
+  }
+
+  return hash;
+}
+
+void KeymapCache::Prewarm() {
+  if (prewarm_started_ || directory_.empty()) {
+    return;
+  }
+
+  prewarm_started_ = true;
+
+  prewarm_ = std::async(std::launch::async, [path = FilePath()]() {
+    Entry entry = {0, "", nullptr, {}};
+    std::ifstream file(path);
+
+    if (!file) {
+      return entry;
+    }
+
+    std::stringstream text;
+    text << file.rdbuf();
+    entry.text = text.str();
+
+    // xkb contexts are not thread safe, the keymap keeps this one alive
+    struct xkb_context *xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+
+    if (xkb_context == nullptr) {
+      return entry;
+    }
+
+    FLWAY_TRACE_SCOPE("KeymapCache.prewarm");
+    const uint64_t start_ns = MonotonicNs();
+    entry.keymap            = xkb_keymap_new_from_buffer(xkb_context, entry.text.data(), entry.text.size(), XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
+    xkb_context_unref(xkb_context);
+
+    if (entry.keymap != nullptr) {
+      entry.hash = Hash(entry.text);
+      entry.modifiers.Update(entry.keymap);
+      FL_DEBUG("keymap cache: compiled %s in %.2f ms ahead of time", path.c_str(), (MonotonicNs() - start_ns) / 1e6);
+    }
+
+    return entry;
+  });
+}
+
+void KeymapCache::CollectPrewarm() {
+  if (!prewarm_.valid()) {
+    return;
+  }
+
+  Entry entry = prewarm_.get();
+
+  if (entry.keymap != nullptr) {
+    Insert(std::move(entry));
+  }
+}
+
+void KeymapCache::Insert(Entry entry) {
+  entries_.push_front(std::move(entry));
+
+  if (entries_.size() > kMaxEntries) {
+    xkb_keymap_unref(entries_.back().keymap);
+    entries_.pop_back();
+  }
+}
+
+struct xkb_keymap *KeymapCache::Get(struct xkb_context *xkb_context, const char *text, size_t size, ModifierTable *modifiers) {
+  // a keymap which arrives before the ahead of time compile finished waits
+  // for it, which is still shorter than compiling it again
+  CollectPrewarm();
+
+  const std::string keymap_text(text, strnlen(text, size));
+  const uint64_t hash = Hash(keymap_text);
+
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    if (it->hash == hash && it->text == keymap_text) {
+      entries_.splice(entries_.begin(), entries_, it);
+      hits_++;
+
+      FL_DEBUG("keymap cache: hit %016llx (%u hits, %u misses)", static_cast<unsigned long long>(hash), hits_, misses_);
+      *modifiers = it->modifiers;
+      return xkb_keymap_ref(it->keymap);
+    }
+  }
+
+  FLWAY_TRACE_SCOPE("KeymapCache.compile");
+  const uint64_t start_ns = MonotonicNs();
+  struct xkb_keymap *keymap = xkb_keymap_new_from_buffer(xkb_context, keymap_text.data(), keymap_text.size(), XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
+  const uint64_t elapsed_ns = MonotonicNs() - start_ns;
+
+  misses_++;
+  compile_ns_ += elapsed_ns;
+
+  FL_INFO("keymap cache: miss %016llx, compiled in %.2f ms (%u hits, %u misses)", static_cast<unsigned long long>(hash), elapsed_ns / 1e6, hits_, misses_);
+
+  if (keymap == nullptr) {
+    return nullptr;
+  }
+
+  Entry entry = {hash, keymap_text, keymap, {}};
+  entry.modifiers.Update(keymap);
+  *modifiers = entry.modifiers;
+  Insert(std::move(entry));
+
+  if (!directory_.empty()) {
+    Store(keymap_text);
+  }
+
+  return xkb_keymap_ref(keymap);
+}
+
+// mkdir -p, a fresh $XDG_CACHE_HOME may not exist yet
+static void MakeDirectories(const std::string &path) {
+  for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+    mkdir(path.substr(0, slash).c_str(), 0700);
+  }
+
+  mkdir(path.c_str(), 0700);
+}
+
+void KeymapCache::Store(const std::string &text) const {
+  MakeDirectories(directory_);
+
+  // written aside under a unique name and renamed, concurrently starting
+  // instances neither read half a keymap nor write into each other's file
+  const std::string path = FilePath();
+  std::string tmp_path   = path + ".XXXXXX";
+  const int fd           = mkstemp(&tmp_path[0]);
+
+  if (fd == -1) {
+    FL_DEBUG("keymap cache: could not create %s: %s", tmp_path.c_str(), strerror(errno));
+    return;
+  }
+
+  FILE *file         = fdopen(fd, "w");
+  const bool written = file != nullptr && fwrite(text.data(), 1, text.size(), file) == text.size();
+
+  if ((file != nullptr ? fclose(file) : close(fd)) != 0 || !written) {
+    FL_DEBUG("keymap cache: could not write %s", tmp_path.c_str());
+    remove(tmp_path.c_str());
+    return;
+  }
+
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    FL_DEBUG("keymap cache: could not write %s", path.c_str());
+    remove(tmp_path.c_str());
+  }
+}
+
+} // namespace flutter
@@ -0,0 +1,77 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <future>
+#include <list>
+#include <string>
+
+#include <xkbcommon/xkbcommon.h>
+
+#include "keys.h"
+#include "macros.h"
+
+namespace flutter {
+
+// Compiled xkb keymaps and their modifier tables keyed by the hash of the
+// keymap text the compositor sends. Seats re-sending a keymap, and every
+// window of the process, get the already compiled keymap.
+//
+// xkbcommon has no serialized form of a compiled keymap, so what goes to disk
+// is the text of the last keymap seen. The next start compiles it on a
+// background thread while the connection is being set up, and the compositor's
+// keymap event is a cache hit in the common case.
+//
+// Only used from the platform thread.
+//
+// Configured through the environment:
+//   FLUTTER_WAYLAND_KEYMAP_CACHE_DIR - directory of the on-disk cache, empty disables it
+//                                      (default: $XDG_CACHE_HOME/flutter-wayland or ~/.cache/flutter-wayland)
+class KeymapCache {
+public:
+  static KeymapCache &Instance();
+
+  // Starts compiling the keymap cached on disk, once per process.
+  void Prewarm();
+
+  // Returns a new reference to the keymap compiled from text, nullptr when it
+  // does not compile. modifiers is set to the keymap's modifier table.
+  struct xkb_keymap *Get(struct xkb_context *xkb_context, const char *text, size_t size, ModifierTable *modifiers);
+
+private:
+  KeymapCache();
+
+  ~KeymapCache();
+
+  struct Entry {
+    uint64_t hash;
+    std::string text;
+    struct xkb_keymap *keymap;
+    ModifierTable modifiers;
+  };
+
+  static constexpr size_t kMaxEntries = 4;
+
+  const std::string directory_;
+  std::list<Entry> entries_; // most recently used first
+  std::future<Entry> prewarm_;
+  bool prewarm_started_ = false;
+
+  unsigned hits_       = 0;
+  unsigned misses_     = 0;
+  uint64_t compile_ns_ = 0; // spent compiling on the platform thread
+
+  void Insert(Entry entry);
+  void CollectPrewarm();
+  std::string FilePath() const;
+  void Store(const std::string &text) const;
+
+  static uint64_t Hash(const std::string &text);
+  static std::string DefaultDirectory();
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(KeymapCache)
+};
+
+} // namespace flutter
@@ -21,11 +21,19 @@
 //
 
 #include <iterator>
+#include <linux/input-event-codes.h>
 #include "keys.h"
 
 namespace flutter {
 
-GdkModifierType toGDKModifiers(struct xkb_keymap *xkb_keymap, guint32 mods) {
+// Flutter key id planes, see keyboard_key.g.dart in the framework
+static constexpr uint64_t kValueMask        = 0x000ffffffff;
+static constexpr uint64_t kUnicodePlane     = 0x00000000000;
+static constexpr uint64_t kUnprintablePlane = 0x00100000000;
+static constexpr uint64_t kGtkPlane         = 0x01700000000;
+static constexpr uint64_t kUsbHidPage       = 0x00070000;
+
+void ModifierTable::Update(struct xkb_keymap *xkb_keymap) {
   static const struct {
     const char *xkb_name;
     guint32 gdk_mask;
@@ -42,17 +50,204 @@ GdkModifierType toGDKModifiers(struct xkb_keymap *xkb_keymap, guint32 mods) {
       {"Hyper", GDK_HYPER_MASK},
   };
 
-  guint state = 0;
+  for (auto &mask : gdk_masks_) {
+    mask = 0;
+  }
 
   for (size_t i = 0; i < std::size(table); i++) {
-    if (mods & (1 << xkb_keymap_mod_get_index(xkb_keymap, table[i].xkb_name)))
-      state |= table[i].gdk_mask;
+    const xkb_mod_index_t index = xkb_keymap_mod_get_index(xkb_keymap, table[i].xkb_name);
+
+    if (index < std::size(gdk_masks_))
+      gdk_masks_[index] |= table[i].gdk_mask;
   }
 
-  if (mods & (1 << xkb_keymap_mod_get_index(xkb_keymap, "Meta")) && (state & GDK_MOD1_MASK) == 0)
+  const xkb_mod_index_t meta = xkb_keymap_mod_get_index(xkb_keymap, "Meta");
+  meta_mask_                 = meta < std::size(gdk_masks_) ? (1u << meta) : 0;
+}
+
+GdkModifierType ModifierTable::ToGDK(xkb_mod_mask_t mods) const {
+  guint state = 0;
+
+  for (xkb_mod_mask_t bits = mods; bits; bits &= bits - 1) {
+    state |= gdk_masks_[__builtin_ctz(bits)];
+  }
+
+  if ((mods & meta_mask_) && (state & GDK_MOD1_MASK) == 0)
     state |= GDK_META_MASK;
 
   return static_cast<GdkModifierType>(state);
 }
 
+uint64_t EvdevToPhysicalKey(uint32_t evdev_code) {
+  switch (evdev_code) {
+  // clang-format off
+  case KEY_ESC:          return kUsbHidPage | 0x29;
+  case KEY_1:            return kUsbHidPage | 0x1e;
+  case KEY_2:            return kUsbHidPage | 0x1f;
+  case KEY_3:            return kUsbHidPage | 0x20;
+  case KEY_4:            return kUsbHidPage | 0x21;
+  case KEY_5:            return kUsbHidPage | 0x22;
+  case KEY_6:            return kUsbHidPage | 0x23;
+  case KEY_7:            return kUsbHidPage | 0x24;
+  case KEY_8:            return kUsbHidPage | 0x25;
+  case KEY_9:            return kUsbHidPage | 0x26;
+  case KEY_0:            return kUsbHidPage | 0x27;
+  case KEY_MINUS:        return kUsbHidPage | 0x2d;
+  case KEY_EQUAL:        return kUsbHidPage | 0x2e;
+  case KEY_BACKSPACE:    return kUsbHidPage | 0x2a;
+  case KEY_TAB:          return kUsbHidPage | 0x2b;
+  case KEY_Q:            return kUsbHidPage | 0x14;
+  case KEY_W:            return kUsbHidPage | 0x1a;
+  case KEY_E:            return kUsbHidPage | 0x08;
+  case KEY_R:            return kUsbHidPage | 0x15;
+  case KEY_T:            return kUsbHidPage | 0x17;
+  case KEY_Y:            return kUsbHidPage | 0x1c;
+  case KEY_U:            return kUsbHidPage | 0x18;
+  case KEY_I:            return kUsbHidPage | 0x0c;
+  case KEY_O:            return kUsbHidPage | 0x12;
+  case KEY_P:            return kUsbHidPage | 0x13;
+  case KEY_LEFTBRACE:    return kUsbHidPage | 0x2f;
+  case KEY_RIGHTBRACE:   return kUsbHidPage | 0x30;
+  case KEY_ENTER:        return kUsbHidPage | 0x28;
+  case KEY_LEFTCTRL:     return kUsbHidPage | 0xe0;
+  case KEY_A:            return kUsbHidPage | 0x04;
+  case KEY_S:            return kUsbHidPage | 0x16;
+  case KEY_D:            return kUsbHidPage | 0x07;
+  case KEY_F:            return kUsbHidPage | 0x09;
+  case KEY_G:            return kUsbHidPage | 0x0a;
+  case KEY_H:            return kUsbHidPage | 0x0b;
+  case KEY_J:            return kUsbHidPage | 0x0d;
+  case KEY_K:            return kUsbHidPage | 0x0e;
+  case KEY_L:            return kUsbHidPage | 0x0f;
+  case KEY_SEMICOLON:    return kUsbHidPage | 0x33;
+  case KEY_APOSTROPHE:   return kUsbHidPage | 0x34;
+  case KEY_GRAVE:        return kUsbHidPage | 0x35;
+  case KEY_LEFTSHIFT:    return kUsbHidPage | 0xe1;
+  case KEY_BACKSLASH:    return kUsbHidPage | 0x31;
+  case KEY_Z:            return kUsbHidPage | 0x1d;
+  case KEY_X:            return kUsbHidPage | 0x1b;
+  case KEY_C:            return kUsbHidPage | 0x06;
+  case KEY_V:            return kUsbHidPage | 0x19;
+  case KEY_B:            return kUsbHidPage | 0x05;
+  case KEY_N:            return kUsbHidPage | 0x11;
+  case KEY_M:            return kUsbHidPage | 0x10;
+  case KEY_COMMA:        return kUsbHidPage | 0x36;
+  case KEY_DOT:          return kUsbHidPage | 0x37;
+  case KEY_SLASH:        return kUsbHidPage | 0x38;
+  case KEY_RIGHTSHIFT:   return kUsbHidPage | 0xe5;
+  case KEY_KPASTERISK:   return kUsbHidPage | 0x55;
+  case KEY_LEFTALT:      return kUsbHidPage | 0xe2;
+  case KEY_SPACE:        return kUsbHidPage | 0x2c;
+  case KEY_CAPSLOCK:     return kUsbHidPage | 0x39;
+  case KEY_F1:           return kUsbHidPage | 0x3a;
+  case KEY_F2:           return kUsbHidPage | 0x3b;
+  case KEY_F3:           return kUsbHidPage | 0x3c;
+  case KEY_F4:           return kUsbHidPage | 0x3d;
+  case KEY_F5:           return kUsbHidPage | 0x3e;
+  case KEY_F6:           return kUsbHidPage | 0x3f;
+  case KEY_F7:           return kUsbHidPage | 0x40;
+  case KEY_F8:           return kUsbHidPage | 0x41;
+  case KEY_F9:           return kUsbHidPage | 0x42;
+  case KEY_F10:          return kUsbHidPage | 0x43;
+  case KEY_NUMLOCK:      return kUsbHidPage | 0x53;
+  case KEY_SCROLLLOCK:   return kUsbHidPage | 0x47;
+  case KEY_KP7:          return kUsbHidPage | 0x5f;
+  case KEY_KP8:          return kUsbHidPage | 0x60;
+  case KEY_KP9:          return kUsbHidPage | 0x61;
+  case KEY_KPMINUS:      return kUsbHidPage | 0x56;
+  case KEY_KP4:          return kUsbHidPage | 0x5c;
+  case KEY_KP5:          return kUsbHidPage | 0x5d;
+  case KEY_KP6:          return kUsbHidPage | 0x5e;
+  case KEY_KPPLUS:       return kUsbHidPage | 0x57;
+  case KEY_KP1:          return kUsbHidPage | 0x59;
+  case KEY_KP2:          return kUsbHidPage | 0x5a;
+  case KEY_KP3:          return kUsbHidPage | 0x5b;
+  case KEY_KP0:          return kUsbHidPage | 0x62;
+  case KEY_KPDOT:        return kUsbHidPage | 0x63;
+  case KEY_102ND:        return kUsbHidPage | 0x64;
+  case KEY_F11:          return kUsbHidPage | 0x44;
+  case KEY_F12:          return kUsbHidPage | 0x45;
+  case KEY_KPENTER:      return kUsbHidPage | 0x58;
+  case KEY_RIGHTCTRL:    return kUsbHidPage | 0xe4;
+  case KEY_KPSLASH:      return kUsbHidPage | 0x54;
+  case KEY_SYSRQ:        return kUsbHidPage | 0x46;
+  case KEY_RIGHTALT:     return kUsbHidPage | 0xe6;
+  case KEY_HOME:         return kUsbHidPage | 0x4a;
+  case KEY_UP:           return kUsbHidPage | 0x52;
+  case KEY_PAGEUP:       return kUsbHidPage | 0x4b;
+  case KEY_LEFT:         return kUsbHidPage | 0x50;
+  case KEY_RIGHT:        return kUsbHidPage | 0x4f;
+  case KEY_END:          return kUsbHidPage | 0x4d;
+  case KEY_DOWN:         return kUsbHidPage | 0x51;
+  case KEY_PAGEDOWN:     return kUsbHidPage | 0x4e;
+  case KEY_INSERT:       return kUsbHidPage | 0x49;
+  case KEY_DELETE:       return kUsbHidPage | 0x4c;
+  case KEY_PAUSE:        return kUsbHidPage | 0x48;
+  case KEY_LEFTMETA:     return kUsbHidPage | 0xe3;
+  case KEY_RIGHTMETA:    return kUsbHidPage | 0xe7;
+  case KEY_COMPOSE:      return kUsbHidPage | 0x65;
+  // clang-format on
+  default:
+    break;
+  }
+
+  // same fallback as the GTK embedder: the xkb keycode in the GTK plane
+  return kGtkPlane | ((evdev_code + 8) & kValueMask);
+}
+
+uint64_t KeysymToLogicalKey(xkb_keysym_t keysym, uint32_t utf32) {
+  switch (keysym) {
+  // clang-format off
+  case GDK_KEY_BackSpace:        return kUnprintablePlane | 0x008;
+  case GDK_KEY_Tab:
+  case GDK_KEY_ISO_Left_Tab:     return kUnprintablePlane | 0x009;
+  case GDK_KEY_Return:           return kUnprintablePlane | 0x00d;
+  case GDK_KEY_Escape:           return kUnprintablePlane | 0x01b;
+  case GDK_KEY_Delete:           return kUnprintablePlane | 0x07f;
+  case GDK_KEY_Caps_Lock:        return kUnprintablePlane | 0x104;
+  case GDK_KEY_Num_Lock:         return kUnprintablePlane | 0x10a;
+  case GDK_KEY_Scroll_Lock:      return kUnprintablePlane | 0x10c;
+  case GDK_KEY_Down:             return kUnprintablePlane | 0x301;
+  case GDK_KEY_Left:             return kUnprintablePlane | 0x302;
+  case GDK_KEY_Right:            return kUnprintablePlane | 0x303;
+  case GDK_KEY_Up:               return kUnprintablePlane | 0x304;
+  case GDK_KEY_End:              return kUnprintablePlane | 0x305;
+  case GDK_KEY_Home:             return kUnprintablePlane | 0x306;
+  case GDK_KEY_Page_Down:        return kUnprintablePlane | 0x307;
+  case GDK_KEY_Page_Up:          return kUnprintablePlane | 0x308;
+  case GDK_KEY_Insert:           return kUnprintablePlane | 0x407;
+  case GDK_KEY_Menu:             return kUnprintablePlane | 0x505;
+  case GDK_KEY_Pause:            return kUnprintablePlane | 0x509;
+  case GDK_KEY_Print:            return kUnprintablePlane | 0x608;
+  case GDK_KEY_KP_Enter:         return 0x0020000020d;
+  case GDK_KEY_Control_L:        return 0x00200000100;
+  case GDK_KEY_Control_R:        return 0x00200000101;
+  case GDK_KEY_Shift_L:          return 0x00200000102;
+  case GDK_KEY_Shift_R:          return 0x00200000103;
+  case GDK_KEY_Alt_L:            return 0x00200000104;
+  case GDK_KEY_Alt_R:
+  case GDK_KEY_ISO_Level3_Shift: return 0x00200000105;
+  case GDK_KEY_Meta_L:
+  case GDK_KEY_Super_L:          return 0x00200000106;
+  case GDK_KEY_Meta_R:
+  case GDK_KEY_Super_R:          return 0x00200000107;
+  // clang-format on
+  default:
+    break;
+  }
+
+  if (keysym >= GDK_KEY_F1 && keysym <= GDK_KEY_F12) {
+    return kUnprintablePlane | (0x801 + keysym - GDK_KEY_F1);
+  }
+
+  if (utf32 >= 0x20 && utf32 != 0x7f) {
+    // printable keys are identified by their lowercase character; symbols typed
+    // with Shift (e.g. '!') keep theirs, the unshifted one would need the keymap
+    const uint32_t lower = xkb_keysym_to_utf32(xkb_keysym_to_lower(keysym));
+    return kUnicodePlane | (lower != 0 && xkb_keysym_to_utf32(keysym) == utf32 ? lower : utf32);
+  }
+
+  return kGtkPlane | (keysym & kValueMask);
+}
+
 } // namespace flutter
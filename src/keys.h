@@ -22,11 +22,29 @@
 
 #pragma once
 
+#include <cstdint>
 #include <xkbcommon/xkbcommon.h>
 #include <gdk/gdk.h>
 
 namespace flutter {
 
-GdkModifierType toGDKModifiers(struct xkb_keymap *xkb_keymap, guint32 mods);
+// xkb modifier mask to GDK modifier mask translation, built once per keymap so
+// translating the modifiers of a key event is a few table lookups.
+class ModifierTable {
+public:
+  void Update(struct xkb_keymap *xkb_keymap);
+
+  GdkModifierType ToGDK(xkb_mod_mask_t mods) const;
+
+private:
+  guint gdk_masks_[32]      = {}; // indexed by xkb modifier index
+  xkb_mod_mask_t meta_mask_ = 0;
+};
+
+// Flutter's physical key id (USB HID usage) of a Linux evdev key code.
+uint64_t EvdevToPhysicalKey(uint32_t evdev_code);
+
+// Flutter's logical key id of a keysym, utf32 is the character the key produces (or 0).
+uint64_t KeysymToLogicalKey(xkb_keysym_t keysym, uint32_t utf32);
 
 } // namespace flutter
@@ -2,12 +2,19 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <signal.h>
 #include <stdlib.h>
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "utils.h"
+#include "egl_utils.h"
+#include "headless_display.h"
+#include "input_log.h"
+#include "thread_policy.h"
+#include "trace.h"
 #include "wayland_display.h"
 
 static_assert(FLUTTER_ENGINE_VERSION == 1, "");
@@ -17,7 +24,7 @@ namespace flutter {
 static void PrintUsage() {
   std::cerr << "Flutter Wayland Embedder" << std::endl << std::endl;
   std::cerr << "========================" << std::endl;
-  std::cerr << "Usage: `" << GetExecutableName() << " <asset_bundle_path> <flutter_flags>`" << std::endl << std::endl;
+  std::cerr << "Usage: `" << GetExecutableName() << " <asset_bundle_path> [<asset_bundle_path>...] <flutter_flags>`" << std::endl << std::endl;
   std::cerr << R"~(
 This utility runs an instance of a Flutter application and renders using
 Wayland core protocols.
@@ -31,14 +38,79 @@ asset_bundle_path: The Flutter application code needs to be snapshotted using
                    valid Flutter project. This should package all the code and
                    assets in the "build/flutter_assets" directory. Specify this
                    directory as the first argument to this utility.
+                   Several bundles run as separate windows and engines in one
+                   process, sharing the Wayland connection and the Dart VM.
 
     flutter_flags: Typically empty. These extra flags are passed directly to the
                    Flutter engine. To see all supported flags, run
                    `flutter_tester --help` using the test binary included in the
                    Flutter tools.
+
+Environment:
+  FLUTTER_WAYLAND_OPAQUE=1         Marks the surface opaque so the compositor
+                                   does not blend it (implies xrgb8888).
+  FLUTTER_WAYLAND_EGL_FORMAT=fmt   Framebuffer format: rgba8888 (default),
+                                   xrgb8888 or rgb565.
+  FLUTTER_WAYLAND_EGL_DEPTH=n      Depth buffer size (default: 0).
+  FLUTTER_WAYLAND_EGL_STENCIL=n    Stencil buffer size (default: 0).
+  FLUTTER_WAYLAND_EGL_SAMPLES=n    MSAA samples (default: 0).
+  FLUTTER_WAYLAND_THREAD_POLICY=p  Scheduling per thread role, see
+                                   src/thread_policy.h, e.g.
+                                   "raster=fifo:10@2-3;io=nice:10@0-1".
+  FLUTTER_WAYLAND_FRAME_SCHEDULE=m throughput (default) or latency: answer
+                                   vsync as late as measured frame times
+                                   allow, see src/frame_scheduler.h.
+  FLUTTER_WAYLAND_UPLOAD_CONTEXTS=n
+                                   Threads uploading external texture pixels
+                                   (default: 2, 0 uploads on the raster thread).
+  FLUTTER_WAYLAND_TRACE=file      Writes the embedder's trace events as a
+                                   Chrome JSON trace on exit, see src/trace.h.
+  FLUTTER_WAYLAND_METRICS_SOCKET=path
+                                   Serves Prometheus metrics on this Unix
+                                   socket, see src/metrics.h.
+  FLUTTER_WAYLAND_CAPTURE_DIR=dir Writes captured frames into dir, on SIGUSR1
+                                   or every FLUTTER_WAYLAND_CAPTURE_EVERY
+                                   frames, see src/frame_capture.h.
+  FLUTTER_WAYLAND_HEADLESS=hz     Renders offscreen without a compositor at a
+                                   synthetic vsync of hz, "benchmark" as fast
+                                   as possible, see src/headless_display.h.
+  FLUTTER_WAYLAND_INPUT_RECORD=file
+                                   Records input and window metrics changes.
+  FLUTTER_WAYLAND_INPUT_REPLAY=file
+                                   Replays a recording, see src/input_log.h.
+  FLUTTER_WAYLAND_SEMANTICS_SOCKET=path
+                                   Streams the semantics trees to an
+                                   accessibility bridge connected to this
+                                   Unix socket, see src/semantics.h.
+  FLUTTER_WAYLAND_SUPERVISOR=1     SIGHUP restarts the engines while the
+                                   windows and their last frame stay.
+  FLUTTER_WAYLAND_SUPERVISOR_BUNDLES=file
+                                   Asset bundles to restart with, one line
+                                   per window, empty lines keep the bundle.
 )~" << std::endl;
 }
 
+static bool FramebufferConfigFromEnvironment(EGLFramebufferConfig *config) {
+  config->opaque = getEnv("FLUTTER_WAYLAND_OPAQUE", 0.) != 0.;
+
+  const auto format = getEnv("FLUTTER_WAYLAND_EGL_FORMAT", std::string(config->opaque ? "xrgb8888" : "rgba8888"));
+
+  if (!EGLFramebufferConfig::ParseFormat(format, &config->format)) {
+    FL_ERROR("Unknown FLUTTER_WAYLAND_EGL_FORMAT: %s", format.c_str());
+    return false;
+  }
+
+  if (config->opaque && config->HasAlpha()) {
+    FL_WARN("Opaque surface with an alpha channel, the compositor may still blend it");
+  }
+
+  config->depth_size   = static_cast<EGLint>(getEnv("FLUTTER_WAYLAND_EGL_DEPTH", 0.));
+  config->stencil_size = static_cast<EGLint>(getEnv("FLUTTER_WAYLAND_EGL_STENCIL", 0.));
+  config->samples      = static_cast<EGLint>(getEnv("FLUTTER_WAYLAND_EGL_SAMPLES", 0.));
+
+  return true;
+}
+
 static bool Main(std::vector<std::string> args) {
   if (args.size() == 1) {
     FL_ERROR("<Invalid Arguments>");
@@ -46,41 +118,212 @@ static bool Main(std::vector<std::string> args) {
     return false;
   }
 
-  const auto asset_bundle_path = args[1];
+  // every leading argument which is not a flag is an asset bundle
+  auto flags_begin = args.begin() + 1;
+  std::vector<std::string> asset_bundle_paths;
+
+  for (; flags_begin != args.end() && flags_begin->compare(0, 1, "-") != 0; ++flags_begin) {
+    asset_bundle_paths.push_back(*flags_begin);
+  }
 
-  if (!FlutterAssetBundleIsValid(asset_bundle_path)) {
-    FL_ERROR("<Invalid Flutter Asset Bundle>");
+  if (asset_bundle_paths.empty()) {
+    FL_ERROR("<Invalid Arguments>");
     PrintUsage();
     return false;
   }
 
+  for (const auto &asset_bundle_path : asset_bundle_paths) {
+    if (!FlutterAssetBundleIsValid(asset_bundle_path)) {
+      FL_ERROR("<Invalid Flutter Asset Bundle>");
+      PrintUsage();
+      return false;
+    }
+  }
+
   const size_t kWidth  = 1920;
   const size_t kHeight = 1080;
 
-  const std::vector<std::string> flutter_args(args.begin() + 1, args.end());
+  EGLFramebufferConfig framebuffer_config;
 
-  for (const auto &arg : flutter_args) {
-    FL_INFO("Flutter arg: %s", arg.c_str());
+  if (!FramebufferConfigFromEnvironment(&framebuffer_config)) {
+    PrintUsage();
+    return false;
+  }
+
+  if (!ThreadPolicy::Instance().Load(getEnv("FLUTTER_WAYLAND_THREAD_POLICY", std::string("")))) {
+    PrintUsage();
+    return false;
   }
 
-  WaylandDisplay display(kWidth, kHeight);
-  FlutterApplication flutter(&display, asset_bundle_path, flutter_args);
-  if(!flutter.isStarted()) {
-    FL_ERROR("Could not run the Flutter application.");
+  // before the displays, so the keymap prewarm is traced as well
+  if (!Trace::Instance().Start(getEnv("FLUTTER_WAYLAND_TRACE", std::string("")), static_cast<size_t>(getEnv("FLUTTER_WAYLAND_TRACE_EVENTS", 65536.)))) {
+    PrintUsage();
     return false;
   }
 
-  if (!display.IsValid()) {
-    FL_ERROR("Wayland display was not valid.");
+  // a replayed session is not recorded again
+  const std::string input_record = getEnv("FLUTTER_WAYLAND_INPUT_RECORD", std::string(""));
+
+  if (!getEnv("FLUTTER_WAYLAND_INPUT_REPLAY", std::string("")).empty()) {
+    if (!input_record.empty()) {
+      FL_WARN("Replaying input, FLUTTER_WAYLAND_INPUT_RECORD is ignored");
+    }
+  } else if (!InputRecorder::Instance().Start(input_record)) {
+    PrintUsage();
     return false;
   }
 
+  // a clipboard reader or metrics client going away fails the write instead
+  signal(SIGPIPE, SIG_IGN);
+
+  std::vector<std::unique_ptr<WaylandDisplay>> displays;
+  std::vector<std::unique_ptr<FlutterApplication>> applications;
+
+  auto shutdown = [&](bool status) {
+    // engines go before their displays, displays sharing the connection before its owner
+    while (!displays.empty()) {
+      if (applications.size() == displays.size()) {
+        applications.pop_back();
+      }
+      displays.pop_back();
+    }
+
+    // every thread which recorded events has stopped by now
+    Trace::Instance().Stop();
+    InputRecorder::Instance().Stop();
+
+    return status;
+  };
+
+  auto flutter_args_for = [&](const std::string &asset_bundle_path) {
+    std::vector<std::string> flutter_args = {asset_bundle_path};
+    flutter_args.insert(flutter_args.end(), flags_begin, args.end());
+
+    for (const auto &arg : flutter_args) {
+      FL_INFO("Flutter arg: %s", arg.c_str());
+    }
+
+    return flutter_args;
+  };
+
+  const std::string headless = getEnv("FLUTTER_WAYLAND_HEADLESS", std::string(""));
+
+  if (!headless.empty()) {
+    const double refresh_hz = headless == "benchmark" ? 0. : atof(headless.c_str());
+
+    if (headless != "benchmark" && refresh_hz <= 0.) {
+      FL_ERROR("Invalid FLUTTER_WAYLAND_HEADLESS: %s", headless.c_str());
+      PrintUsage();
+      return false;
+    }
+
+    if (asset_bundle_paths.size() > 1) {
+      FL_WARN("Headless: only the first asset bundle runs");
+    }
+
+    auto display = std::make_unique<HeadlessDisplay>(kWidth, kHeight, refresh_hz, framebuffer_config);
+
+    if (!display->IsValid()) {
+      FL_ERROR("Headless display was not valid.");
+      return false;
+    }
+
+    auto application = std::make_unique<FlutterApplication>(display.get(), asset_bundle_paths.front(), flutter_args_for(asset_bundle_paths.front()));
+
+    if (!application->isStarted()) {
+      FL_ERROR("Could not run the Flutter application.");
+      return false;
+    }
+
+    ThreadPolicy::Instance().Apply(ThreadPolicy::Role::PLATFORM);
+
+    const bool success = display->Run();
+
+    application.reset();
+    display.reset();
+    Trace::Instance().Stop();
+    InputRecorder::Instance().Stop();
+
+    return success;
+  }
+
+  for (const auto &asset_bundle_path : asset_bundle_paths) {
+    // the first display owns the wayland connection, the others open their surfaces on it
+    displays.push_back(std::make_unique<WaylandDisplay>(kWidth, kHeight, framebuffer_config, displays.empty() ? nullptr : displays.front().get()));
+    applications.push_back(std::make_unique<FlutterApplication>(displays.back().get(), asset_bundle_path, flutter_args_for(asset_bundle_path)));
+
+    if (!applications.back()->isStarted()) {
+      FL_ERROR("Could not run the Flutter application.");
+      return shutdown(false);
+    }
+
+    if (!displays.back()->IsValid()) {
+      FL_ERROR("Wayland display was not valid.");
+      return shutdown(false);
+    }
+  }
+
   // if (!application.SetWindowSize(kWidth, kHeight)) {
   //   FLWAY_ERROR << "Could not update Flutter application size." << std::endl;
   //   return false;
   // }
 
-  return display.Run();
+  std::vector<WaylandDisplay *> running;
+
+  for (const auto &display : displays) {
+    running.push_back(display.get());
+  }
+
+  // Supervisor mode: only the engines are restarted, the connection, EGL,
+  // the keymap and the surfaces (showing their last frame) stay.
+  const std::string supervisor_bundles = getEnv("FLUTTER_WAYLAND_SUPERVISOR_BUNDLES", std::string(""));
+  bool restart_failed                  = false;
+
+  auto restart = [&]() -> bool {
+    std::vector<std::string> next_bundle_paths = asset_bundle_paths;
+
+    if (!supervisor_bundles.empty()) {
+      std::ifstream file(supervisor_bundles);
+      std::string line;
+
+      for (size_t i = 0; i < next_bundle_paths.size() && std::getline(file, line); i++) {
+        if (!line.empty()) {
+          next_bundle_paths[i] = line;
+        }
+      }
+    }
+
+    for (size_t i = 0; i < applications.size(); i++) {
+      if (!FlutterAssetBundleIsValid(next_bundle_paths[i])) {
+        FL_ERROR("Keeping the engine of window %zu, invalid asset bundle: %s", i, next_bundle_paths[i].c_str());
+        continue;
+      }
+
+      const uint64_t start_ns = FlutterEngineGetCurrentTime();
+
+      applications[i].reset();
+      applications[i] = std::make_unique<FlutterApplication>(displays[i].get(), next_bundle_paths[i], flutter_args_for(next_bundle_paths[i]));
+
+      if (!applications[i]->isStarted()) {
+        FL_ERROR("Could not restart the Flutter application: %s", next_bundle_paths[i].c_str());
+        restart_failed = true;
+        return false;
+      }
+
+      asset_bundle_paths[i] = next_bundle_paths[i];
+      FL_INFO("Engine restart: %s running after %.1f ms", asset_bundle_paths[i].c_str(), (FlutterEngineGetCurrentTime() - start_ns) / 1e6);
+    }
+
+    return true;
+  };
+
+  // after the engines started, so their threads do not inherit it; threads
+  // started from now on (vsync) inherit it unless their own role is configured
+  ThreadPolicy::Instance().Apply(ThreadPolicy::Role::PLATFORM);
+
+  const bool success = getEnv("FLUTTER_WAYLAND_SUPERVISOR", 0.) != 0. ? WaylandDisplay::RunAll(running, restart) : WaylandDisplay::RunAll(running);
+
+  return shutdown(success && !restart_failed);
 }
 
 } // namespace flutter
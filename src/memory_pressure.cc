@@ -0,0 +1,198 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <fstream>
+#include <sstream>
+
+#include "utils.h"
+#include "memory_pressure.h"
+
+namespace flutter {
+
+MemoryPressureWatcher::MemoryPressureWatcher()
+    : enabled_(getEnv("FLUTTER_WAYLAND_MEMORY_PRESSURE", 1.) != 0.)
+    , stall_us_(getEnv("FLUTTER_WAYLAND_MEMORY_PRESSURE_STALL_US", 150000.))
+    , window_us_(getEnv("FLUTTER_WAYLAND_MEMORY_PRESSURE_WINDOW_US", 2000000.))
+    , interval_ms_(getEnv("FLUTTER_WAYLAND_MEMORY_PRESSURE_INTERVAL_MS", 5000.))
+    , quiet_ms_(getEnv("FLUTTER_WAYLAND_MEMORY_PRESSURE_QUIET_MS", 30000.)) {
+}
+
+MemoryPressureWatcher::~MemoryPressureWatcher() {
+  Stop();
+}
+
+// Returns the unified hierarchy path ("0::/path" entry), empty for cgroup v1.
+std::string MemoryPressureWatcher::GetCgroupPath() {
+  std::ifstream cgroup("/proc/self/cgroup");
+  std::string line;
+
+  while (std::getline(cgroup, line)) {
+    if (line.compare(0, 3, "0::") == 0) {
+      return "/sys/fs/cgroup" + line.substr(3);
+    }
+  }
+
+  return "";
+}
+
+bool MemoryPressureWatcher::OpenPSITrigger(const std::string &path) {
+  int fd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+
+  if (fd < 0) {
+    return false;
+  }
+
+  const std::string trigger = "some " + std::to_string(stall_us_) + " " + std::to_string(window_us_);
+
+  if (write(fd, trigger.c_str(), trigger.size() + 1) < 0) {
+    FL_WARN("Could not register PSI trigger '%s' on %s (errno: %d)", trigger.c_str(), path.c_str(), errno);
+    close(fd);
+    return false;
+  }
+
+  FL_INFO("Memory pressure: PSI trigger '%s' on %s", trigger.c_str(), path.c_str());
+
+  fd_     = fd;
+  source_ = Source::PSI;
+
+  return true;
+}
+
+bool MemoryPressureWatcher::OpenCgroupEvents(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+
+  if (fd < 0) {
+    return false;
+  }
+
+  FL_INFO("Memory pressure: watching %s", path.c_str());
+
+  fd_               = fd;
+  source_           = Source::CGROUP_EVENTS;
+  last_event_count_ = ReadCgroupEventCount();
+
+  return true;
+}
+
+// Sum of the reclaim/limit related counters, any increase means we are under pressure.
+uint64_t MemoryPressureWatcher::ReadCgroupEventCount() const {
+  char buffer[512];
+  ssize_t rv = pread(fd_, buffer, sizeof(buffer) - 1, 0);
+
+  if (rv <= 0) {
+    return last_event_count_;
+  }
+
+  buffer[rv] = '\0';
+
+  std::istringstream stream(buffer);
+  std::string key;
+  uint64_t value;
+  uint64_t count = 0;
+
+  while (stream >> key >> value) {
+    if (key == "high" || key == "max" || key == "oom") {
+      count += value;
+    }
+  }
+
+  return count;
+}
+
+bool MemoryPressureWatcher::Start(uv_loop_t *loop, Callback callback, Callback relieved) {
+  if (!enabled_) {
+    return false;
+  }
+
+  const std::string cgroup = GetCgroupPath();
+
+  if (!(cgroup.size() && OpenPSITrigger(cgroup + "/memory.pressure")) && !OpenPSITrigger("/proc/pressure/memory") && !(cgroup.size() && OpenCgroupEvents(cgroup + "/memory.events"))) {
+    FL_WARN("Memory pressure: neither PSI nor cgroup v2 memory.events available");
+    return false;
+  }
+
+  loop_     = loop;
+  callback_ = std::move(callback);
+  relieved_ = std::move(relieved);
+
+  quiet_handle_       = new uv_timer_t;
+  quiet_handle_->data = this;
+  uv_timer_init(loop_, quiet_handle_);
+
+  poll_handle_       = new uv_poll_t;
+  poll_handle_->data = this;
+  uv_poll_init(loop_, poll_handle_, fd_);
+  uv_poll_start(poll_handle_, UV_PRIORITIZED, [](uv_poll_t *handle, int status, int events) { static_cast<MemoryPressureWatcher *>(handle->data)->OnPollEvent(status, events); });
+
+  return true;
+}
+
+void MemoryPressureWatcher::Stop() {
+  if (poll_handle_) {
+    uv_poll_stop(poll_handle_);
+    uv_close(reinterpret_cast<uv_handle_t *>(poll_handle_), [](uv_handle_t *handle) { delete reinterpret_cast<uv_poll_t *>(handle); });
+    poll_handle_ = nullptr;
+  }
+
+  if (quiet_handle_) {
+    uv_timer_stop(quiet_handle_);
+    uv_close(reinterpret_cast<uv_handle_t *>(quiet_handle_), [](uv_handle_t *handle) { delete reinterpret_cast<uv_timer_t *>(handle); });
+    quiet_handle_ = nullptr;
+  }
+
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+
+  source_ = Source::NONE;
+}
+
+void MemoryPressureWatcher::OnPollEvent(int status, int events) {
+  if (status < 0) {
+    // e.g. the cgroup went away under us
+    FL_ERROR("Memory pressure: poll failed: %s", uv_strerror(status));
+    Stop();
+    return;
+  }
+
+  if (source_ == Source::CGROUP_EVENTS) {
+    const uint64_t count = ReadCgroupEventCount();
+
+    if (count == last_event_count_) {
+      return;
+    }
+
+    last_event_count_ = count;
+  }
+
+  // every event, also a throttled one, pushes the end of the pressure out
+  uv_timer_start(quiet_handle_,
+                 [](uv_timer_t *handle) {
+                   MemoryPressureWatcher *const watcher = static_cast<MemoryPressureWatcher *>(handle->data);
+
+                   FL_INFO("Memory pressure is over");
+                   watcher->last_notify_ms_ = 0;
+                   watcher->relieved_();
+                 },
+                 quiet_ms_, 0);
+
+  const uint64_t now_ms = uv_now(loop_);
+
+  if (last_notify_ms_ != 0 && now_ms - last_notify_ms_ < interval_ms_) {
+    return;
+  }
+
+  last_notify_ms_ = now_ms;
+
+  FL_WARN("Memory pressure detected (%s)", source_ == Source::PSI ? "psi" : "memory.events");
+
+  callback_();
+}
+
+} // namespace flutter
@@ -0,0 +1,70 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include <uv.h>
+
+#include "macros.h"
+
+namespace flutter {
+
+// Watches for memory pressure on the libuv loop. Prefers a PSI trigger on the
+// process' cgroup v2 memory.pressure (or the system wide /proc/pressure/memory)
+// and falls back to change notifications of the cgroup's memory.events.
+// Neither signals the end of the pressure, it is considered over once no event
+// came for a quiet period.
+//
+// Configured through the environment:
+//   FLUTTER_WAYLAND_MEMORY_PRESSURE             - 0 disables the watcher (default: 1)
+//   FLUTTER_WAYLAND_MEMORY_PRESSURE_STALL_US    - PSI stall threshold per window (default: 150000)
+//   FLUTTER_WAYLAND_MEMORY_PRESSURE_WINDOW_US   - PSI window, multiple of 2s when unprivileged (default: 2000000)
+//   FLUTTER_WAYLAND_MEMORY_PRESSURE_INTERVAL_MS - minimum time between notifications (default: 5000)
+//   FLUTTER_WAYLAND_MEMORY_PRESSURE_QUIET_MS    - time without events after which the pressure is over
+//                                                 (default: 30000)
+class MemoryPressureWatcher {
+public:
+  using Callback = std::function<void()>;
+
+  MemoryPressureWatcher();
+
+  ~MemoryPressureWatcher();
+
+  // relieved is called once the pressure callback was called and the pressure is over.
+  bool Start(uv_loop_t *loop, Callback callback, Callback relieved);
+  void Stop();
+
+private:
+  enum class Source { NONE, PSI, CGROUP_EVENTS };
+
+  bool enabled_;
+  uint64_t stall_us_;
+  uint64_t window_us_;
+  uint64_t interval_ms_;
+  uint64_t quiet_ms_;
+
+  Source source_             = Source::NONE;
+  int fd_                    = -1;
+  uv_loop_t *loop_           = nullptr;
+  uv_poll_t *poll_handle_    = nullptr;
+  uv_timer_t *quiet_handle_  = nullptr; // running while under pressure
+  uint64_t last_event_count_ = 0;
+  uint64_t last_notify_ms_   = 0;
+  Callback callback_;
+  Callback relieved_;
+
+  bool OpenPSITrigger(const std::string &path);
+  bool OpenCgroupEvents(const std::string &path);
+  uint64_t ReadCgroupEventCount() const;
+  void OnPollEvent(int status, int events);
+
+  static std::string GetCgroupPath();
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(MemoryPressureWatcher)
+};
+
+} // namespace flutter
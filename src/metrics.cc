@@ -0,0 +1,388 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <dirent.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "metrics.h"
+#include "utils.h"
+
+namespace flutter {
+
+Histogram::Histogram(const std::vector<double> &bounds) : bounds_(bounds), buckets_(std::make_unique<std::atomic<uint64_t>[]>(bounds.size() + 1)) {
+  for (size_t i = 0; i <= bounds_.size(); i++) {
+    buckets_[i] = 0;
+  }
+}
+
+void Histogram::Observe(double value) {
+  const size_t bucket = std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin();
+
+  buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+
+  double sum = sum_.load(std::memory_order_relaxed);
+  while (!sum_.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed)) {
+  }
+}
+
+const std::vector<double> &Histogram::Bounds() const {
+  return bounds_;
+}
+
+uint64_t Histogram::BucketCount(size_t bucket) const {
+  return buckets_[bucket].load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::Count() const {
+  return count_.load(std::memory_order_relaxed);
+}
+
+double Histogram::Sum() const {
+  return sum_.load(std::memory_order_relaxed);
+}
+
+Metrics &Metrics::Instance() {
+  static Metrics metrics;
+  return metrics;
+}
+
+Metrics::Family *Metrics::GetFamily(const std::string &name, const char *help, Type type) {
+  auto it = families_.find(name);
+
+  if (it == families_.end()) {
+    it = families_.emplace(name, Family{type, help, {}, {}, {}}).first;
+  } else if (it->second.type != type) {
+    FL_ERROR("Metric %s registered with another type", name.c_str());
+    return nullptr;
+  }
+
+  return &it->second;
+}
+
+Counter *Metrics::GetCounter(const std::string &name, const char *help, const std::string &labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Family *family = GetFamily(name, help, Type::COUNTER);
+
+  // keeps the callers going, the metric is just not exported
+  static Counter orphan;
+
+  if (family == nullptr) {
+    return &orphan;
+  }
+
+  auto &counter = family->counters[labels];
+
+  if (!counter) {
+    counter = std::make_unique<Counter>();
+  }
+
+  return counter.get();
+}
+
+Gauge *Metrics::GetGauge(const std::string &name, const char *help, const std::string &labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Family *family = GetFamily(name, help, Type::GAUGE);
+
+  static Gauge orphan;
+
+  if (family == nullptr) {
+    return &orphan;
+  }
+
+  auto &gauge = family->gauges[labels];
+
+  if (!gauge) {
+    gauge = std::make_unique<Gauge>();
+  }
+
+  return gauge.get();
+}
+
+Histogram *Metrics::GetHistogram(const std::string &name, const char *help, const std::vector<double> &bounds, const std::string &labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Family *family = GetFamily(name, help, Type::HISTOGRAM);
+
+  static Histogram orphan({});
+
+  if (family == nullptr) {
+    return &orphan;
+  }
+
+  auto &histogram = family->histograms[labels];
+
+  if (!histogram) {
+    histogram = std::make_unique<Histogram>(bounds);
+  }
+
+  return histogram.get();
+}
+
+std::string Metrics::Label(const char *key, const std::string &value) {
+  std::string label = std::string(key) + "=\"";
+
+  for (const char c : value) {
+    switch (c) {
+    case '\\':
+      label += "\\\\";
+      break;
+    case '"':
+      label += "\\\"";
+      break;
+    case '\n':
+      label += "\\n";
+      break;
+    default:
+      label += c;
+      break;
+    }
+  }
+
+  return label + "\"";
+}
+
+static std::string WithLabels(const std::string &name, const std::string &labels, const std::string &extra = "") {
+  if (labels.empty() && extra.empty()) {
+    return name;
+  }
+
+  return name + "{" + labels + (labels.empty() || extra.empty() ? "" : ",") + extra + "}";
+}
+
+void Metrics::RenderProcess(std::string *out) {
+  std::stringstream text;
+
+  long pages = 0;
+  std::ifstream statm("/proc/self/statm");
+
+  if (statm >> pages >> pages) {
+    text << "# HELP flutter_wayland_resident_memory_bytes Resident set size.\n";
+    text << "# TYPE flutter_wayland_resident_memory_bytes gauge\n";
+    text << "flutter_wayland_resident_memory_bytes " << pages * sysconf(_SC_PAGESIZE) << "\n";
+  }
+
+  DIR *tasks = opendir("/proc/self/task");
+
+  if (tasks == nullptr) {
+    *out += text.str();
+    return;
+  }
+
+  const double ticks_per_second = static_cast<double>(sysconf(_SC_CLK_TCK));
+
+  text << "# HELP flutter_wayland_thread_cpu_seconds_total User and system CPU time per thread.\n";
+  text << "# TYPE flutter_wayland_thread_cpu_seconds_total counter\n";
+
+  while (struct dirent *entry = readdir(tasks)) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+
+    std::ifstream file(std::string("/proc/self/task/") + entry->d_name + "/stat");
+    std::string stat((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    // the thread name may contain spaces and parentheses
+    const size_t name_begin = stat.find('(');
+    const size_t name_end   = stat.rfind(')');
+
+    if (name_begin == std::string::npos || name_end == std::string::npos || name_end < name_begin) {
+      continue;
+    }
+
+    // fields after the name, starting with state (3), utime is 14 and stime 15
+    std::stringstream fields(stat.substr(name_end + 2));
+    std::string field;
+    unsigned long long utime = 0, stime = 0;
+
+    for (int i = 3; i < 14 && fields >> field; i++) {
+    }
+
+    if (!(fields >> utime >> stime)) {
+      continue;
+    }
+
+    const std::string labels = Label("thread", stat.substr(name_begin + 1, name_end - name_begin - 1)) + "," + Label("tid", entry->d_name);
+    text << WithLabels("flutter_wayland_thread_cpu_seconds_total", labels) << " " << (utime + stime) / ticks_per_second << "\n";
+  }
+
+  closedir(tasks);
+
+  *out += text.str();
+}
+
+// The registry lock is only held to copy the metric pointers, which stay
+// valid, so a scrape never holds up a thread registering a metric.
+std::string Metrics::Render() {
+  struct Entry {
+    const std::string *name;
+    Type type;
+    const char *help;
+    const std::string *labels;
+    const void *metric;
+  };
+
+  std::vector<Entry> entries;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (const auto &[name, family] : families_) {
+      // the maps only grow, their keys stay put
+      for (const auto &[labels, counter] : family.counters) {
+        entries.push_back({&name, family.type, family.help, &labels, counter.get()});
+      }
+
+      for (const auto &[labels, gauge] : family.gauges) {
+        entries.push_back({&name, family.type, family.help, &labels, gauge.get()});
+      }
+
+      for (const auto &[labels, histogram] : family.histograms) {
+        entries.push_back({&name, family.type, family.help, &labels, histogram.get()});
+      }
+    }
+  }
+
+  std::stringstream text;
+  const std::string *family_name = nullptr;
+
+  for (const Entry &entry : entries) {
+    const std::string &name   = *entry.name;
+    const std::string &labels = *entry.labels;
+
+    if (entry.name != family_name) {
+      family_name = entry.name;
+      text << "# HELP " << name << " " << entry.help << "\n";
+      text << "# TYPE " << name << " " << (entry.type == Type::COUNTER ? "counter" : entry.type == Type::GAUGE ? "gauge" : "histogram") << "\n";
+    }
+
+    switch (entry.type) {
+    case Type::COUNTER:
+      text << WithLabels(name, labels) << " " << static_cast<const Counter *>(entry.metric)->Value() << "\n";
+      break;
+
+    case Type::GAUGE:
+      text << WithLabels(name, labels) << " " << static_cast<const Gauge *>(entry.metric)->Value() << "\n";
+      break;
+
+    case Type::HISTOGRAM: {
+      const Histogram *histogram = static_cast<const Histogram *>(entry.metric);
+      const auto &bounds         = histogram->Bounds();
+      uint64_t cumulative        = 0;
+
+      for (size_t i = 0; i < bounds.size(); i++) {
+        std::stringstream le;
+        le << bounds[i];
+
+        cumulative += histogram->BucketCount(i);
+        text << WithLabels(name + "_bucket", labels, Label("le", le.str())) << " " << cumulative << "\n";
+      }
+
+      cumulative += histogram->BucketCount(bounds.size());
+      text << WithLabels(name + "_bucket", labels, Label("le", "+Inf")) << " " << cumulative << "\n";
+      text << WithLabels(name + "_sum", labels) << " " << histogram->Sum() << "\n";
+      text << WithLabels(name + "_count", labels) << " " << histogram->Count() << "\n";
+      break;
+    }
+    }
+  }
+
+  std::string out = text.str();
+  RenderProcess(&out);
+
+  return out;
+}
+
+MetricsServer::MetricsServer() : path_(getEnv("FLUTTER_WAYLAND_METRICS_SOCKET", std::string(""))) {
+}
+
+MetricsServer::~MetricsServer() {
+  Stop();
+}
+
+bool MetricsServer::Start(uv_loop_t *loop) {
+  if (path_.empty()) {
+    return true;
+  }
+
+  // left behind by a previous instance which did not exit cleanly
+  unlink(path_.c_str());
+
+  server_handle_       = new uv_pipe_t;
+  server_handle_->data = this;
+  uv_pipe_init(loop, server_handle_, 0);
+
+  int status = uv_pipe_bind(server_handle_, path_.c_str());
+
+  if (status == 0) {
+    status = uv_listen(reinterpret_cast<uv_stream_t *>(server_handle_), 4, [](uv_stream_t *handle, int status) { static_cast<MetricsServer *>(handle->data)->OnConnection(status); });
+  }
+
+  if (status != 0) {
+    FL_ERROR("Could not serve metrics on %s: %s", path_.c_str(), uv_strerror(status));
+    Stop();
+    return false;
+  }
+
+  FL_INFO("Serving metrics on %s", path_.c_str());
+
+  return true;
+}
+
+void MetricsServer::Stop() {
+  if (server_handle_ == nullptr) {
+    return;
+  }
+
+  uv_close(reinterpret_cast<uv_handle_t *>(server_handle_), [](uv_handle_t *handle) { delete reinterpret_cast<uv_pipe_t *>(handle); });
+  server_handle_ = nullptr;
+
+  unlink(path_.c_str());
+}
+
+void MetricsServer::OnConnection(int status) {
+  if (status != 0) {
+    FL_WARN("Metrics connection failed: %s", uv_strerror(status));
+    return;
+  }
+
+  struct Client {
+    uv_pipe_t pipe;
+    uv_write_t write;
+    std::string response;
+  };
+
+  Client *client = new Client;
+  uv_pipe_init(server_handle_->loop, &client->pipe, 0);
+  client->pipe.data  = client;
+  client->write.data = client;
+
+  auto close = [](uv_handle_t *handle) { delete static_cast<Client *>(handle->data); };
+
+  if (uv_accept(reinterpret_cast<uv_stream_t *>(server_handle_), reinterpret_cast<uv_stream_t *>(&client->pipe)) != 0) {
+    uv_close(reinterpret_cast<uv_handle_t *>(&client->pipe), close);
+    return;
+  }
+
+  const std::string body = Metrics::Instance().Render();
+
+  client->response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+
+  uv_buf_t buffer = uv_buf_init(&client->response[0], client->response.size());
+
+  const int result = uv_write(&client->write, reinterpret_cast<uv_stream_t *>(&client->pipe), &buffer, 1, [](uv_write_t *request, int status) {
+    Client *client = static_cast<Client *>(request->data);
+    uv_close(reinterpret_cast<uv_handle_t *>(&client->pipe), [](uv_handle_t *handle) { delete static_cast<Client *>(handle->data); });
+  });
+
+  if (result != 0) {
+    uv_close(reinterpret_cast<uv_handle_t *>(&client->pipe), close);
+  }
+}
+
+} // namespace flutter
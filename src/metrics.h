@@ -0,0 +1,135 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <uv.h>
+
+#include "macros.h"
+
+namespace flutter {
+
+class Counter {
+public:
+  void Add(uint64_t n = 1) {
+    value_.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  uint64_t Value() const {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<uint64_t> value_ = 0;
+};
+
+class Gauge {
+public:
+  void Set(double value) {
+    value_.store(value, std::memory_order_relaxed);
+  }
+
+  double Value() const {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<double> value_ = 0.;
+};
+
+// Fixed buckets, each observation is a few relaxed atomic adds.
+class Histogram {
+public:
+  explicit Histogram(const std::vector<double> &bounds);
+
+  void Observe(double value);
+
+  const std::vector<double> &Bounds() const;
+  uint64_t BucketCount(size_t bucket) const; // not cumulative, the last bucket is +Inf
+  uint64_t Count() const;
+  double Sum() const;
+
+private:
+  const std::vector<double> bounds_;
+  std::unique_ptr<std::atomic<uint64_t>[]> buckets_;
+  std::atomic<uint64_t> count_ = 0;
+  std::atomic<double> sum_     = 0.;
+};
+
+// Process wide counters, gauges and histograms. Getting a metric takes a lock,
+// callers on hot paths keep the pointer, which stays valid for the lifetime of
+// the process. Updating a metric never blocks, and neither does a scrape
+// block a thread getting a metric for longer than copying the pointers.
+class Metrics {
+public:
+  static Metrics &Instance();
+
+  // labels: preformatted, e.g. Label("channel", name), empty for none.
+  Counter *GetCounter(const std::string &name, const char *help, const std::string &labels = "");
+  Gauge *GetGauge(const std::string &name, const char *help, const std::string &labels = "");
+  Histogram *GetHistogram(const std::string &name, const char *help, const std::vector<double> &bounds, const std::string &labels = "");
+
+  static std::string Label(const char *key, const std::string &value);
+
+  // Prometheus text exposition format, process metrics are sampled from procfs.
+  std::string Render();
+
+private:
+  Metrics() = default;
+
+  enum class Type { COUNTER, GAUGE, HISTOGRAM };
+
+  struct Family {
+    Type type;
+    const char *help;
+    std::map<std::string, std::unique_ptr<Counter>> counters;
+    std::map<std::string, std::unique_ptr<Gauge>> gauges;
+    std::map<std::string, std::unique_ptr<Histogram>> histograms;
+  };
+
+  std::mutex mutex_;
+  std::map<std::string, Family> families_;
+
+  Family *GetFamily(const std::string &name, const char *help, Type type);
+  static void RenderProcess(std::string *out);
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(Metrics)
+};
+
+// Serves Metrics::Render() on a Unix domain socket from the libuv loop, to
+// every client which connects, e.g.
+//   curl --unix-socket /run/user/1000/flutter-wayland.metrics http://localhost/metrics
+// The response is written right away without reading the request, so it also
+// works with plain socket readers like socat.
+//
+// Configured through the environment:
+//   FLUTTER_WAYLAND_METRICS_SOCKET - path of the socket, no metrics are served when unset
+class MetricsServer {
+public:
+  MetricsServer();
+
+  ~MetricsServer();
+
+  bool Start(uv_loop_t *loop);
+  void Stop();
+
+private:
+  std::string path_;
+  uv_pipe_t *server_handle_ = nullptr;
+
+  void OnConnection(int status);
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(MetricsServer)
+};
+
+} // namespace flutter
@@ -0,0 +1,407 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "flutter_application.h"
+#include "mouse_cursor.h"
+#include "utils.h"
+
+namespace flutter {
+
+// CSS names first, then the X11 core names older themes have.
+const MouseCursor::Kind MouseCursor::kKinds[kKindCount] = {
+    {"basic", {"default", "left_ptr"}},
+    {"alias", {"alias", "dnd-link"}},
+    {"allScroll", {"all-scroll", "fleur"}},
+    {"cell", {"cell", "plus"}},
+    {"click", {"pointer", "hand2", "hand1"}},
+    {"contextMenu", {"context-menu"}},
+    {"copy", {"copy", "dnd-copy"}},
+    {"disappearing", {"default", "left_ptr"}},
+    {"forbidden", {"not-allowed", "crossed_circle"}},
+    {"grab", {"grab", "openhand", "hand1"}},
+    {"grabbing", {"grabbing", "closedhand", "fleur"}},
+    {"help", {"help", "question_arrow"}},
+    {"move", {"move", "fleur"}},
+    {"none", {}}, // hidden
+    {"noDrop", {"no-drop", "dnd-no-drop"}},
+    {"precise", {"crosshair", "cross"}},
+    {"progress", {"progress", "left_ptr_watch"}},
+    {"text", {"text", "xterm"}},
+    {"resizeColumn", {"col-resize", "sb_h_double_arrow"}},
+    {"resizeDown", {"s-resize", "bottom_side"}},
+    {"resizeDownLeft", {"sw-resize", "bottom_left_corner"}},
+    {"resizeDownRight", {"se-resize", "bottom_right_corner"}},
+    {"resizeLeft", {"w-resize", "left_side"}},
+    {"resizeLeftRight", {"ew-resize", "sb_h_double_arrow"}},
+    {"resizeRight", {"e-resize", "right_side"}},
+    {"resizeRow", {"row-resize", "sb_v_double_arrow"}},
+    {"resizeUp", {"n-resize", "top_side"}},
+    {"resizeUpDown", {"ns-resize", "sb_v_double_arrow"}},
+    {"resizeUpLeft", {"nw-resize", "top_left_corner"}},
+    {"resizeUpRight", {"ne-resize", "top_right_corner"}},
+    {"resizeUpLeftDownRight", {"nwse-resize", "size_fdiag"}},
+    {"resizeUpRightDownLeft", {"nesw-resize", "size_bdiag"}},
+    {"verticalText", {"vertical-text"}},
+    {"wait", {"wait", "watch"}},
+    {"zoomIn", {"zoom-in"}},
+    {"zoomOut", {"zoom-out"}},
+};
+
+// Just enough StandardMethodCodec for activateSystemCursor, read in place:
+// a method name and a map of strings and integers.
+class StandardReader {
+public:
+  struct Value {
+    uint8_t type;
+    int64_t integer;
+    const char *string;
+    size_t length;
+  };
+
+  StandardReader(const uint8_t *data, size_t size) : p_(data), end_(data + size) {}
+
+  bool Read(Value *value) {
+    if (p_ == end_) {
+      return false;
+    }
+
+    value->type = *p_++;
+
+    switch (value->type) {
+    case kNull:
+    case kTrue:
+    case kFalse:
+      return true;
+    case kInt32: {
+      int32_t integer;
+      if (!Take(&integer, sizeof(integer))) {
+        return false;
+      }
+      value->integer = integer;
+      return true;
+    }
+    case kInt64:
+      return Take(&value->integer, sizeof(value->integer));
+    case kString:
+    case kMap: {
+      uint32_t size;
+
+      if (!ReadSize(&size)) {
+        return false;
+      }
+
+      value->length = size;
+
+      if (value->type == kMap) {
+        return true; // the members follow
+      }
+
+      if (static_cast<size_t>(end_ - p_) < size) {
+        return false;
+      }
+
+      value->string = reinterpret_cast<const char *>(p_);
+      p_ += size;
+      return true;
+    }
+    default:
+      return false;
+    }
+  }
+
+  static constexpr uint8_t kNull   = 0;
+  static constexpr uint8_t kTrue   = 1;
+  static constexpr uint8_t kFalse  = 2;
+  static constexpr uint8_t kInt32  = 3;
+  static constexpr uint8_t kInt64  = 4;
+  static constexpr uint8_t kString = 7;
+  static constexpr uint8_t kMap    = 13;
+
+private:
+  const uint8_t *p_;
+  const uint8_t *const end_;
+
+  bool Take(void *out, size_t size) {
+    if (static_cast<size_t>(end_ - p_) < size) {
+      return false;
+    }
+
+    memcpy(out, p_, size); // little endian, like the framework's
+    p_ += size;
+    return true;
+  }
+
+  bool ReadSize(uint32_t *size) {
+    uint8_t byte;
+
+    if (!Take(&byte, 1)) {
+      return false;
+    }
+
+    if (byte < 254) {
+      *size = byte;
+      return true;
+    }
+
+    if (byte == 254) {
+      uint16_t size16;
+
+      if (!Take(&size16, sizeof(size16))) {
+        return false;
+      }
+
+      *size = size16;
+      return true;
+    }
+
+    return Take(size, sizeof(*size));
+  }
+};
+
+static bool Equals(const StandardReader::Value &value, const char *string) {
+  return value.type == StandardReader::kString && value.length == strlen(string) && memcmp(value.string, string, value.length) == 0;
+}
+
+MouseCursor::MouseCursor() : theme_name_(getEnv("XCURSOR_THEME", std::string(""))), size_(std::max(1, static_cast<int>(getEnv("XCURSOR_SIZE", 24.)))) {
+}
+
+MouseCursor::~MouseCursor() {
+  Detach();
+  Unbind();
+}
+
+void MouseCursor::Bind(wl_compositor *compositor, uint32_t compositor_version, wl_shm *shm) {
+  shm_ = shm;
+
+  if (compositor == nullptr || shm_ == nullptr) {
+    return;
+  }
+
+  surface_      = wl_compositor_create_surface(compositor);
+  buffer_scale_ = compositor_version >= 3;
+
+  LoadTheme();
+}
+
+void MouseCursor::Unbind() {
+  pointer_ = nullptr;
+  cursor_  = nullptr;
+
+  // the theme owns the buffers
+  if (theme_) {
+    wl_cursor_theme_destroy(theme_);
+    theme_ = nullptr;
+  }
+
+  if (surface_) {
+    wl_surface_destroy(surface_);
+    surface_ = nullptr;
+  }
+
+  if (shm_) {
+    wl_shm_destroy(shm_);
+    shm_ = nullptr;
+  }
+}
+
+void MouseCursor::Attach(uv_loop_t *loop) {
+  animation_handle_       = new uv_timer_t;
+  animation_handle_->data = this;
+  uv_timer_init(loop, animation_handle_);
+}
+
+void MouseCursor::Detach() {
+  if (animation_handle_ == nullptr) {
+    return;
+  }
+
+  uv_timer_stop(animation_handle_);
+  uv_close(reinterpret_cast<uv_handle_t *>(animation_handle_), [](uv_handle_t *handle) { delete reinterpret_cast<uv_timer_t *>(handle); });
+  animation_handle_ = nullptr;
+}
+
+void MouseCursor::SetScale(int32_t scale) {
+  if (scale < 1 || scale == scale_) {
+    return;
+  }
+
+  scale_ = scale;
+
+  if (theme_ && buffer_scale_) {
+    LoadTheme();
+  }
+}
+
+void MouseCursor::LoadTheme() {
+  const uint64_t start_ns = FlutterEngineGetCurrentTime();
+  const int32_t scale     = buffer_scale_ ? scale_ : 1;
+
+  // the cursor is shown again from the new buffers below
+  if (animation_handle_) {
+    uv_timer_stop(animation_handle_);
+  }
+
+  cursor_ = nullptr;
+
+  if (theme_) {
+    wl_cursor_theme_destroy(theme_);
+  }
+
+  memset(cursors_, 0, sizeof(cursors_));
+  theme_ = wl_cursor_theme_load(theme_name_.empty() ? nullptr : theme_name_.c_str(), size_ * scale, shm_);
+
+  if (theme_ == nullptr) {
+    FL_ERROR("Could not load the cursor theme %s", theme_name_.c_str());
+    return;
+  }
+
+  size_t images = 0;
+
+  for (size_t i = 0; i < kKindCount; i++) {
+    for (const char *name : kKinds[i].themed) {
+      if (name != nullptr && (cursors_[i] = wl_cursor_theme_get_cursor(theme_, name)) != nullptr) {
+        break;
+      }
+    }
+
+    // wl_buffers are created on first use otherwise, on the first hover
+    for (unsigned int j = 0; cursors_[i] != nullptr && j < cursors_[i]->image_count; j++) {
+      wl_cursor_image_get_buffer(cursors_[i]->images[j]);
+      images++;
+    }
+  }
+
+  if (buffer_scale_) {
+    wl_surface_set_buffer_scale(surface_, scale);
+  }
+
+  FL_INFO("Cursor theme %s loaded at size %d in %.1f ms, %zu images", theme_name_.empty() ? "default" : theme_name_.c_str(), size_ * scale, (FlutterEngineGetCurrentTime() - start_ns) / 1e6, images);
+
+  if (pointer_) {
+    Show(kind_);
+  }
+}
+
+void MouseCursor::Enter(wl_pointer *pointer, uint32_t serial) {
+  pointer_ = pointer;
+  serial_  = serial; // of the enter event, set_cursor needs it
+
+  Show(kind_);
+}
+
+void MouseCursor::Leave() {
+  pointer_ = nullptr;
+  cursor_  = nullptr;
+
+  if (animation_handle_) {
+    uv_timer_stop(animation_handle_);
+  }
+}
+
+void MouseCursor::HandleMessage(Application *application, const FlutterPlatformMessage *message) {
+  static const uint8_t kSuccess[] = {0, StandardReader::kNull}; // envelope with a null result
+
+  StandardReader reader(message->message, message->message_size);
+  StandardReader::Value method, args;
+
+  if (!reader.Read(&method) || !Equals(method, "activateSystemCursor") || !reader.Read(&args) || args.type != StandardReader::kMap) {
+    application->respondPlatformMessage(message->response_handle, nullptr, 0);
+    return;
+  }
+
+  StandardReader::Value key, value;
+  StandardReader::Value kind = {};
+
+  for (size_t i = 0; i < args.length && reader.Read(&key) && reader.Read(&value); i++) {
+    if (Equals(key, "kind")) {
+      kind = value;
+    }
+  }
+
+  size_t index = 0; // unknown kinds get the basic cursor
+
+  for (size_t i = 0; i < kKindCount; i++) {
+    if (Equals(kind, kKinds[i].name)) {
+      index = i;
+      break;
+    }
+  }
+
+  // the framework only asks on changes, still no requests for the same cursor
+  if (index != kind_) {
+    kind_ = index;
+
+    if (pointer_) {
+      Show(index);
+    }
+  }
+
+  application->respondPlatformMessage(message->response_handle, kSuccess, sizeof(kSuccess));
+}
+
+void MouseCursor::Show(size_t kind) {
+  if (animation_handle_) {
+    uv_timer_stop(animation_handle_);
+  }
+
+  cursor_ = nullptr;
+  frame_  = 0;
+
+  // only "none" hides the pointer
+  if (kKinds[kind].themed[0] == nullptr) {
+    wl_pointer_set_cursor(pointer_, serial_, nullptr, 0, 0);
+    return;
+  }
+
+  cursor_ = cursors_[kind] != nullptr ? cursors_[kind] : cursors_[0];
+
+  // without shm or a theme (or not even its basic cursor) the compositor's cursor stays
+  if (cursor_ == nullptr || surface_ == nullptr) {
+    return;
+  }
+
+  const int32_t scale          = buffer_scale_ ? scale_ : 1;
+  const wl_cursor_image *image = cursor_->images[0];
+
+  ShowFrame();
+  wl_pointer_set_cursor(pointer_, serial_, surface_, image->hotspot_x / scale, image->hotspot_y / scale);
+}
+
+void MouseCursor::ShowFrame() {
+  wl_cursor_image *const image = cursor_->images[frame_];
+
+  wl_surface_attach(surface_, wl_cursor_image_get_buffer(image), 0, 0);
+  wl_surface_damage(surface_, 0, 0, image->width, image->height);
+  wl_surface_commit(surface_);
+
+  if (cursor_->image_count > 1) {
+    Animate();
+  }
+}
+
+void MouseCursor::Animate() {
+  if (animation_handle_ == nullptr) {
+    return;
+  }
+
+  uv_timer_start(
+      animation_handle_,
+      [](uv_timer_t *handle) {
+        MouseCursor *const mc = static_cast<MouseCursor *>(handle->data);
+
+        if (mc->cursor_ == nullptr) {
+          return;
+        }
+
+        mc->frame_ = (mc->frame_ + 1) % mc->cursor_->image_count;
+        mc->ShowFrame();
+      },
+      cursor_->images[frame_]->delay, 0);
+}
+
+} // namespace flutter
@@ -0,0 +1,94 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include <flutter_embedder.h>
+#include <uv.h>
+#include <wayland-client.h>
+#include <wayland-cursor.h>
+
+#include "macros.h"
+
+namespace flutter {
+
+class Application;
+
+// flutter/mousecursor: shows the system cursor kinds the framework activates
+// while the pointer is over our surface.
+//
+// The cursor theme is loaded once at the output's scale, and the buffers of
+// every cursor kind are created right away, so activating a cursor is a table
+// lookup, an attach to the cursor surface and one wl_pointer.set_cursor,
+// without file I/O or allocation however many widgets the pointer crosses.
+// Animated cursors advance their frames from a timer on the uv loop. A new
+// output scale loads the theme again.
+//
+// Configured through the environment:
+//   XCURSOR_THEME - cursor theme (default: the default theme)
+//   XCURSOR_SIZE  - cursor size in logical pixels (default: 24)
+class MouseCursor {
+public:
+  static constexpr const char *kChannel = "flutter/mousecursor";
+
+  MouseCursor();
+
+  ~MouseCursor();
+
+  // After the registry roundtrip, takes the shm global; without it the
+  // compositor's cursor stays. Unbind() before the connection goes away.
+  void Bind(wl_compositor *compositor, uint32_t compositor_version, wl_shm *shm);
+  void Unbind();
+
+  void Attach(uv_loop_t *loop);
+  void Detach();
+
+  void SetScale(int32_t scale);
+
+  // The pointer entered or left our surface.
+  void Enter(wl_pointer *pointer, uint32_t serial);
+  void Leave();
+
+  void HandleMessage(Application *application, const FlutterPlatformMessage *message);
+
+private:
+  struct Kind {
+    const char *name;      // SystemMouseCursors kind
+    const char *themed[3]; // cursor names in the theme, by preference
+  };
+
+  static constexpr size_t kKindCount = 36;
+  static const Kind kKinds[kKindCount]; // basic first
+
+  const std::string theme_name_;
+  const int size_;
+
+  wl_shm *shm_                    = nullptr;
+  wl_surface *surface_            = nullptr;
+  bool buffer_scale_              = false; // wl_surface.set_buffer_scale, compositor version 3
+  int32_t scale_                  = 1;
+  wl_cursor_theme *theme_         = nullptr;
+  wl_cursor *cursors_[kKindCount] = {}; // null when the theme has none
+  uv_timer_t *animation_handle_   = nullptr;
+
+  wl_pointer *pointer_ = nullptr; // while over our surface
+  uint32_t serial_     = 0;
+  size_t kind_         = 0;       // the active one, shown on enter
+  wl_cursor *cursor_   = nullptr; // shown, null when hidden
+  uint32_t frame_      = 0;
+
+  void LoadTheme();
+  void Show(size_t kind);
+  void ShowFrame();
+  void Animate();
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(MouseCursor)
+};
+
+} // namespace flutter
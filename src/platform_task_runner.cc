@@ -0,0 +1,115 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <functional>
+
+#include "platform_task_runner.h"
+
+namespace flutter {
+
+PlatformTaskRunner &PlatformTaskRunner::Instance() {
+  static PlatformTaskRunner runner;
+  return runner;
+}
+
+// the first use is in main(), before any engine runs
+PlatformTaskRunner::PlatformTaskRunner() : thread_id_(std::this_thread::get_id()) {
+}
+
+FlutterTaskRunnerDescription PlatformTaskRunner::Description(FlutterEngine *engine) {
+  return {
+      .struct_size                          = sizeof(FlutterTaskRunnerDescription),
+      .user_data                            = engine,
+      .runs_task_on_current_thread_callback = [](void *user_data) -> bool { return std::this_thread::get_id() == Instance().thread_id_; },
+      .post_task_callback                   = [](FlutterTask task, uint64_t target_time_nanos, void *user_data) { Instance().Post(static_cast<FlutterEngine *>(user_data), task, target_time_nanos); },
+      .identifier                           = reinterpret_cast<size_t>(engine), // unique among the runners of one engine
+  };
+}
+
+void PlatformTaskRunner::Post(FlutterEngine *engine, FlutterTask task, uint64_t target_ns) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  tasks_.push_back({engine, task, target_ns});
+  std::push_heap(tasks_.begin(), tasks_.end(), std::greater<Task>());
+
+  if (async_handle_) {
+    uv_async_send(async_handle_);
+  }
+}
+
+void PlatformTaskRunner::Forget(FlutterEngine *engine) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  tasks_.erase(std::remove_if(tasks_.begin(), tasks_.end(), [engine](const Task &task) { return task.engine == engine; }), tasks_.end());
+  std::make_heap(tasks_.begin(), tasks_.end(), std::greater<Task>());
+}
+
+void PlatformTaskRunner::Attach(uv_loop_t *loop) {
+  timer_handle_ = new uv_timer_t;
+  uv_timer_init(loop, timer_handle_);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  async_handle_ = new uv_async_t;
+  uv_async_init(loop, async_handle_, [](uv_async_t *handle) { Instance().RunExpired(); });
+
+  // whatever the engines posted while starting
+  uv_async_send(async_handle_);
+}
+
+void PlatformTaskRunner::Detach() {
+  if (timer_handle_ == nullptr) {
+    return;
+  }
+
+  uv_timer_stop(timer_handle_);
+  uv_close(reinterpret_cast<uv_handle_t *>(timer_handle_), [](uv_handle_t *handle) { delete reinterpret_cast<uv_timer_t *>(handle); });
+  timer_handle_ = nullptr;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  uv_close(reinterpret_cast<uv_handle_t *>(async_handle_), [](uv_handle_t *handle) { delete reinterpret_cast<uv_async_t *>(handle); });
+  async_handle_ = nullptr;
+}
+
+void PlatformTaskRunner::RunExpired() {
+  std::vector<Task> expired;
+  uint64_t next_ns = 0;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const uint64_t now_ns = FlutterEngineGetCurrentTime();
+
+    while (!tasks_.empty() && tasks_.front().target_ns <= now_ns) {
+      std::pop_heap(tasks_.begin(), tasks_.end(), std::greater<Task>());
+      expired.push_back(tasks_.back());
+      tasks_.pop_back();
+    }
+
+    if (!tasks_.empty()) {
+      next_ns = tasks_.front().target_ns - now_ns;
+    }
+  }
+
+  // outside the lock, tasks post further tasks
+  for (const auto &task : expired) {
+    if (*task.engine == nullptr || FlutterEngineRunTask(*task.engine, &task.task) != kSuccess) {
+      FL_ERROR("Could not run a platform task");
+    }
+  }
+
+  if (timer_handle_ == nullptr) {
+    return;
+  }
+
+  // tasks posted meanwhile woke the async handle already
+  if (next_ns > 0) {
+    uv_timer_start(timer_handle_, [](uv_timer_t *handle) { Instance().RunExpired(); }, (next_ns + 999999) / 1000000, 0);
+  } else {
+    uv_timer_stop(timer_handle_);
+  }
+}
+
+} // namespace flutter
@@ -0,0 +1,64 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <flutter_embedder.h>
+#include <uv.h>
+
+#include "macros.h"
+
+namespace flutter {
+
+// Runs the engines' platform tasks on the uv loop of the thread which started
+// them. Platform messages and their responses are delivered by these tasks, so
+// nothing reaches a channel handler without it. Tasks posted before a loop is
+// attached wait for it.
+class PlatformTaskRunner {
+public:
+  static PlatformTaskRunner &Instance();
+
+  // The engine pointer is read when a task runs, it may still be null while
+  // FlutterEngineRun() posts the first tasks.
+  FlutterTaskRunnerDescription Description(FlutterEngine *engine);
+
+  // Drops the tasks of an engine which was shut down.
+  void Forget(FlutterEngine *engine);
+
+  void Attach(uv_loop_t *loop);
+  void Detach();
+
+private:
+  PlatformTaskRunner();
+
+  struct Task {
+    FlutterEngine *engine;
+    FlutterTask task;
+    uint64_t target_ns;
+
+    bool operator>(const Task &other) const {
+      return target_ns > other.target_ns;
+    }
+  };
+
+  const std::thread::id thread_id_;
+
+  std::mutex mutex_;
+  std::vector<Task> tasks_; // min-heap on target_ns, guarded by mutex_
+  uv_async_t *async_handle_ = nullptr; // guarded by mutex_
+  uv_timer_t *timer_handle_ = nullptr;
+
+  void Post(FlutterEngine *engine, FlutterTask task, uint64_t target_ns);
+  void RunExpired();
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(PlatformTaskRunner)
+};
+
+} // namespace flutter
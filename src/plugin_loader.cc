@@ -0,0 +1,197 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <dlfcn.h>
+
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#include "flutter_application.h"
+#include "json.h"
+#include "plugin_loader.h"
+#include "trace.h"
+#include "utils.h"
+
+namespace flutter {
+
+struct PluginLoader::Module {
+  void *handle;
+  FlutterWaylandPluginInitFn init;
+  std::string load_trace_name; // trace event names must outlive the trace
+  std::string init_trace_name;
+};
+
+static std::string BaseName(const std::string &path) {
+  const auto slash = path.find_last_of('/');
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+PluginLoader::PluginLoader(Application *application) : application_(application) {
+  host_ = {
+      .struct_size  = sizeof(FlutterWaylandPluginHost),
+      .host_data    = application,
+      .send_message = [](void *host_data, const char *channel, const uint8_t *message, size_t message_size) { return static_cast<Application *>(host_data)->sendPlatformMessage(channel, message, message_size); },
+      .respond      = [](void *host_data, const FlutterPlatformMessageResponseHandle *response_handle, const uint8_t *message, size_t message_size) { return static_cast<Application *>(host_data)->respondPlatformMessage(response_handle, message, message_size); },
+  };
+}
+
+PluginLoader::~PluginLoader() {
+  for (const auto &plugin : plugins_) {
+    if (plugin->module != nullptr && plugin->instance.destroy != nullptr) {
+      plugin->instance.destroy(plugin->instance.user_data);
+    }
+  }
+}
+
+bool PluginLoader::Load(const std::string &bundle_path) {
+  const std::string manifest_path = bundle_path + "/" + kManifest;
+  std::ifstream file(manifest_path);
+
+  if (!file) {
+    return true;
+  }
+
+  std::stringstream stream;
+  stream << file.rdbuf();
+  const std::string data = stream.str();
+
+  const JsonValue manifest = JsonValue::Parse(reinterpret_cast<const uint8_t *>(data.data()), data.size());
+  const JsonValue &plugins = manifest["plugins"];
+
+  if (plugins.type() != JsonValue::Type::ARRAY) {
+    FL_ERROR("%s: no plugins array", manifest_path.c_str());
+    return false;
+  }
+
+  for (size_t i = 0; i < plugins.size(); i++) {
+    const JsonValue &entry = plugins[i];
+    auto plugin            = std::make_unique<Plugin>();
+
+    plugin->library = entry["library"].AsString();
+    plugin->preload = entry["preload"].AsBool(false);
+
+    for (size_t j = 0; j < entry["channels"].size(); j++) {
+      plugin->channels.push_back(entry["channels"][j].AsString());
+    }
+
+    if (plugin->library.empty() || plugin->channels.empty()) {
+      FL_ERROR("%s: plugin %zu needs a library and channels", manifest_path.c_str(), i);
+      continue;
+    }
+
+    // relative paths are within the bundle, a plain name is looked up there
+    // first and otherwise left to dlopen()
+    const bool plain_name = plugin->library.find('/') == std::string::npos;
+
+    if (plugin->library[0] != '/' && (!plain_name || FileExistsAtPath(bundle_path + "/" + plugin->library))) {
+      plugin->library = bundle_path + "/" + plugin->library;
+    }
+
+    Plugin *const p = plugin.get();
+
+    for (const auto &channel : plugin->channels) {
+      application_->setPlatformMessageHandler(channel, [this, p](const FlutterPlatformMessage *message) {
+        if (p->module == nullptr && !Activate(p)) {
+          application_->respondPlatformMessage(message->response_handle, nullptr, 0);
+          return;
+        }
+
+        p->instance.handle_message(p->instance.user_data, message);
+      });
+    }
+
+    plugins_.push_back(std::move(plugin));
+  }
+
+  for (const auto &plugin : plugins_) {
+    if (plugin->preload) {
+      Activate(plugin.get());
+    }
+  }
+
+  FL_INFO("%zu plugins in %s", plugins_.size(), manifest_path.c_str());
+
+  return true;
+}
+
+const PluginLoader::Module *PluginLoader::OpenModule(const std::string &path) {
+  // modules are shared by every engine of the process and never closed
+  static std::mutex mutex;
+  static std::map<std::string, std::unique_ptr<Module>> modules;
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto it = modules.find(path);
+
+  if (it != modules.end()) {
+    return it->second.get();
+  }
+
+  const uint64_t start_ns = FlutterEngineGetCurrentTime();
+  void *handle            = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+
+  if (handle == nullptr) {
+    FL_ERROR("Could not load plugin %s: %s", path.c_str(), dlerror());
+    return nullptr;
+  }
+
+  auto init = reinterpret_cast<FlutterWaylandPluginInitFn>(dlsym(handle, FLUTTER_WAYLAND_PLUGIN_INIT));
+
+  if (init == nullptr) {
+    FL_ERROR("Plugin %s does not export %s", path.c_str(), FLUTTER_WAYLAND_PLUGIN_INIT);
+    dlclose(handle);
+    return nullptr;
+  }
+
+  auto module = std::make_unique<Module>(Module{
+      .handle          = handle,
+      .init            = init,
+      .load_trace_name = "plugin.load " + BaseName(path),
+      .init_trace_name = "plugin.init " + BaseName(path),
+  });
+
+  const uint64_t end_ns = FlutterEngineGetCurrentTime();
+
+  if (Trace::IsEnabled()) {
+    Trace::Instance().Complete(module->load_trace_name.c_str(), start_ns, end_ns);
+  }
+
+  FL_INFO("Loaded plugin %s in %.1f ms", path.c_str(), (end_ns - start_ns) / 1e6);
+
+  return modules.emplace(path, std::move(module)).first->second.get();
+}
+
+bool PluginLoader::Activate(Plugin *plugin) {
+  if (plugin->failed) {
+    return false;
+  }
+
+  const Module *module = OpenModule(plugin->library);
+
+  if (module == nullptr) {
+    plugin->failed = true;
+    return false;
+  }
+
+  const uint64_t start_ns = FlutterEngineGetCurrentTime();
+
+  plugin->instance = {.struct_size = sizeof(FlutterWaylandPlugin)};
+
+  if (!module->init(&host_, &plugin->instance) || plugin->instance.handle_message == nullptr) {
+    FL_ERROR("Plugin %s did not initialize", plugin->library.c_str());
+    plugin->failed = true;
+    return false;
+  }
+
+  if (Trace::IsEnabled()) {
+    Trace::Instance().Complete(module->init_trace_name.c_str(), start_ns, FlutterEngineGetCurrentTime());
+  }
+
+  plugin->module = module;
+
+  return true;
+}
+
+} // namespace flutter
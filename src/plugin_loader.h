@@ -0,0 +1,67 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "macros.h"
+#include "flutter_wayland_plugin.h"
+
+namespace flutter {
+
+class Application;
+
+// Native plugin modules listed in flutter_wayland_plugins.json of the asset
+// bundle:
+//
+//   {"plugins": [
+//     {"library": "libcamera_plugin.so", "channels": ["plugins.flutter.io/camera"], "preload": true},
+//     {"library": "libshare_plugin.so", "channels": ["plugins.flutter.io/share"]}
+//   ]}
+//
+// A plain library name is looked up next to the manifest first, then where
+// dlopen() searches. A module is opened when the first message on one of its
+// channels arrives, or at startup with preload set, and stays open for the
+// rest of the process; engine restarts and further windows only initialize
+// another instance of it. Opening and initializing each show up in the trace
+// as "plugin.load <library>" and "plugin.init <library>".
+class PluginLoader {
+public:
+  static constexpr const char *kManifest = "flutter_wayland_plugins.json";
+
+  explicit PluginLoader(Application *application);
+
+  // Destroys the instances, after the engine shut down.
+  ~PluginLoader();
+
+  // Registers the channels of the bundle's manifest and loads the preload
+  // plugins once the engine runs. Without a manifest there is nothing to do.
+  bool Load(const std::string &bundle_path);
+
+private:
+  struct Module;
+
+  struct Plugin {
+    std::string library;
+    std::vector<std::string> channels;
+    bool preload                  = false;
+    const Module *module          = nullptr; // once activated
+    bool failed                   = false;   // not retried on every message
+    FlutterWaylandPlugin instance = {};
+  };
+
+  Application *const application_;
+  FlutterWaylandPluginHost host_;
+  std::vector<std::unique_ptr<Plugin>> plugins_;
+
+  static const Module *OpenModule(const std::string &path);
+  bool Activate(Plugin *plugin);
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(PluginLoader)
+};
+
+} // namespace flutter
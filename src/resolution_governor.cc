@@ -0,0 +1,85 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+
+#include "utils.h"
+#include "resolution_governor.h"
+
+namespace flutter {
+
+ResolutionGovernor::ResolutionGovernor()
+    : enabled_(getEnv("FLUTTER_WAYLAND_DRS", 0.) != 0.)
+    , min_scale_(std::clamp(getEnv("FLUTTER_WAYLAND_DRS_MIN_SCALE", 0.5), 0.1, 1.0))
+    , step_(std::clamp(getEnv("FLUTTER_WAYLAND_DRS_STEP", 0.1), 0.01, 0.5))
+    , missed_frames_(std::max(1., getEnv("FLUTTER_WAYLAND_DRS_MISSED_FRAMES", 3.)))
+    , headroom_frames_(std::max(1., getEnv("FLUTTER_WAYLAND_DRS_HEADROOM_FRAMES", 60.)))
+    , headroom_(std::clamp(getEnv("FLUTTER_WAYLAND_DRS_HEADROOM", 0.6), 0.1, 1.0)) {
+  if (enabled_) {
+    FL_INFO("Dynamic resolution: min_scale: %.2f step: %.2f missed_frames: %u headroom_frames: %u headroom: %.2f", min_scale_, step_, missed_frames_, headroom_frames_, headroom_);
+  }
+}
+
+bool ResolutionGovernor::IsEnabled() const {
+  return enabled_;
+}
+
+void ResolutionGovernor::Disable() {
+  enabled_ = false;
+  scale_   = 1.0;
+}
+
+double ResolutionGovernor::Scale() const {
+  return scale_;
+}
+
+void ResolutionGovernor::FrameBegin(uint64_t now_ns) {
+  // make_current may be called more than once per frame, the first call marks the beginning
+  if (frame_begin_ns_ == 0) {
+    frame_begin_ns_ = now_ns;
+  }
+}
+
+bool ResolutionGovernor::FrameEnd(uint64_t now_ns, uint64_t frame_budget_ns) {
+  if (!enabled_ || frame_begin_ns_ == 0) {
+    return false;
+  }
+
+  const uint64_t frame_ns = now_ns - frame_begin_ns_;
+  frame_begin_ns_         = 0;
+
+  if (frame_ns > frame_budget_ns) {
+    late_count_++;
+    fast_count_ = 0;
+  } else if (frame_ns < frame_budget_ns * headroom_) {
+    fast_count_++;
+    late_count_ = 0;
+  } else {
+    late_count_ = 0;
+    fast_count_ = 0;
+  }
+
+  const double scale = scale_;
+  double new_scale   = scale;
+
+  if (late_count_ >= missed_frames_) {
+    new_scale = std::max(min_scale_, scale - step_);
+  } else if (fast_count_ >= headroom_frames_) {
+    new_scale = std::min(1.0, scale + step_);
+  }
+
+  if (new_scale == scale) {
+    return false;
+  }
+
+  late_count_ = 0;
+  fast_count_ = 0;
+  scale_      = new_scale;
+
+  FL_INFO("Dynamic resolution: scale %.2f -> %.2f (frame: %ju us budget: %ju us)", scale, new_scale, frame_ns / 1000, frame_budget_ns / 1000);
+
+  return true;
+}
+
+} // namespace flutter
@@ -0,0 +1,53 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "macros.h"
+
+namespace flutter {
+
+// Dynamic resolution scaling: lowers the render scale in steps when frames
+// miss their deadline and raises it again once there is headroom.
+//
+// Configured through the environment:
+//   FLUTTER_WAYLAND_DRS                 - 1 enables the governor (default: 0)
+//   FLUTTER_WAYLAND_DRS_MIN_SCALE       - lowest render scale (default: 0.5)
+//   FLUTTER_WAYLAND_DRS_STEP            - scale change per step (default: 0.1)
+//   FLUTTER_WAYLAND_DRS_MISSED_FRAMES   - consecutive late frames before scaling down (default: 3)
+//   FLUTTER_WAYLAND_DRS_HEADROOM_FRAMES - consecutive fast frames before scaling up (default: 60)
+//   FLUTTER_WAYLAND_DRS_HEADROOM        - fraction of the frame budget counted as fast (default: 0.6)
+class ResolutionGovernor {
+public:
+  ResolutionGovernor();
+
+  bool IsEnabled() const;
+  void Disable();
+
+  // Both are called on the raster thread, around the rendering of one frame.
+  void FrameBegin(uint64_t now_ns);
+  bool FrameEnd(uint64_t now_ns, uint64_t frame_budget_ns);
+
+  double Scale() const;
+
+private:
+  bool enabled_             = false;
+  double min_scale_         = 0.5;
+  double step_              = 0.1;
+  uint32_t missed_frames_   = 3;
+  uint32_t headroom_frames_ = 60;
+  double headroom_          = 0.6;
+
+  std::atomic<double> scale_ = 1.0;
+  uint64_t frame_begin_ns_   = 0;
+  uint32_t late_count_       = 0;
+  uint32_t fast_count_       = 0;
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(ResolutionGovernor)
+};
+
+} // namespace flutter
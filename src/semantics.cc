@@ -0,0 +1,611 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "flutter_application.h"
+#include "json.h"
+#include "semantics.h"
+#include "utils.h"
+
+namespace flutter {
+
+static const char *NonNull(const char *text) {
+  return text != nullptr ? text : "";
+}
+
+const std::vector<SemanticsTree::NodeChange> &SemanticsTree::Apply(const FlutterSemanticsUpdate2 *update) {
+  changes_.clear();
+  orphans_.clear();
+
+  for (size_t i = 0; i < update->node_count; i++) {
+    const FlutterSemanticsNode2 &node = *update->nodes[i];
+
+    if (node.id < 0) {
+      continue;
+    }
+
+    const int32_t slot = Acquire(node.id);
+    uint32_t changes   = filled_[slot] ? 0 : static_cast<uint32_t>(ADDED);
+    filled_[slot]      = true;
+
+    const uint64_t flags   = static_cast<uint64_t>(node.flags);
+    const uint64_t actions = static_cast<uint64_t>(node.actions);
+
+    if (flags_[slot] != flags || actions_[slot] != actions) {
+      flags_[slot]   = flags;
+      actions_[slot] = actions;
+      changes |= STATE;
+    }
+
+    Text &text = text_[slot];
+
+    if (text.label != NonNull(node.label) || text.value != NonNull(node.value) || text.hint != NonNull(node.hint) || text.tooltip != NonNull(node.tooltip) || text.selection_base != node.text_selection_base ||
+        text.selection_extent != node.text_selection_extent) {
+      // assign() keeps the capacity, equal lengths do not allocate
+      text.label.assign(NonNull(node.label));
+      text.value.assign(NonNull(node.value));
+      text.hint.assign(NonNull(node.hint));
+      text.tooltip.assign(NonNull(node.tooltip));
+      text.selection_base   = node.text_selection_base;
+      text.selection_extent = node.text_selection_extent;
+      changes |= TEXT;
+    }
+
+    if (memcmp(&rect_[slot], &node.rect, sizeof(FlutterRect)) != 0 || memcmp(&transform_[slot], &node.transform, sizeof(FlutterTransformation)) != 0) {
+      rect_[slot]      = node.rect;
+      transform_[slot] = node.transform;
+      changes |= BOUNDS;
+    }
+
+    const Scroll scroll = {node.scroll_position, node.scroll_extent_min, node.scroll_extent_max, node.scroll_child_count, node.scroll_index};
+
+    if (memcmp(&scroll_[slot], &scroll, sizeof(Scroll)) != 0) {
+      scroll_[slot] = scroll;
+      changes |= SCROLL;
+    }
+
+    if (SetChildren(slot, node.children_in_traversal_order, node.child_count)) {
+      changes |= CHILDREN;
+    }
+
+    if (changes != 0) {
+      changes_.push_back({node.id, changes});
+    }
+  }
+
+  // dropped by their parent and not adopted by another one
+  for (const int32_t id : orphans_) {
+    if (id != kRootId && Contains(id) && Parent(id) < 0) {
+      Remove(id);
+    }
+  }
+
+  return changes_;
+}
+
+void SemanticsTree::Clear() {
+  slot_of_.clear();
+  id_.clear();
+  parent_.clear();
+  filled_.clear();
+  flags_.clear();
+  actions_.clear();
+  text_.clear();
+  rect_.clear();
+  transform_.clear();
+  scroll_.clear();
+  children_.clear();
+  children_pool_.clear();
+  children_garbage_ = 0;
+  free_slots_.clear();
+  orphans_.clear();
+  changes_.clear();
+}
+
+int32_t SemanticsTree::Acquire(int32_t id) {
+  if (static_cast<size_t>(id) >= slot_of_.size()) {
+    slot_of_.resize(id + 1, -1);
+  }
+
+  if (slot_of_[id] >= 0) {
+    return slot_of_[id];
+  }
+
+  int32_t slot;
+
+  if (!free_slots_.empty()) {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+  } else {
+    slot = static_cast<int32_t>(id_.size());
+    id_.emplace_back();
+    parent_.emplace_back();
+    filled_.emplace_back();
+    flags_.emplace_back();
+    actions_.emplace_back();
+    text_.emplace_back();
+    rect_.emplace_back();
+    transform_.emplace_back();
+    scroll_.emplace_back();
+    children_.emplace_back();
+  }
+
+  slot_of_[id]     = slot;
+  id_[slot]        = id;
+  parent_[slot]    = -1;
+  filled_[slot]    = false;
+  flags_[slot]     = 0;
+  actions_[slot]   = 0;
+  rect_[slot]      = {};
+  transform_[slot] = {};
+  scroll_[slot]    = {};
+  children_[slot]  = {};
+
+  // a reused slot keeps the capacity of its strings
+  Text &text = text_[slot];
+  text.label.clear();
+  text.value.clear();
+  text.hint.clear();
+  text.tooltip.clear();
+  text.selection_base   = -1;
+  text.selection_extent = -1;
+
+  return slot;
+}
+
+bool SemanticsTree::SetChildren(int32_t slot, const int32_t *children, size_t count) {
+  const int32_t id = id_[slot];
+
+  {
+    const ChildRange &range = children_[slot];
+    const int32_t *old      = children_pool_.data() + range.offset;
+
+    if (count == range.count && std::equal(old, old + count, children)) {
+      return false;
+    }
+
+    // the ones not listed again are orphans, unless another node adopts them
+    for (size_t i = 0; i < range.count; i++) {
+      const int32_t child_slot = Slot(old[i]);
+
+      if (child_slot >= 0 && parent_[child_slot] == id) {
+        parent_[child_slot] = -1;
+        orphans_.push_back(old[i]);
+      }
+    }
+  }
+
+  // may grow the columns, so before taking the range again
+  for (size_t i = 0; i < count; i++) {
+    if (children[i] >= 0) {
+      parent_[Acquire(children[i])] = id;
+    }
+  }
+
+  ChildRange &range = children_[slot];
+
+  if (count > range.capacity) {
+    children_garbage_ += range.capacity;
+    range.offset   = static_cast<uint32_t>(children_pool_.size());
+    range.capacity = static_cast<uint32_t>(count);
+    children_pool_.resize(children_pool_.size() + count);
+  }
+
+  std::copy(children, children + count, children_pool_.begin() + range.offset);
+  range.count = static_cast<uint32_t>(count);
+
+  if (children_garbage_ > 4096 && children_garbage_ > children_pool_.size() / 2) {
+    CompactChildren();
+  }
+
+  return true;
+}
+
+void SemanticsTree::Remove(int32_t id) {
+  const int32_t slot = Slot(id);
+
+  size_t count;
+  const int32_t *children = Children(id, &count);
+
+  for (size_t i = 0; i < count; i++) {
+    if (Contains(children[i]) && Parent(children[i]) == id) {
+      Remove(children[i]);
+    }
+  }
+
+  children_garbage_ += children_[slot].capacity;
+  children_[slot] = {};
+  id_[slot]       = -1;
+  slot_of_[id]    = -1;
+  free_slots_.push_back(slot);
+
+  changes_.push_back({id, REMOVED});
+}
+
+void SemanticsTree::CompactChildren() {
+  std::vector<int32_t> pool;
+  pool.reserve(children_pool_.size() - children_garbage_);
+
+  for (size_t slot = 0; slot < id_.size(); slot++) {
+    if (id_[slot] < 0) {
+      continue;
+    }
+
+    ChildRange &range = children_[slot];
+    const auto begin  = children_pool_.begin() + range.offset;
+
+    pool.insert(pool.end(), begin, begin + range.count);
+    range.offset   = static_cast<uint32_t>(pool.size() - range.count);
+    range.capacity = range.count;
+  }
+
+  children_pool_.swap(pool);
+  children_garbage_ = 0;
+}
+
+static void AppendInt(std::string *out, int64_t value) {
+  char number[24];
+  out->append(number, snprintf(number, sizeof(number), "%" PRId64, value));
+}
+
+static void AppendDouble(std::string *out, double value) {
+  char number[32];
+  out->append(number, snprintf(number, sizeof(number), "%.9g", isfinite(value) ? value : 0.));
+}
+
+SemanticsServer &SemanticsServer::Instance() {
+  static SemanticsServer server;
+  return server;
+}
+
+SemanticsServer::SemanticsServer() : path_(getEnv("FLUTTER_WAYLAND_SEMANTICS_SOCKET", std::string(""))) {
+}
+
+bool SemanticsServer::Start(uv_loop_t *loop) {
+  if (path_.empty() || server_handle_ != nullptr) {
+    return true;
+  }
+
+  // left behind by a previous instance which did not exit cleanly
+  unlink(path_.c_str());
+
+  server_handle_       = new uv_pipe_t;
+  server_handle_->data = this;
+  uv_pipe_init(loop, server_handle_, 0);
+
+  int status = uv_pipe_bind(server_handle_, path_.c_str());
+
+  if (status == 0) {
+    status = uv_listen(reinterpret_cast<uv_stream_t *>(server_handle_), 4, [](uv_stream_t *handle, int status) { static_cast<SemanticsServer *>(handle->data)->OnConnection(status); });
+  }
+
+  if (status != 0) {
+    FL_ERROR("Could not serve semantics on %s: %s", path_.c_str(), uv_strerror(status));
+    Stop();
+    return false;
+  }
+
+  FL_INFO("Serving semantics on %s", path_.c_str());
+
+  return true;
+}
+
+void SemanticsServer::Stop() {
+  if (server_handle_ == nullptr) {
+    return;
+  }
+
+  for (Client *client : std::vector<Client *>(clients_)) {
+    Close(client);
+  }
+
+  uv_close(reinterpret_cast<uv_handle_t *>(server_handle_), [](uv_handle_t *handle) { delete reinterpret_cast<uv_pipe_t *>(handle); });
+  server_handle_ = nullptr;
+
+  unlink(path_.c_str());
+}
+
+void SemanticsServer::Add(Application *application) {
+  engines_.push_back({application, next_engine_number_++});
+
+  if (clients_.empty()) {
+    return;
+  }
+
+  application->setSemanticsEnabled(true);
+
+  out_.clear();
+  AppendEngine(engines_.back(), "started");
+  Broadcast();
+}
+
+void SemanticsServer::Remove(Application *application) {
+  auto engine = std::find_if(engines_.begin(), engines_.end(), [application](const Engine &engine) { return engine.application == application; });
+
+  if (engine == engines_.end()) {
+    return;
+  }
+
+  if (!clients_.empty()) {
+    out_.clear();
+    AppendEngine(*engine, "stopped");
+    Broadcast();
+  }
+
+  engines_.erase(engine);
+}
+
+void SemanticsServer::Publish(Application *application, const std::vector<SemanticsTree::NodeChange> &changes) {
+  if (clients_.empty() || changes.empty()) {
+    return;
+  }
+
+  auto engine = std::find_if(engines_.begin(), engines_.end(), [application](const Engine &engine) { return engine.application == application; });
+
+  if (engine == engines_.end()) {
+    return;
+  }
+
+  const SemanticsTree &tree = *application->semantics();
+  out_.clear();
+
+  for (const auto &change : changes) {
+    if (change.changes & SemanticsTree::REMOVED) {
+      out_.append("{\"engine\":");
+      AppendInt(&out_, engine->number);
+      out_.append(",\"id\":");
+      AppendInt(&out_, change.id);
+      out_.append(",\"removed\":true}\n");
+    } else if (tree.IsFilled(change.id)) {
+      AppendNode(*engine, tree, change.id, change.changes);
+    }
+  }
+
+  Broadcast();
+}
+
+void SemanticsServer::OnConnection(int status) {
+  if (status != 0) {
+    FL_WARN("Semantics connection failed: %s", uv_strerror(status));
+    return;
+  }
+
+  Client *client = new Client;
+  client->server = this;
+  uv_pipe_init(server_handle_->loop, &client->pipe, 0);
+  client->pipe.data = client;
+
+  if (uv_accept(reinterpret_cast<uv_stream_t *>(server_handle_), reinterpret_cast<uv_stream_t *>(&client->pipe)) != 0) {
+    uv_close(reinterpret_cast<uv_handle_t *>(&client->pipe), [](uv_handle_t *handle) { delete static_cast<Client *>(handle->data); });
+    return;
+  }
+
+  uv_read_start(
+      reinterpret_cast<uv_stream_t *>(&client->pipe),
+      [](uv_handle_t *handle, size_t suggested_size, uv_buf_t *buffer) {
+        Client *client = static_cast<Client *>(handle->data);
+        client->input.resize(client->input_size + 4096);
+        *buffer = uv_buf_init(&client->input[client->input_size], 4096);
+      },
+      [](uv_stream_t *stream, ssize_t nread, const uv_buf_t *buffer) {
+        Client *client = static_cast<Client *>(stream->data);
+        client->server->OnRead(client, nread);
+      });
+
+  clients_.push_back(client);
+
+  FL_INFO("Semantics bridge connected");
+
+  // the first bridge turns semantics on, the engines then send their trees
+  if (clients_.size() == 1) {
+    SetEnabled(true);
+  }
+
+  out_.clear();
+
+  for (const auto &engine : engines_) {
+    const SemanticsTree &tree = *engine.application->semantics();
+
+    AppendEngine(engine, "started");
+    tree.ForEach([&](int32_t id) { AppendNode(engine, tree, id, SemanticsTree::ADDED); });
+  }
+
+  Send(client, std::make_shared<const std::string>(out_));
+}
+
+void SemanticsServer::OnRead(Client *client, ssize_t nread) {
+  if (nread < 0) {
+    if (nread != UV_EOF) {
+      FL_WARN("Semantics bridge: %s", uv_strerror(static_cast<int>(nread)));
+    }
+
+    Close(client);
+    return;
+  }
+
+  client->input_size += nread;
+
+  size_t start = 0;
+
+  for (size_t end; (end = client->input.find('\n', start)) != std::string::npos && end < client->input_size; start = end + 1) {
+    const JsonValue request = JsonValue::Parse(reinterpret_cast<const uint8_t *>(client->input.data() + start), end - start);
+    const int64_t number    = request["engine"].AsInt(-1);
+
+    auto engine = std::find_if(engines_.begin(), engines_.end(), [number](const Engine &engine) { return engine.number == number; });
+
+    if (engine == engines_.end() || request["action"].IsNull()) {
+      FL_WARN("Semantics bridge: invalid request %.*s", static_cast<int>(end - start), client->input.data() + start);
+      continue;
+    }
+
+    engine->application->dispatchSemanticsAction(static_cast<int32_t>(request["id"].AsInt()), static_cast<FlutterSemanticsAction>(request["action"].AsInt()));
+  }
+
+  client->input.erase(0, start);
+  client->input_size -= start;
+
+  if (client->input_size > 65536) {
+    FL_WARN("Semantics bridge: request too long");
+    Close(client);
+  }
+}
+
+void SemanticsServer::Close(Client *client) {
+  if (uv_is_closing(reinterpret_cast<uv_handle_t *>(&client->pipe))) {
+    return;
+  }
+
+  uv_read_stop(reinterpret_cast<uv_stream_t *>(&client->pipe));
+  uv_close(reinterpret_cast<uv_handle_t *>(&client->pipe), [](uv_handle_t *handle) { delete static_cast<Client *>(handle->data); });
+
+  clients_.erase(std::find(clients_.begin(), clients_.end(), client));
+
+  FL_INFO("Semantics bridge disconnected");
+
+  if (clients_.empty()) {
+    SetEnabled(false);
+  }
+}
+
+void SemanticsServer::Send(Client *client, std::shared_ptr<const std::string> data) {
+  if (data->empty()) {
+    return;
+  }
+
+  if (client->queued + data->size() > kMaxQueuedBytes) {
+    FL_WARN("Semantics bridge does not keep up, disconnecting it");
+    Close(client);
+    return;
+  }
+
+  Write *write        = new Write{{}, client, std::move(data)};
+  write->request.data = write;
+  client->queued += write->data->size();
+
+  uv_buf_t buffer = uv_buf_init(const_cast<char *>(write->data->data()), write->data->size());
+
+  const int result = uv_write(&write->request, reinterpret_cast<uv_stream_t *>(&client->pipe), &buffer, 1, [](uv_write_t *request, int status) {
+    Write *write = static_cast<Write *>(request->data);
+    write->client->queued -= write->data->size();
+
+    if (status != 0) {
+      write->client->server->Close(write->client);
+    }
+
+    delete write;
+  });
+
+  if (result != 0) {
+    client->queued -= write->data->size();
+    delete write;
+    Close(client);
+  }
+}
+
+void SemanticsServer::Broadcast() {
+  if (out_.empty()) {
+    return;
+  }
+
+  // one copy shared by all bridges, written as is
+  const auto data = std::make_shared<const std::string>(out_);
+
+  for (Client *client : std::vector<Client *>(clients_)) {
+    Send(client, data);
+  }
+}
+
+void SemanticsServer::SetEnabled(bool enabled) {
+  for (const auto &engine : engines_) {
+    engine.application->setSemanticsEnabled(enabled);
+  }
+}
+
+void SemanticsServer::AppendEngine(const Engine &engine, const char *event) {
+  out_.append("{\"engine\":");
+  AppendInt(&out_, engine.number);
+  out_.append(",\"");
+  out_.append(event);
+  out_.append("\":true}\n");
+}
+
+void SemanticsServer::AppendNode(const Engine &engine, const SemanticsTree &tree, int32_t id, uint32_t changes) {
+  const SemanticsTree::Text &text     = tree.TextOf(id);
+  const SemanticsTree::Scroll &scroll = tree.ScrollOf(id);
+  const FlutterRect &rect             = tree.Rect(id);
+  const FlutterTransformation &t      = tree.Transform(id);
+
+  out_.append("{\"engine\":");
+  AppendInt(&out_, engine.number);
+  out_.append(",\"id\":");
+  AppendInt(&out_, id);
+  out_.append(",\"changes\":");
+  AppendInt(&out_, changes);
+  out_.append(",\"node\":{\"parent\":");
+  AppendInt(&out_, tree.Parent(id));
+  out_.append(",\"flags\":");
+  AppendInt(&out_, static_cast<int64_t>(tree.Flags(id)));
+  out_.append(",\"actions\":");
+  AppendInt(&out_, static_cast<int64_t>(tree.Actions(id)));
+  out_.append(",\"label\":");
+  JsonValue::SerializeString(text.label, &out_);
+  out_.append(",\"value\":");
+  JsonValue::SerializeString(text.value, &out_);
+  out_.append(",\"hint\":");
+  JsonValue::SerializeString(text.hint, &out_);
+  out_.append(",\"tooltip\":");
+  JsonValue::SerializeString(text.tooltip, &out_);
+  out_.append(",\"selection\":[");
+  AppendInt(&out_, text.selection_base);
+  out_.push_back(',');
+  AppendInt(&out_, text.selection_extent);
+  out_.append("],\"rect\":[");
+
+  for (const double value : {rect.left, rect.top, rect.right, rect.bottom}) {
+    AppendDouble(&out_, value);
+    out_.push_back(',');
+  }
+
+  out_.back() = ']';
+  out_.append(",\"transform\":[");
+
+  for (const double value : {t.scaleX, t.skewX, t.transX, t.skewY, t.scaleY, t.transY, t.pers0, t.pers1, t.pers2}) {
+    AppendDouble(&out_, value);
+    out_.push_back(',');
+  }
+
+  out_.back() = ']';
+  out_.append(",\"scroll\":[");
+
+  for (const double value : {scroll.position, scroll.extent_min, scroll.extent_max, static_cast<double>(scroll.child_count), static_cast<double>(scroll.index)}) {
+    AppendDouble(&out_, value);
+    out_.push_back(',');
+  }
+
+  out_.back() = ']';
+  out_.append(",\"children\":[");
+
+  size_t count;
+  const int32_t *children = tree.Children(id, &count);
+
+  for (size_t i = 0; i < count; i++) {
+    AppendInt(&out_, children[i]);
+    out_.push_back(',');
+  }
+
+  if (count > 0) {
+    out_.pop_back();
+  }
+
+  out_.append("]}}\n");
+}
+
+} // namespace flutter
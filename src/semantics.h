@@ -0,0 +1,230 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <flutter_embedder.h>
+#include <uv.h>
+
+#include "macros.h"
+
+namespace flutter {
+
+class Application;
+
+// The semantics tree of one engine, kept in columns indexed by slot, with a
+// slot per node id. The engine's updates carry only the nodes which changed;
+// they are compared with the stored ones and written in place, strings and
+// child lists reuse their storage, so an update costs its size and steady
+// scrolling allocates nothing. Nodes dropped from their parent's children
+// and not adopted by another node within the same update are removed with
+// their subtrees.
+class SemanticsTree {
+public:
+  static constexpr int32_t kRootId = 0;
+
+  SemanticsTree() = default;
+
+  enum Change : uint32_t {
+    ADDED    = 1 << 0,
+    REMOVED  = 1 << 1,
+    STATE    = 1 << 2, // flags, actions
+    TEXT     = 1 << 3, // label, value, hint, tooltip, text selection
+    BOUNDS   = 1 << 4, // rect, transform
+    CHILDREN = 1 << 5,
+    SCROLL   = 1 << 6,
+  };
+
+  struct NodeChange {
+    int32_t id;
+    uint32_t changes;
+  };
+
+  struct Text {
+    std::string label;
+    std::string value;
+    std::string hint;
+    std::string tooltip;
+    int32_t selection_base;
+    int32_t selection_extent;
+  };
+
+  struct Scroll {
+    double position;
+    double extent_min;
+    double extent_max;
+    int32_t child_count;
+    int32_t index;
+  };
+
+  // The changes of the update, in its order.
+  const std::vector<NodeChange> &Apply(const FlutterSemanticsUpdate2 *update);
+
+  // Semantics were disabled, the engine sends the whole tree again next time.
+  void Clear();
+
+  size_t size() const { return id_.size() - free_slots_.size(); }
+  bool Contains(int32_t id) const { return Slot(id) >= 0; }
+  // The node itself arrived, not only its id in a parent's children.
+  bool IsFilled(int32_t id) const {
+    const int32_t slot = Slot(id);
+    return slot >= 0 && filled_[slot];
+  }
+
+  // Every filled node, parents before their children.
+  template <typename F> void ForEach(F f) const {
+    if (IsFilled(kRootId)) {
+      Visit(kRootId, f);
+    }
+  }
+
+  // The node must exist.
+  int32_t Parent(int32_t id) const { return parent_[Slot(id)]; }
+  uint64_t Flags(int32_t id) const { return flags_[Slot(id)]; }
+  uint64_t Actions(int32_t id) const { return actions_[Slot(id)]; }
+  const Text &TextOf(int32_t id) const { return text_[Slot(id)]; }
+  const FlutterRect &Rect(int32_t id) const { return rect_[Slot(id)]; }
+  const FlutterTransformation &Transform(int32_t id) const { return transform_[Slot(id)]; }
+  const Scroll &ScrollOf(int32_t id) const { return scroll_[Slot(id)]; }
+
+  // In traversal order.
+  const int32_t *Children(int32_t id, size_t *count) const {
+    const int32_t slot = Slot(id);
+    *count             = children_[slot].count;
+    return children_pool_.data() + children_[slot].offset;
+  }
+
+private:
+  struct ChildRange {
+    uint32_t offset; // into children_pool_
+    uint32_t count;
+    uint32_t capacity;
+  };
+
+  std::vector<int32_t> slot_of_; // by id, -1 for none
+
+  // columns, by slot
+  std::vector<int32_t> id_; // -1 for a free slot
+  std::vector<int32_t> parent_;
+  std::vector<bool> filled_; // the node itself arrived, not only as someone's child
+  std::vector<uint64_t> flags_;
+  std::vector<uint64_t> actions_;
+  std::vector<Text> text_;
+  std::vector<FlutterRect> rect_;
+  std::vector<FlutterTransformation> transform_;
+  std::vector<Scroll> scroll_;
+  std::vector<ChildRange> children_;
+
+  std::vector<int32_t> children_pool_;
+  size_t children_garbage_ = 0; // pool entries no node uses any more
+
+  std::vector<int32_t> free_slots_;
+  std::vector<int32_t> orphans_;
+  std::vector<NodeChange> changes_;
+
+  int32_t Slot(int32_t id) const {
+    return id >= 0 && static_cast<size_t>(id) < slot_of_.size() ? slot_of_[id] : -1;
+  }
+
+  int32_t Acquire(int32_t id);
+  bool SetChildren(int32_t slot, const int32_t *children, size_t count);
+  void Remove(int32_t id);
+  void CompactChildren();
+
+  template <typename F> void Visit(int32_t id, F &f) const {
+    f(id);
+
+    size_t count;
+    const int32_t *children = Children(id, &count);
+
+    for (size_t i = 0; i < count; i++) {
+      if (IsFilled(children[i])) {
+        Visit(children[i], f);
+      }
+    }
+  }
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(SemanticsTree)
+};
+
+// Streams the semantics trees of all engines to accessibility bridges, e.g.
+// one exposing them over AT-SPI on the session bus, connected to a Unix
+// domain socket. Semantics are enabled in the engines only while a bridge is
+// connected, so without one they cost nothing.
+//
+// Every line is one JSON object. A new bridge gets {"engine":n,"started":true}
+// and every node of each running engine first, then the changes as they come:
+//   {"engine":n,"started":true} / {"engine":n,"stopped":true}
+//   {"engine":n,"id":i,"changes":mask,"node":{...}}  mask of SemanticsTree::Change
+//   {"engine":n,"id":i,"removed":true}
+// A bridge performs actions with {"engine":n,"id":i,"action":a}, a being a
+// FlutterSemanticsAction.
+//
+// Configured through the environment:
+//   FLUTTER_WAYLAND_SEMANTICS_SOCKET - path of the socket, semantics stay off when unset
+class SemanticsServer {
+public:
+  static SemanticsServer &Instance();
+
+  bool Start(uv_loop_t *loop);
+  void Stop();
+
+  // A running engine, between its start and stop.
+  void Add(Application *application);
+  void Remove(Application *application);
+
+  // After the application's tree applied an update.
+  void Publish(Application *application, const std::vector<SemanticsTree::NodeChange> &changes);
+
+private:
+  SemanticsServer();
+
+  static constexpr size_t kMaxQueuedBytes = 16 << 20; // a bridge further behind is dropped
+
+  struct Engine {
+    Application *application;
+    int64_t number;
+  };
+
+  struct Client {
+    SemanticsServer *server;
+    uv_pipe_t pipe;
+    std::string input; // an incomplete line, then room for the next read
+    size_t input_size = 0;
+    size_t queued     = 0;
+  };
+
+  struct Write {
+    uv_write_t request;
+    Client *client;
+    std::shared_ptr<const std::string> data;
+  };
+
+  const std::string path_;
+  uv_pipe_t *server_handle_ = nullptr;
+  std::vector<Engine> engines_;
+  int64_t next_engine_number_ = 1;
+  std::vector<Client *> clients_;
+  std::string out_; // reused while serializing
+
+  void OnConnection(int status);
+  void OnRead(Client *client, ssize_t nread);
+  void Close(Client *client);
+  void Send(Client *client, std::shared_ptr<const std::string> data);
+  void Broadcast();
+  void SetEnabled(bool enabled);
+
+  void AppendEngine(const Engine &engine, const char *event);
+  void AppendNode(const Engine &engine, const SemanticsTree &tree, int32_t id, uint32_t changes);
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(SemanticsServer)
+};
+
+} // namespace flutter
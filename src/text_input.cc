@@ -0,0 +1,423 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gdk/gdk.h>
+
+#include "flutter_application.h"
+#include "input_log.h"
+#include "text_input.h"
+#include "trace.h"
+
+namespace flutter {
+
+static constexpr char16_t kReplacementCharacter = 0xfffd;
+
+static void AppendUtf16(uint32_t code, std::u16string *out) {
+  if (code < 0x10000) {
+    out->push_back(static_cast<char16_t>(code));
+  } else {
+    code -= 0x10000;
+    out->push_back(static_cast<char16_t>(0xd800 + (code >> 10)));
+    out->push_back(static_cast<char16_t>(0xdc00 + (code & 0x3ff)));
+  }
+}
+
+// Malformed sequences become U+FFFD.
+static std::u16string Utf8ToUtf16(const std::string &text) {
+  std::u16string out;
+  out.reserve(text.size());
+
+  for (size_t i = 0; i < text.size();) {
+    const uint8_t lead  = text[i];
+    const size_t length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xe ? 3 : (lead >> 3) == 0x1e ? 4 : 0;
+
+    if (length == 0 || i + length > text.size()) {
+      out.push_back(kReplacementCharacter);
+      i++;
+      continue;
+    }
+
+    uint32_t code = length == 1 ? lead : lead & (0x7f >> length);
+    bool valid    = true;
+
+    for (size_t j = 1; j < length; j++) {
+      const uint8_t continuation = text[i + j];
+      valid                      = valid && (continuation & 0xc0) == 0x80;
+      code                       = (code << 6) | (continuation & 0x3f);
+    }
+
+    if (!valid || code > 0x10ffff || (code >= 0xd800 && code < 0xe000)) {
+      out.push_back(kReplacementCharacter);
+      i++;
+      continue;
+    }
+
+    AppendUtf16(code, &out);
+    i += length;
+  }
+
+  return out;
+}
+
+// Unpaired surrogates become U+FFFD.
+static std::string Utf16ToUtf8(const std::u16string &text, size_t start = 0, size_t end = std::u16string::npos) {
+  std::string out;
+  end = std::min(end, text.size());
+  out.reserve(end - std::min(start, end));
+
+  for (size_t i = start; i < end; i++) {
+    uint32_t code = text[i];
+
+    if (code >= 0xd800 && code < 0xdc00 && i + 1 < end && text[i + 1] >= 0xdc00 && text[i + 1] < 0xe000) {
+      code = 0x10000 + ((code - 0xd800) << 10) + (text[++i] - 0xdc00);
+    } else if (code >= 0xd800 && code < 0xe000) {
+      code = kReplacementCharacter;
+    }
+
+    if (code < 0x80) {
+      out.push_back(static_cast<char>(code));
+    } else if (code < 0x800) {
+      out.push_back(static_cast<char>(0xc0 | (code >> 6)));
+      out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+    } else if (code < 0x10000) {
+      out.push_back(static_cast<char>(0xe0 | (code >> 12)));
+      out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+      out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+    } else {
+      out.push_back(static_cast<char>(0xf0 | (code >> 18)));
+      out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3f)));
+      out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+      out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+    }
+  }
+
+  return out;
+}
+
+static TextInputModel::Range Clamp(TextInputModel::Range range, size_t size) {
+  if (!range.IsValid()) {
+    return {};
+  }
+
+  const int64_t limit = static_cast<int64_t>(size);
+  return {std::min(range.base, limit), std::min(range.extent, limit)};
+}
+
+void TextInputModel::SetState(std::u16string text, Range selection, Range composing) {
+  text_      = std::move(text);
+  selection_ = selection.IsValid() ? Clamp(selection, text_.size()) : Range{0, 0};
+  composing_ = Clamp(composing, text_.size());
+
+  if (composing_.IsValid() && composing_.base == composing_.extent) {
+    composing_ = {};
+  }
+}
+
+TextInputModel::Delta TextInputModel::Replace(size_t start, size_t end, const std::u16string &text) {
+  Delta delta = {start, end, text};
+  text_.replace(start, end - start, text);
+  return delta;
+}
+
+TextInputModel::Delta TextInputModel::Commit(const std::u16string &text) {
+  const Range &range = composing_.IsValid() ? composing_ : selection_;
+  const size_t start = range.start();
+
+  Delta delta       = Replace(start, range.end(), text);
+  const int64_t end = static_cast<int64_t>(start + text.size());
+  selection_        = {end, end};
+  composing_        = {};
+
+  return delta;
+}
+
+TextInputModel::Delta TextInputModel::Compose(const std::u16string &text, int64_t cursor_begin, int64_t cursor_end) {
+  const Range &range   = composing_.IsValid() ? composing_ : selection_;
+  const int64_t start  = static_cast<int64_t>(range.start());
+  const int64_t length = static_cast<int64_t>(text.size());
+  Delta delta          = Replace(range.start(), range.end(), text);
+
+  if (text.empty()) {
+    selection_ = {start, start};
+    composing_ = {};
+    return delta;
+  }
+
+  composing_ = {start, start + length};
+
+  if (cursor_begin < 0) {
+    selection_ = {start + length, start + length};
+  } else {
+    cursor_begin = std::min(cursor_begin, length);
+    cursor_end   = cursor_end < 0 ? cursor_begin : std::min(cursor_end, length);
+    selection_   = {start + cursor_begin, start + cursor_end};
+  }
+
+  return delta;
+}
+
+TextInputModel::Delta TextInputModel::DeleteSurrounding(size_t before, size_t after) {
+  const size_t cursor = static_cast<size_t>(selection_.extent);
+  const size_t start  = cursor - std::min(before, cursor);
+  const size_t end    = std::min(text_.size(), cursor + after);
+
+  Delta delta = Replace(start, end, std::u16string());
+  selection_  = {static_cast<int64_t>(start), static_cast<int64_t>(start)};
+  composing_  = {};
+
+  return delta;
+}
+
+TextInputPlugin::TextInputPlugin(Application *application, RenderDisplay *display) : application_(application), display_(display) {
+}
+
+bool TextInputPlugin::IsActive() const {
+  return client_ >= 0 && shown_;
+}
+
+// selection and composing region, as both the editing state and a delta have them
+static void SetRanges(JsonValue *json, const TextInputModel &model) {
+  json->Set("selectionBase", model.selection().base)
+      .Set("selectionExtent", model.selection().extent)
+      .Set("selectionAffinity", "TextAffinity.downstream")
+      .Set("selectionIsDirectional", false)
+      .Set("composingBase", model.composing().base)
+      .Set("composingExtent", model.composing().extent);
+}
+
+void TextInputPlugin::HandleMessage(const FlutterPlatformMessage *message) {
+  FLWAY_TRACE_SCOPE("TextInputPlugin.HandleMessage");
+
+  const JsonValue call    = JsonValue::Parse(message->message, message->message_size);
+  const std::string &name = call["method"].AsString();
+  const JsonValue &args   = call["args"];
+  bool handled            = true;
+  bool changed            = true; // what the input method sees
+
+  if (name == "TextInput.setClient") {
+    const JsonValue &config = args[1];
+
+    client_       = args[0].AsInt(-1);
+    input_type_   = config["inputType"]["name"].AsString();
+    input_action_ = config["inputAction"].AsString();
+    obscure_text_ = config["obscureText"].AsBool();
+    autocorrect_  = config["autocorrect"].AsBool(true);
+    delta_model_  = config["enableDeltaModel"].AsBool();
+    model_.SetState(std::u16string(), {0, 0}, {});
+  } else if (name == "TextInput.clearClient") {
+    client_ = -1;
+    shown_  = false;
+  } else if (name == "TextInput.setEditingState") {
+    model_.SetState(Utf8ToUtf16(args["text"].AsString()), {args["selectionBase"].AsInt(-1), args["selectionExtent"].AsInt(-1)}, {args["composingBase"].AsInt(-1), args["composingExtent"].AsInt(-1)});
+  } else if (name == "TextInput.show") {
+    shown_ = true;
+  } else if (name == "TextInput.hide") {
+    shown_ = false;
+  } else if (name == "TextInput.setEditableSizeAndTransform") {
+    const JsonValue &transform = args["transform"];
+
+    for (size_t i = 0; i < transform.size() && i < std::size(transform_); i++) {
+      transform_[i] = transform[i].AsNumber();
+    }
+  } else if (name == "TextInput.setCaretRect" || name == "TextInput.setMarkedTextRect") {
+    caret_[0] = args["x"].AsNumber();
+    caret_[1] = args["y"].AsNumber();
+    caret_[2] = args["width"].AsNumber();
+    caret_[3] = args["height"].AsNumber();
+  } else if (name == "TextInput.setStyle" || name == "TextInput.requestAutofill" || name == "TextInput.finishAutofillContext") {
+    changed = false;
+  } else {
+    handled = false;
+    changed = false;
+  }
+
+  // JSONMethodCodec: [result] on success, nothing for an unknown method
+  static const char kSuccess[] = "[null]";
+  application_->respondPlatformMessage(message->response_handle, reinterpret_cast<const uint8_t *>(kSuccess), handled ? strlen(kSuccess) : 0);
+
+  if (changed) {
+    display_->onTextInputChanged(this);
+  }
+}
+
+bool TextInputPlugin::KeyPress(xkb_keysym_t keysym, uint32_t utf32, uint32_t gdk_state) {
+  if (client_ < 0) {
+    return false;
+  }
+
+  JsonValue deltas = JsonValue::Array();
+
+  if (keysym == GDK_KEY_Return || keysym == GDK_KEY_KP_Enter) {
+    if (input_type_ == "TextInputType.multiline") {
+      Apply(&deltas, [&] { return model_.Commit(u"\n"); });
+      SendEdits(std::move(deltas));
+    }
+
+    SendAction();
+  } else if (utf32 >= 0x20 && utf32 != 0x7f && utf32 <= 0x10ffff && (gdk_state & (GDK_CONTROL_MASK | GDK_MOD1_MASK)) == 0) {
+    std::u16string text;
+    AppendUtf16(utf32, &text);
+
+    Apply(&deltas, [&] { return model_.Commit(text); });
+    SendEdits(std::move(deltas));
+  } else {
+    // editing and navigation keys are the framework's shortcuts
+    return false;
+  }
+
+  display_->onTextInputChanged(this);
+
+  return true;
+}
+
+void TextInputPlugin::ApplyInputMethodEdit(const InputMethodEdit &edit) {
+  if (InputRecorder::Instance().IsRecording()) {
+    InputRecorder::Instance().InputMethodEdit(edit);
+  }
+
+  if (client_ < 0) {
+    return;
+  }
+
+  const std::u16string preedit = Utf8ToUtf16(edit.preedit);
+  const int64_t cursor_begin   = edit.preedit_cursor_begin < 0 ? -1 : static_cast<int64_t>(Utf8ToUtf16(edit.preedit.substr(0, edit.preedit_cursor_begin)).size());
+  const int64_t cursor_end     = edit.preedit_cursor_end < 0 ? -1 : static_cast<int64_t>(Utf8ToUtf16(edit.preedit.substr(0, edit.preedit_cursor_end)).size());
+  JsonValue deltas             = JsonValue::Array();
+
+  if (edit.delete_before == 0 && edit.delete_after == 0 && (edit.commit.empty() || edit.preedit.empty())) {
+    // the usual transactions, a preedit replacing the previous one or its
+    // commit, are a single replacement of the composing region
+    if (!edit.commit.empty()) {
+      Apply(&deltas, [&] { return model_.Commit(Utf8ToUtf16(edit.commit)); });
+    } else if (!preedit.empty() || model_.composing().IsValid()) {
+      Apply(&deltas, [&] { return model_.Compose(preedit, cursor_begin, cursor_end); });
+    }
+  } else {
+    if (model_.composing().IsValid()) {
+      Apply(&deltas, [&] { return model_.Compose(std::u16string(), -1, -1); });
+    }
+
+    if (edit.delete_before > 0 || edit.delete_after > 0) {
+      // byte counts of UTF-8 around the cursor, in UTF-16 units
+      const size_t cursor      = static_cast<size_t>(model_.selection().extent);
+      const std::string before = Utf16ToUtf8(model_.text(), 0, cursor);
+      const std::string after  = Utf16ToUtf8(model_.text(), cursor);
+      const size_t before_size = Utf8ToUtf16(before.substr(before.size() - std::min<size_t>(edit.delete_before, before.size()))).size();
+      const size_t after_size  = Utf8ToUtf16(after.substr(0, edit.delete_after)).size();
+
+      Apply(&deltas, [&] { return model_.DeleteSurrounding(before_size, after_size); });
+    }
+
+    if (!edit.commit.empty()) {
+      Apply(&deltas, [&] { return model_.Commit(Utf8ToUtf16(edit.commit)); });
+    }
+
+    if (!preedit.empty()) {
+      Apply(&deltas, [&] { return model_.Compose(preedit, cursor_begin, cursor_end); });
+    }
+  }
+
+  SendEdits(std::move(deltas));
+}
+
+void TextInputPlugin::SurroundingText(size_t max_bytes, std::string *text, uint32_t *cursor, uint32_t *anchor) const {
+  // without the preedit, the input method knows it
+  std::u16string surrounding      = model_.text();
+  TextInputModel::Range selection = model_.selection();
+
+  if (model_.composing().IsValid()) {
+    const size_t start = model_.composing().start();
+    surrounding.erase(start, model_.composing().end() - start);
+    selection = {static_cast<int64_t>(start), static_cast<int64_t>(start)};
+  }
+
+  *text                  = Utf16ToUtf8(surrounding);
+  const size_t cursor_at = Utf16ToUtf8(surrounding, 0, selection.extent).size();
+  const size_t anchor_at = Utf16ToUtf8(surrounding, 0, selection.base).size();
+
+  size_t start = 0;
+
+  // a window around the cursor, cut at character boundaries
+  if (text->size() > max_bytes) {
+    start      = cursor_at - std::min(cursor_at, max_bytes / 2);
+    size_t end = std::min(text->size(), start + max_bytes);
+
+    while (start < text->size() && ((*text)[start] & 0xc0) == 0x80) {
+      start++;
+    }
+
+    while (end > start && end < text->size() && ((*text)[end] & 0xc0) == 0x80) {
+      end--;
+    }
+
+    *text = text->substr(start, end - start);
+  }
+
+  *cursor = static_cast<uint32_t>(std::min(text->size(), cursor_at - std::min(cursor_at, start)));
+  *anchor = static_cast<uint32_t>(std::min(text->size(), anchor_at - std::min(anchor_at, start)));
+}
+
+void TextInputPlugin::CursorRectangle(int32_t *x, int32_t *y, int32_t *width, int32_t *height) const {
+  *x      = static_cast<int32_t>(transform_[0] * caret_[0] + transform_[4] * caret_[1] + transform_[12]);
+  *y      = static_cast<int32_t>(transform_[1] * caret_[0] + transform_[5] * caret_[1] + transform_[13]);
+  *width  = static_cast<int32_t>(transform_[0] * caret_[2]);
+  *height = static_cast<int32_t>(transform_[5] * caret_[3]);
+}
+
+template <typename Edit> void TextInputPlugin::Apply(JsonValue *deltas, Edit edit) {
+  if (!delta_model_) {
+    edit();
+    return;
+  }
+
+  std::string old_text              = Utf16ToUtf8(model_.text());
+  const TextInputModel::Delta delta = edit();
+
+  JsonValue json = JsonValue::Object();
+  json.Set("oldText", std::move(old_text))
+      .Set("deltaText", Utf16ToUtf8(delta.text))
+      .Set("deltaStart", static_cast<int64_t>(delta.start))
+      .Set("deltaEnd", static_cast<int64_t>(delta.end));
+  SetRanges(&json, model_);
+
+  deltas->Append(std::move(json));
+}
+
+void TextInputPlugin::SendEdits(JsonValue deltas) {
+  if (!delta_model_) {
+    SendEditingState();
+    return;
+  }
+
+  if (deltas.size() == 0) {
+    return;
+  }
+
+  JsonValue state = JsonValue::Object();
+  state.Set("deltas", std::move(deltas));
+
+  Send("TextInputClient.updateEditingStateWithDeltas", JsonValue::Array().Append(client_).Append(std::move(state)));
+}
+
+void TextInputPlugin::SendEditingState() {
+  JsonValue state = JsonValue::Object();
+  state.Set("text", Utf16ToUtf8(model_.text()));
+  SetRanges(&state, model_);
+
+  Send("TextInputClient.updateEditingState", JsonValue::Array().Append(client_).Append(std::move(state)));
+}
+
+void TextInputPlugin::SendAction() {
+  Send("TextInputClient.performAction", JsonValue::Array().Append(client_).Append(input_action_));
+}
+
+void TextInputPlugin::Send(const char *method, JsonValue args) {
+  const std::string message = JsonValue::Object().Set("method", method).Set("args", std::move(args)).Serialize();
+
+  if (!application_->sendPlatformMessage(kChannel, reinterpret_cast<const uint8_t *>(message.data()), message.size())) {
+    FL_ERROR("Error sending PlatformMessage: %s", method);
+  }
+}
+
+} // namespace flutter
@@ -0,0 +1,139 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <string>
+
+#include <flutter_embedder.h>
+#include <xkbcommon/xkbcommon.h>
+
+#include "macros.h"
+#include "json.h"
+
+namespace flutter {
+
+class Application;
+class RenderDisplay;
+
+// Text, selection and composing region of the focused text field, indices in
+// UTF-16 code units as the framework counts them. Every edit reports the range
+// of the old text it replaced, which is what a TextEditingDelta carries.
+class TextInputModel {
+public:
+  struct Range {
+    int64_t base   = -1;
+    int64_t extent = -1;
+
+    bool IsValid() const { return base >= 0 && extent >= 0; }
+    size_t start() const { return static_cast<size_t>(std::min(base, extent)); }
+    size_t end() const { return static_cast<size_t>(std::max(base, extent)); }
+  };
+
+  struct Delta {
+    size_t start = 0; // replaced range of the old text
+    size_t end   = 0;
+    std::u16string text;
+  };
+
+  void SetState(std::u16string text, Range selection, Range composing);
+
+  // Replaces the composing region, or the selection without one, with
+  // committed text; the cursor goes behind it.
+  Delta Commit(const std::u16string &text);
+
+  // Replaces the composing region, or the selection without one, with
+  // composing text. cursor_begin/cursor_end are relative to the composing
+  // text, -1 puts the cursor behind it. Empty text ends composing.
+  Delta Compose(const std::u16string &text, int64_t cursor_begin, int64_t cursor_end);
+
+  // Deletes around the cursor.
+  Delta DeleteSurrounding(size_t before, size_t after);
+
+  const std::u16string &text() const { return text_; }
+  const Range &selection() const { return selection_; }
+  const Range &composing() const { return composing_; }
+
+private:
+  std::u16string text_;
+  Range selection_ = {0, 0};
+  Range composing_;
+
+  Delta Replace(size_t start, size_t end, const std::u16string &text);
+};
+
+// flutter/textinput: keeps the model of the focused field, inserts the
+// characters of key presses the framework leaves to the platform and applies
+// input method edits. With the client's enableDeltaModel set, edits go out as
+// TextInputClient.updateEditingStateWithDeltas, otherwise as full states.
+// The display is told whenever the input method should see a new state.
+class TextInputPlugin {
+public:
+  static constexpr const char *kChannel = "flutter/textinput";
+
+  TextInputPlugin(Application *application, RenderDisplay *display);
+
+  void HandleMessage(const FlutterPlatformMessage *message);
+
+  // Whether a text field has the focus and wants a keyboard.
+  bool IsActive() const;
+
+  // Key presses and repeats; true when the key went into the text.
+  bool KeyPress(xkb_keysym_t keysym, uint32_t utf32, uint32_t gdk_state);
+
+  // One input method transaction, applied in the order zwp_text_input_v3
+  // defines. All texts are UTF-8, offsets and lengths in bytes; a negative
+  // preedit_cursor_begin hides the cursor.
+  struct InputMethodEdit {
+    std::string preedit;
+    int32_t preedit_cursor_begin = -1;
+    int32_t preedit_cursor_end   = -1;
+    std::string commit;
+    uint32_t delete_before = 0;
+    uint32_t delete_after  = 0;
+  };
+
+  void ApplyInputMethodEdit(const InputMethodEdit &edit);
+
+  // The text around the cursor for the input method, at most max_bytes of
+  // UTF-8 with cursor and anchor as byte offsets into it.
+  void SurroundingText(size_t max_bytes, std::string *text, uint32_t *cursor, uint32_t *anchor) const;
+
+  // In logical coordinates of the view, from the framework's caret rectangle.
+  void CursorRectangle(int32_t *x, int32_t *y, int32_t *width, int32_t *height) const;
+
+  const std::string &InputType() const { return input_type_; }
+  bool ObscureText() const { return obscure_text_; }
+  bool Autocorrect() const { return autocorrect_; }
+
+private:
+  Application *const application_;
+  RenderDisplay *const display_;
+
+  int64_t client_ = -1;
+  bool shown_     = false;
+  std::string input_type_;
+  std::string input_action_;
+  bool obscure_text_ = false;
+  bool autocorrect_  = true;
+  bool delta_model_  = false;
+  TextInputModel model_;
+
+  double transform_[16] = {1., 0., 0., 0., 0., 1., 0., 0., 0., 0., 1., 0., 0., 0., 0., 1.}; // column-major
+  double caret_[4]      = {};                                                             // x, y, width, height
+
+  // Runs an edit of the model, collecting its delta when the client wants them.
+  template <typename Edit> void Apply(JsonValue *deltas, Edit edit);
+  void SendEdits(JsonValue deltas);
+  void SendEditingState();
+  void SendAction();
+  void Send(const char *method, JsonValue args);
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(TextInputPlugin)
+};
+
+} // namespace flutter
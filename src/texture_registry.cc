@@ -0,0 +1,702 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "egl_utils.h"
+#include "texture_registry.h"
+#include "trace.h"
+
+#ifndef DRM_FORMAT_MOD_INVALID
+#define DRM_FORMAT_MOD_INVALID 0x00ffffffffffffffULL
+#endif
+
+namespace flutter {
+
+TextureRegistry::~TextureRegistry() {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  for (auto &it : textures_) {
+    ReleaseFrame(it.second->pending.get());
+    ReleaseFrame(it.second->current.get());
+  }
+
+  for (auto &texture : graveyard_) {
+    ReleaseFrame(texture->current.get());
+  }
+
+  for (auto &retired : retired_frames_) {
+    ReleaseFrame(retired.frame.get());
+  }
+}
+
+void TextureRegistry::Attach(Application *application, EGLDisplay display, UploadContextPool *upload_pool) {
+  egl_display_ = display;
+  upload_pool_ = upload_pool && upload_pool->IsRunning() ? upload_pool : nullptr;
+
+  const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+
+  if (extensions && strstr(extensions, "EGL_EXT_image_dma_buf_import")) {
+    egl_create_image_            = reinterpret_cast<PFNEGLCREATEIMAGEKHRPROC>(eglGetProcAddress("eglCreateImageKHR"));
+    egl_destroy_image_           = reinterpret_cast<PFNEGLDESTROYIMAGEKHRPROC>(eglGetProcAddress("eglDestroyImageKHR"));
+    gl_egl_image_target_texture_ = reinterpret_cast<PFNGLEGLIMAGETARGETTEXTURE2DOESPROC>(eglGetProcAddress("glEGLImageTargetTexture2DOES"));
+    dmabuf_supported_            = egl_create_image_ && egl_destroy_image_ && gl_egl_image_target_texture_;
+  }
+
+  FL_INFO("External textures: dmabuf import %s", dmabuf_supported_ ? "available" : "not available, CPU uploads only");
+
+  if (extensions && strstr(extensions, "EGL_KHR_fence_sync")) {
+    egl_create_sync_      = reinterpret_cast<PFNEGLCREATESYNCKHRPROC>(eglGetProcAddress("eglCreateSyncKHR"));
+    egl_destroy_sync_     = reinterpret_cast<PFNEGLDESTROYSYNCKHRPROC>(eglGetProcAddress("eglDestroySyncKHR"));
+    egl_client_wait_sync_ = reinterpret_cast<PFNEGLCLIENTWAITSYNCKHRPROC>(eglGetProcAddress("eglClientWaitSyncKHR"));
+  }
+
+  if (extensions && strstr(extensions, "EGL_KHR_wait_sync")) {
+    egl_wait_sync_ = reinterpret_cast<PFNEGLWAITSYNCKHRPROC>(eglGetProcAddress("eglWaitSyncKHR"));
+  }
+
+  // after an engine restart the textures (and their GL names) carry over to
+  // the new engine, with the frames pushed while there was none
+  std::lock_guard<std::mutex> lock(mutex_);
+  application_ = application;
+
+  for (auto &it : textures_) {
+    Texture *texture              = it.second.get();
+    texture->frame_available_sent = false;
+
+    if (!application_->registerExternalTexture(it.first)) {
+      FL_ERROR("Could not register external texture: %jd", it.first);
+      continue;
+    }
+
+    if (texture->pending || texture->ready.name != 0) {
+      texture->frame_available_sent = true;
+      application_->markExternalTextureFrameAvailable(it.first);
+    }
+  }
+}
+
+void TextureRegistry::Detach() {
+  // producers and upload workers notify under the lock, none is left in the old application
+  std::lock_guard<std::mutex> lock(mutex_);
+  application_ = nullptr;
+}
+
+bool TextureRegistry::SupportsDmabuf() const {
+  return dmabuf_supported_;
+}
+
+int64_t TextureRegistry::RegisterTexture() {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (application_ == nullptr) {
+    FL_ERROR("External texture registered while no engine is running");
+    return -1;
+  }
+
+  const int64_t texture_id = next_texture_id_++;
+
+  if (!application_->registerExternalTexture(texture_id)) {
+    FL_ERROR("Could not register external texture: %jd", texture_id);
+    return -1;
+  }
+
+  auto texture = std::make_unique<Texture>();
+  texture->id  = texture_id;
+  textures_.emplace(texture_id, std::move(texture));
+
+  return texture_id;
+}
+
+void TextureRegistry::UnregisterTexture(int64_t texture_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  // the engine restarting registers the remaining textures again
+  if (application_) {
+    application_->unregisterExternalTexture(texture_id);
+  }
+
+  auto it = textures_.find(texture_id);
+
+  if (it == textures_.end()) {
+    return;
+  }
+
+  Texture *texture = it->second.get();
+
+  FL_INFO("External texture %jd: frames: %ju dropped: %ju uploads: %ju avg upload: %ju us", texture_id, texture->frames, texture->dropped, texture->uploads, texture->uploads ? texture->upload_ns / texture->uploads / 1000 : 0);
+
+  ReleaseFrame(texture->pending.get());
+  texture->pending.reset();
+
+  // an upload in flight sees the texture gone and deletes what it uploaded
+  graveyard_.push_back(std::move(it->second));
+  textures_.erase(it);
+  has_garbage_ = true;
+}
+
+bool TextureRegistry::PushFrame(int64_t texture_id, PixelFrame frame) {
+  auto f    = std::make_unique<Frame>();
+  f->dmabuf = false;
+  f->pixels = std::move(frame);
+
+  return PushFrame(texture_id, std::move(f));
+}
+
+bool TextureRegistry::PushFrame(int64_t texture_id, DmabufFrame frame) {
+  if (!dmabuf_supported_) {
+    return false;
+  }
+
+  auto f    = std::make_unique<Frame>();
+  f->dmabuf = true;
+  f->buffer = std::move(frame);
+
+  return PushFrame(texture_id, std::move(f));
+}
+
+bool TextureRegistry::PushFrame(int64_t texture_id, std::unique_ptr<Frame> frame) {
+  std::unique_ptr<Frame> replaced;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = textures_.find(texture_id);
+
+    if (it == textures_.end()) {
+      return false;
+    }
+
+    Texture *texture = it->second.get();
+
+    replaced         = std::move(texture->pending);
+    texture->pending = std::move(frame);
+    texture->frames++;
+
+    if (replaced) {
+      texture->dropped++;
+    }
+
+    if (upload_pool_ && !texture->pending->dmabuf) {
+      // announced once uploaded, an upload already scheduled takes the newest frame
+      if (!texture->upload_scheduled) {
+        texture->upload_scheduled = true;
+        upload_pool_->Post(texture_id, [this, texture_id]() { UploadAsync(texture_id); });
+      }
+    } else if (application_ && !texture->frame_available_sent) {
+      // coalesce: one notification until the engine has picked the frame up
+      texture->frame_available_sent = true;
+      application_->markExternalTextureFrameAvailable(texture_id);
+    }
+  }
+
+  ReleaseFrame(replaced.get());
+
+  return true;
+}
+
+bool TextureRegistry::PopulateTexture(int64_t texture_id, size_t width, size_t height, FlutterOpenGLTexture *texture_out) {
+  Texture *texture = nullptr;
+  std::unique_ptr<Frame> frame;
+  Upload ready;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = textures_.find(texture_id);
+
+    if (it == textures_.end()) {
+      return false;
+    }
+
+    texture                       = it->second.get();
+    texture->frame_available_sent = false;
+
+    if (texture->ready.name != 0) {
+      ready          = texture->ready;
+      texture->ready = {};
+    } else if (!texture->upload_scheduled) {
+      frame = std::move(texture->pending);
+    }
+  }
+
+  if (ready.name != 0) {
+    WaitUpload(&ready);
+
+    if (texture->name != 0 && texture->image == EGL_NO_IMAGE_KHR && egl_create_sync_) {
+      // a spare once the draws of the frame being built are fenced
+      texture->retired.push_back({texture->name, texture->width, texture->height, EGL_NO_SYNC_KHR});
+      texture->name = 0;
+      has_retired_  = true;
+    } else {
+      DestroyTexture(texture);
+    }
+
+    RetireFrame(std::move(texture->current));
+
+    texture->name   = ready.name;
+    texture->width  = ready.width;
+    texture->height = ready.height;
+  }
+
+  if (frame) {
+    const uint64_t start_ns = FlutterEngineGetCurrentTime();
+    const bool uploaded     = frame->dmabuf ? ImportDmabuf(texture, frame->buffer) : UploadPixels(texture, frame->pixels);
+
+    if (uploaded) {
+      texture->uploads++;
+      texture->upload_ns += FlutterEngineGetCurrentTime() - start_ns;
+    }
+
+    if (uploaded) {
+      // the previous frame's draws may still sample a dmabuf shown until now
+      RetireFrame(std::move(texture->current));
+    }
+
+    if (frame->dmabuf && uploaded) {
+      // the EGLImage keeps sampling the producer's buffer until the next frame replaces it
+      texture->current = std::move(frame);
+    } else {
+      ReleaseFrame(frame.get());
+    }
+  }
+
+  if (texture->name == 0) {
+    return false;
+  }
+
+  texture_out->target               = GL_TEXTURE_2D;
+  texture_out->name                 = texture->name;
+  texture_out->format               = GL_RGBA8;
+  texture_out->user_data            = nullptr;
+  texture_out->destruction_callback = [](void *) {}; // owned by the registry, reused across frames
+  texture_out->width                = texture->width;
+  texture_out->height               = texture->height;
+
+  return true;
+}
+
+bool TextureRegistry::UploadPixels(Texture *texture, const PixelFrame &frame) {
+  if (pbo_supported_ < 0) {
+    // GLES3 is needed for mapping GL_PIXEL_UNPACK_BUFFER
+    const char *version = reinterpret_cast<const char *>(glGetString(GL_VERSION));
+    int major           = 0;
+
+    pbo_supported_ = version && sscanf(version, "OpenGL ES %d", &major) == 1 && major >= 3;
+
+    FL_INFO("External textures: CPU uploads via %s", pbo_supported_ ? "pixel buffer object ring" : "glTexSubImage2D");
+  }
+
+  const bool resize = texture->name == 0 || texture->image != EGL_NO_IMAGE_KHR || texture->width != frame.width || texture->height != frame.height;
+
+  if (resize) {
+    DestroyTexture(texture);
+
+    glGenTextures(1, &texture->name);
+    glBindTexture(GL_TEXTURE_2D, texture->name);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, frame.width, frame.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+    texture->width  = frame.width;
+    texture->height = frame.height;
+  } else {
+    glBindTexture(GL_TEXTURE_2D, texture->name);
+  }
+
+  const size_t row_size = frame.width * 4;
+
+  if (!pbo_supported_) {
+    if (frame.stride == row_size) {
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame.width, frame.height, GL_RGBA, GL_UNSIGNED_BYTE, frame.pixels);
+    } else {
+      for (uint32_t y = 0; y < frame.height; y++) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, frame.width, 1, GL_RGBA, GL_UNSIGNED_BYTE, frame.pixels + y * frame.stride);
+      }
+    }
+
+    return true;
+  }
+
+  const size_t size = row_size * frame.height;
+
+  if (texture->pbos[0] == 0 || texture->pbo_size != size) {
+    if (texture->pbos[0] == 0) {
+      glGenBuffers(kPixelBufferRingSize, texture->pbos);
+    }
+
+    for (size_t i = 0; i < kPixelBufferRingSize; i++) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, texture->pbos[i]);
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    }
+
+    texture->pbo_size = size;
+  }
+
+  // Cycling through the ring lets the driver finish the transfer from the previous
+  // buffers while we fill the next one.
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, texture->pbos[texture->next_pbo]);
+  texture->next_pbo = (texture->next_pbo + 1) % kPixelBufferRingSize;
+
+  auto *mapped = static_cast<uint8_t *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+
+  if (mapped == nullptr) {
+    FL_ERROR("External texture %jd: could not map pixel buffer", texture->id);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return false;
+  }
+
+  if (frame.stride == row_size) {
+    memcpy(mapped, frame.pixels, size);
+  } else {
+    for (uint32_t y = 0; y < frame.height; y++) {
+      memcpy(mapped + y * row_size, frame.pixels + y * frame.stride, row_size);
+    }
+  }
+
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame.width, frame.height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  return true;
+}
+
+// Upload pool worker, its shared context is current.
+void TextureRegistry::UploadAsync(int64_t texture_id) {
+  FLWAY_TRACE_SCOPE("TextureRegistry.UploadAsync");
+  std::unique_ptr<Frame> frame;
+  Upload upload;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = textures_.find(texture_id);
+
+    if (it == textures_.end()) {
+      return;
+    }
+
+    Texture *texture          = it->second.get();
+    texture->upload_scheduled = false;
+    frame                     = std::move(texture->pending);
+
+    if (!frame || frame->dmabuf) {
+      // a dmabuf frame replaced the pixels, the raster thread imports it
+      texture->pending = std::move(frame);
+      return;
+    }
+
+    if (!texture->spares.empty()) {
+      upload = texture->spares.back();
+      texture->spares.pop_back();
+    }
+  }
+
+  const PixelFrame &pixels = frame->pixels;
+  const uint64_t start_ns  = FlutterEngineGetCurrentTime();
+
+  // the raster thread's last draws sampling the spare come first
+  WaitUpload(&upload);
+
+  if (upload.name == 0 || upload.width != pixels.width || upload.height != pixels.height) {
+    DestroyUpload(&upload);
+
+    glGenTextures(1, &upload.name);
+    glBindTexture(GL_TEXTURE_2D, upload.name);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, pixels.width, pixels.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+    upload.width  = pixels.width;
+    upload.height = pixels.height;
+  } else {
+    glBindTexture(GL_TEXTURE_2D, upload.name);
+  }
+
+  if (pixels.stride == pixels.width * 4) {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, pixels.width, pixels.height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.pixels);
+  } else {
+    for (uint32_t y = 0; y < pixels.height; y++) {
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, pixels.width, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels.pixels + y * pixels.stride);
+    }
+  }
+
+  // the pixels have been copied by the GL
+  ReleaseFrame(frame.get());
+
+  if (egl_create_sync_) {
+    upload.fence = egl_create_sync_(egl_display_, EGL_SYNC_FENCE_KHR, nullptr);
+    glFlush();
+  } else {
+    glFinish();
+  }
+
+  const uint64_t upload_ns = FlutterEngineGetCurrentTime() - start_ns;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = textures_.find(texture_id);
+
+    if (it != textures_.end()) {
+      Texture *texture = it->second.get();
+
+      if (texture->ready.name != 0) {
+        // the raster thread did not get to the previous upload
+        texture->dropped++;
+        Upload spare = texture->ready;
+        texture->spares.push_back({spare.name, spare.width, spare.height, EGL_NO_SYNC_KHR});
+        spare.name = 0;
+        DestroyUpload(&spare);
+      }
+
+      texture->ready = upload;
+      texture->uploads++;
+      texture->upload_ns += upload_ns;
+      upload = {};
+
+      if (application_ && !texture->frame_available_sent) {
+        texture->frame_available_sent = true;
+        application_->markExternalTextureFrameAvailable(texture_id);
+      }
+    }
+  }
+
+  // unregistered meanwhile
+  if (upload.name != 0) {
+    glDeleteTextures(1, &upload.name);
+    upload.name = 0;
+    DestroyUpload(&upload);
+  }
+}
+
+void TextureRegistry::WaitUpload(Upload *upload) {
+  if (upload->fence == EGL_NO_SYNC_KHR) {
+    return;
+  }
+
+  if (egl_wait_sync_) {
+    egl_wait_sync_(egl_display_, upload->fence, 0);
+  } else {
+    egl_client_wait_sync_(egl_display_, upload->fence, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+  }
+
+  egl_destroy_sync_(egl_display_, upload->fence);
+  upload->fence = EGL_NO_SYNC_KHR;
+}
+
+// Destroys the fence and, if upload.name is set, the texture.
+void TextureRegistry::DestroyUpload(Upload *upload) {
+  if (upload->fence != EGL_NO_SYNC_KHR) {
+    egl_destroy_sync_(egl_display_, upload->fence);
+    upload->fence = EGL_NO_SYNC_KHR;
+  }
+
+  if (upload->name != 0) {
+    glDeleteTextures(1, &upload->name);
+    upload->name = 0;
+  }
+}
+
+bool TextureRegistry::ImportDmabuf(Texture *texture, const DmabufFrame &frame) {
+  struct stat st;
+
+  if (fstat(frame.fd, &st) != 0) {
+    FL_ERROR("External texture %jd: invalid dmabuf fd %d", texture->id, frame.fd);
+    return false;
+  }
+
+  auto &imports = texture->imports;
+  auto it       = std::find_if(imports.begin(), imports.end(), [&](const DmabufImport &import) {
+    return import.dev == st.st_dev && import.ino == st.st_ino && import.fourcc == frame.fourcc && import.width == frame.width && import.height == frame.height && import.stride == frame.stride && import.offset == frame.offset &&
+           import.modifier == frame.modifier;
+  });
+
+  if (it != imports.end()) {
+    // most recently shown last
+    std::rotate(it, it + 1, imports.end());
+    DestroyTexture(texture);
+  } else {
+    std::vector<EGLint> attribs = {
+        // clang-format off
+      EGL_WIDTH,                     static_cast<EGLint>(frame.width),
+      EGL_HEIGHT,                    static_cast<EGLint>(frame.height),
+      EGL_LINUX_DRM_FOURCC_EXT,      static_cast<EGLint>(frame.fourcc),
+      EGL_DMA_BUF_PLANE0_FD_EXT,     frame.fd,
+      EGL_DMA_BUF_PLANE0_OFFSET_EXT, static_cast<EGLint>(frame.offset),
+      EGL_DMA_BUF_PLANE0_PITCH_EXT,  static_cast<EGLint>(frame.stride),
+        // clang-format on
+    };
+
+    if (frame.modifier != DRM_FORMAT_MOD_INVALID) {
+      attribs.insert(attribs.end(), {
+                                        EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT, static_cast<EGLint>(frame.modifier & 0xffffffff),
+                                        EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT, static_cast<EGLint>(frame.modifier >> 32),
+                                    });
+    }
+
+    attribs.push_back(EGL_NONE);
+
+    EGLImageKHR image = egl_create_image_(egl_display_, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, nullptr, attribs.data());
+
+    if (image == EGL_NO_IMAGE_KHR) {
+      LogLastEGLError();
+      FL_ERROR("External texture %jd: could not import dmabuf", texture->id);
+      return false;
+    }
+
+    // before an eviction, which may take the import shown until now
+    DestroyTexture(texture);
+
+    if (imports.size() == kMaxDmabufImports) {
+      DestroyImport(&imports.front());
+      imports.erase(imports.begin());
+    }
+
+    GLuint name;
+    glGenTextures(1, &name);
+    glBindTexture(GL_TEXTURE_2D, name);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    gl_egl_image_target_texture_(GL_TEXTURE_2D, image);
+
+    imports.push_back({st.st_dev, st.st_ino, frame.fourcc, frame.width, frame.height, frame.stride, frame.offset, frame.modifier, image, name});
+  }
+
+  texture->name   = imports.back().name;
+  texture->image  = imports.back().image;
+  texture->width  = frame.width;
+  texture->height = frame.height;
+
+  return true;
+}
+
+// An import shown is only unlinked, the cache owns it.
+void TextureRegistry::DestroyTexture(Texture *texture) {
+  if (texture->image != EGL_NO_IMAGE_KHR) {
+    texture->image = EGL_NO_IMAGE_KHR;
+    texture->name  = 0;
+    return;
+  }
+
+  if (texture->name) {
+    glDeleteTextures(1, &texture->name);
+    texture->name = 0;
+  }
+}
+
+void TextureRegistry::DestroyImport(DmabufImport *import) {
+  glDeleteTextures(1, &import->name);
+  egl_destroy_image_(egl_display_, import->image);
+}
+
+void TextureRegistry::CollectGarbage() {
+  if (!has_garbage_) {
+    return;
+  }
+
+  std::vector<std::unique_ptr<Texture>> graveyard;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    graveyard.swap(graveyard_);
+    has_garbage_ = false;
+  }
+
+  for (auto &texture : graveyard) {
+    DestroyTexture(texture.get());
+    DestroyUpload(&texture->ready);
+
+    for (auto &import : texture->imports) {
+      DestroyImport(&import);
+    }
+
+    for (auto &spare : texture->spares) {
+      DestroyUpload(&spare);
+    }
+
+    for (auto &retired : texture->retired) {
+      DestroyUpload(&retired);
+    }
+
+    if (texture->pbos[0]) {
+      glDeleteBuffers(kPixelBufferRingSize, texture->pbos);
+    }
+
+    RetireFrame(std::move(texture->current));
+  }
+}
+
+// The swap flushes the fences, so the workers' waits see them. Frames are
+// released a frame or more after they were replaced, the producer keeps
+// pushing new ones meanwhile.
+void TextureRegistry::FrameSubmitted() {
+  if (!has_retired_) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto &it : textures_) {
+      Texture *texture = it.second.get();
+
+      for (auto &retired : texture->retired) {
+        retired.fence = egl_create_sync_(egl_display_, EGL_SYNC_FENCE_KHR, nullptr);
+        texture->spares.push_back(retired);
+      }
+
+      texture->retired.clear();
+    }
+  }
+
+  for (auto it = retired_frames_.begin(); it != retired_frames_.end();) {
+    if (it->fence == EGL_NO_SYNC_KHR) {
+      it->fence = egl_create_sync_(egl_display_, EGL_SYNC_FENCE_KHR, nullptr);
+      ++it;
+    } else if (egl_client_wait_sync_(egl_display_, it->fence, 0, 0) == EGL_CONDITION_SATISFIED_KHR) {
+      egl_destroy_sync_(egl_display_, it->fence);
+      ReleaseFrame(it->frame.get());
+      it = retired_frames_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  has_retired_ = !retired_frames_.empty();
+}
+
+// Raster thread.
+void TextureRegistry::RetireFrame(std::unique_ptr<Frame> frame) {
+  if (!frame) {
+    return;
+  }
+
+  // pixels were copied by the GL already, without fences a dmabuf goes back right away
+  if (!frame->dmabuf || !egl_create_sync_) {
+    ReleaseFrame(frame.get());
+    return;
+  }
+
+  retired_frames_.push_back({std::move(frame), EGL_NO_SYNC_KHR});
+  has_retired_ = true;
+}
+
+void TextureRegistry::ReleaseFrame(Frame *frame) {
+  if (frame == nullptr) {
+    return;
+  }
+
+  auto &release = frame->dmabuf ? frame->buffer.release : frame->pixels.release;
+
+  if (release) {
+    release();
+    release = nullptr;
+  }
+}
+
+} // namespace flutter
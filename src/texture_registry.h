@@ -0,0 +1,194 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES3/gl3.h>
+#include <GLES2/gl2ext.h>
+
+#include "macros.h"
+#include "flutter_application.h"
+#include "upload_context_pool.h"
+
+namespace flutter {
+
+// External textures fed by producer threads (camera, video decoders, ...).
+//
+// Producers push whole frames, either dmabufs imported as EGLImage (when the
+// EGL display supports EGL_EXT_image_dma_buf_import) or CPU pixels uploaded
+// through a ring of pixel buffer objects (plain glTexSubImage2D on GLES2).
+// Imports are cached per buffer, so a producer cycling through a few dmabufs
+// only pays for their first frames. A dmabuf goes back to its producer once a
+// fence behind the last draws sampling it signalled.
+// Only the newest frame is kept, frames replaced before the engine picked them
+// up are counted as dropped. The engine is told about a new frame at most once
+// per rendered frame.
+//
+// With an upload pool, CPU pixels are uploaded on its workers instead of the
+// raster thread, into a spare texture guarded by a fence; the raster thread
+// only swaps in the newest uploaded texture. The texture it replaces becomes
+// a spare once the frame which last sampled it is fenced, the worker waits
+// for that fence before writing into it.
+class TextureRegistry {
+public:
+  // Called once the producer's buffer is no longer accessed by the registry.
+  using ReleaseCallback = std::function<void()>;
+
+  struct PixelFrame {
+    const uint8_t *pixels; // RGBA8888
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    ReleaseCallback release;
+  };
+
+  struct DmabufFrame {
+    int fd;
+    uint32_t fourcc;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t offset;
+    uint64_t modifier; // DRM_FORMAT_MOD_INVALID (0x00ffffffffffffff) when implicit
+    ReleaseCallback release;
+  };
+
+  TextureRegistry() = default;
+
+  ~TextureRegistry();
+
+  // Platform thread, once the engine is running, again after a restart.
+  // Detach() before the engine shuts down; frames pushed meanwhile are kept
+  // and announced to the next engine.
+  void Attach(Application *application, EGLDisplay display, UploadContextPool *upload_pool = nullptr);
+  void Detach();
+
+  // Any thread.
+  int64_t RegisterTexture();
+  void UnregisterTexture(int64_t texture_id);
+  bool PushFrame(int64_t texture_id, PixelFrame frame);
+  bool PushFrame(int64_t texture_id, DmabufFrame frame);
+  bool SupportsDmabuf() const;
+
+  // Raster thread, with the onscreen context current.
+  bool PopulateTexture(int64_t texture_id, size_t width, size_t height, FlutterOpenGLTexture *texture_out);
+  void CollectGarbage();
+  // After the frame's draws, before the swap.
+  void FrameSubmitted();
+
+private:
+  static constexpr size_t kPixelBufferRingSize = 3;
+  static constexpr size_t kMaxDmabufImports    = 4; // per texture, producers cycle 2-3 buffers
+
+  struct Frame {
+    bool dmabuf;
+    PixelFrame pixels;
+    DmabufFrame buffer;
+  };
+
+  // A dmabuf is identified by its inode, whichever fd the producer passes.
+  struct DmabufImport {
+    dev_t dev;
+    ino_t ino;
+    uint32_t fourcc;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t offset;
+    uint64_t modifier;
+    EGLImageKHR image;
+    GLuint name;
+  };
+
+  // A replaced frame, released to its producer once the fence signalled.
+  struct Retired {
+    std::unique_ptr<Frame> frame;
+    EGLSyncKHR fence;
+  };
+
+  struct Upload {
+    GLuint name      = 0;
+    uint32_t width   = 0;
+    uint32_t height  = 0;
+    EGLSyncKHR fence = EGL_NO_SYNC_KHR; // signalled once the upload finished
+  };
+
+  struct Texture {
+    int64_t id;
+
+    // upload pool, guarded by mutex_
+    bool upload_scheduled = false;
+    Upload ready;               // newest upload, not picked up by the raster thread yet
+    std::vector<Upload> spares; // textures for the next upload, once their fence signalled
+
+    // guarded by mutex_
+    std::unique_ptr<Frame> pending;
+    bool frame_available_sent = false;
+    uint64_t frames           = 0;
+    uint64_t dropped          = 0;
+
+    // raster thread only
+    std::unique_ptr<Frame> current; // dmabuf frames stay referenced while displayed
+    std::vector<Upload> retired;    // replaced this frame, still sampled by its draws
+    std::vector<DmabufImport> imports; // least recently shown first
+    GLuint name                       = 0;
+    GLuint pbos[kPixelBufferRingSize] = {};
+    size_t pbo_size                   = 0;
+    size_t next_pbo                   = 0;
+    uint32_t width                    = 0;
+    uint32_t height                   = 0;
+    EGLImageKHR image                 = EGL_NO_IMAGE_KHR; // set while an import is shown, name is then the import's
+    uint64_t uploads                  = 0;
+    uint64_t upload_ns                = 0;
+  };
+
+  Application *application_ = nullptr; // guarded by mutex_ off the platform thread
+  EGLDisplay egl_display_   = EGL_NO_DISPLAY;
+  bool dmabuf_supported_    = false;
+  int pbo_supported_        = -1; // resolved lazily on the raster thread
+
+  PFNEGLCREATEIMAGEKHRPROC egl_create_image_                       = nullptr;
+  PFNEGLDESTROYIMAGEKHRPROC egl_destroy_image_                     = nullptr;
+  PFNGLEGLIMAGETARGETTEXTURE2DOESPROC gl_egl_image_target_texture_ = nullptr;
+
+  UploadContextPool *upload_pool_                   = nullptr;
+  PFNEGLCREATESYNCKHRPROC egl_create_sync_          = nullptr;
+  PFNEGLDESTROYSYNCKHRPROC egl_destroy_sync_        = nullptr;
+  PFNEGLCLIENTWAITSYNCKHRPROC egl_client_wait_sync_ = nullptr;
+  PFNEGLWAITSYNCKHRPROC egl_wait_sync_              = nullptr; // GPU side wait, EGL_KHR_wait_sync
+
+  std::mutex mutex_;
+  int64_t next_texture_id_ = 1;
+  std::map<int64_t, std::unique_ptr<Texture>> textures_;
+  std::vector<std::unique_ptr<Texture>> graveyard_; // destroyed on the raster thread
+  std::atomic<bool> has_garbage_ = false;
+  bool has_retired_              = false; // raster thread only
+  std::vector<Retired> retired_frames_;    // raster thread only
+
+  bool PushFrame(int64_t texture_id, std::unique_ptr<Frame> frame);
+  bool UploadPixels(Texture *texture, const PixelFrame &frame);
+  void UploadAsync(int64_t texture_id);
+  void WaitUpload(Upload *upload);
+  void DestroyUpload(Upload *upload);
+  bool ImportDmabuf(Texture *texture, const DmabufFrame &frame);
+  void DestroyTexture(Texture *texture);
+  void DestroyImport(DmabufImport *import);
+  void RetireFrame(std::unique_ptr<Frame> frame);
+  static void ReleaseFrame(Frame *frame);
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(TextureRegistry)
+};
+
+} // namespace flutter
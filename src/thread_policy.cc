@@ -0,0 +1,217 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <iterator>
+#include <sstream>
+
+#include "thread_policy.h"
+
+namespace flutter {
+
+ThreadPolicy &ThreadPolicy::Instance() {
+  static ThreadPolicy policy;
+  return policy;
+}
+
+const char *ThreadPolicy::RoleName(Role role) {
+  switch (role) {
+  case Role::PLATFORM:
+    return "platform";
+  case Role::UI:
+    return "ui";
+  case Role::RASTER:
+    return "raster";
+  case Role::IO:
+    return "io";
+  case Role::VSYNC:
+    return "vsync";
+  default:
+    return "?";
+  }
+}
+
+bool ThreadPolicy::ParseCpus(const std::string &cpus, cpu_set_t *set) {
+  CPU_ZERO(set);
+
+  std::stringstream ranges(cpus);
+  std::string range;
+
+  while (std::getline(ranges, range, ',')) {
+    unsigned first, last;
+    char dash;
+    std::stringstream parser(range);
+
+    if (!(parser >> first)) {
+      return false;
+    }
+
+    last = first;
+
+    if (parser >> dash && (dash != '-' || !(parser >> last))) {
+      return false;
+    }
+
+    if (last < first || last >= CPU_SETSIZE) {
+      return false;
+    }
+
+    for (unsigned cpu = first; cpu <= last; cpu++) {
+      CPU_SET(cpu, set);
+    }
+  }
+
+  return CPU_COUNT(set) > 0;
+}
+
+bool ThreadPolicy::Load(const std::string &config) {
+  std::stringstream entries(config);
+  std::string entry;
+
+  while (std::getline(entries, entry, ';')) {
+    if (entry.empty()) {
+      continue;
+    }
+
+    const auto equals = entry.find('=');
+
+    if (equals == std::string::npos) {
+      FL_ERROR("thread policy: expected <role>=<policy> in \"%s\"", entry.c_str());
+      return false;
+    }
+
+    const std::string role_name = entry.substr(0, equals);
+    size_t role                 = 0;
+
+    while (role < std::size(policies_) && role_name != RoleName(static_cast<Role>(role))) {
+      role++;
+    }
+
+    if (role == std::size(policies_)) {
+      FL_ERROR("thread policy: unknown role \"%s\"", role_name.c_str());
+      return false;
+    }
+
+    Policy policy;
+    policy.configured = true;
+
+    std::string spec = entry.substr(equals + 1);
+    const auto at    = spec.find('@');
+
+    if (at != std::string::npos) {
+      policy.set_cpus = true;
+
+      if (!ParseCpus(spec.substr(at + 1), &policy.cpus)) {
+        FL_ERROR("thread policy: invalid cpu list in \"%s\"", entry.c_str());
+        return false;
+      }
+
+      spec.resize(at);
+    }
+
+    const auto colon        = spec.find(':');
+    const std::string kind  = spec.substr(0, colon);
+    const std::string value = colon == std::string::npos ? "" : spec.substr(colon + 1);
+
+    if (kind == "nice" && !value.empty()) {
+      policy.set_nice = true;
+      policy.nice     = atoi(value.c_str());
+    } else if ((kind == "fifo" || kind == "rr") && !value.empty()) {
+      policy.sched_policy = kind == "fifo" ? SCHED_FIFO : SCHED_RR;
+      policy.priority     = atoi(value.c_str());
+
+      if (policy.priority < sched_get_priority_min(policy.sched_policy) || policy.priority > sched_get_priority_max(policy.sched_policy)) {
+        FL_ERROR("thread policy: priority out of range in \"%s\"", entry.c_str());
+        return false;
+      }
+    } else if (kind != "other" && !kind.empty()) {
+      FL_ERROR("thread policy: unknown policy in \"%s\"", entry.c_str());
+      return false;
+    }
+
+    policies_[role] = policy;
+  }
+
+  return true;
+}
+
+bool ThreadPolicy::HasEngineRoles() const {
+  for (const Role role : {Role::UI, Role::RASTER, Role::IO}) {
+    if (policies_[static_cast<size_t>(role)].configured) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ThreadPolicy::Apply(Role role) const {
+  const Policy &policy = policies_[static_cast<size_t>(role)];
+
+  if (!policy.configured) {
+    return;
+  }
+
+  const pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+  std::string applied;
+
+  if (policy.sched_policy != SCHED_OTHER) {
+    struct sched_param param = {};
+    param.sched_priority     = policy.priority;
+
+    const int rv = pthread_setschedparam(pthread_self(), policy.sched_policy, &param);
+
+    if (rv == 0) {
+      applied += std::string(policy.sched_policy == SCHED_FIFO ? " fifo:" : " rr:") + std::to_string(policy.priority);
+    } else if (rv == EPERM) {
+      // without CAP_SYS_NICE the best an unprivileged thread gets is the lowest nice value RLIMIT_NICE allows
+      struct rlimit limit;
+      const int nice = getrlimit(RLIMIT_NICE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY ? 20 - static_cast<int>(limit.rlim_cur) : 0;
+
+      if (nice < 0 && setpriority(PRIO_PROCESS, tid, nice) == 0) {
+        applied += " nice:" + std::to_string(nice) + " (real-time not permitted)";
+      } else {
+        applied += " default (real-time not permitted)";
+      }
+    } else {
+      FL_WARN("thread policy: %s: pthread_setschedparam failed: %s", RoleName(role), strerror(rv));
+    }
+  }
+
+  if (policy.set_nice) {
+    if (setpriority(PRIO_PROCESS, tid, policy.nice) == 0) {
+      applied += " nice:" + std::to_string(policy.nice);
+    } else {
+      applied += " nice not permitted (" + std::string(strerror(errno)) + ")";
+    }
+  }
+
+  if (policy.set_cpus) {
+    const int rv = pthread_setaffinity_np(pthread_self(), sizeof(policy.cpus), &policy.cpus);
+
+    if (rv == 0) {
+      applied += " cpus:";
+
+      for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &policy.cpus)) {
+          applied += std::to_string(cpu) + ",";
+        }
+      }
+
+      applied.pop_back();
+    } else {
+      applied += " affinity failed (" + std::string(strerror(rv)) + ")";
+    }
+  }
+
+  FL_INFO("thread policy: %s thread %d:%s", RoleName(role), tid, applied.empty() ? " default" : applied.c_str());
+}
+
+} // namespace flutter
@@ -0,0 +1,65 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <sched.h>
+
+#include <string>
+
+#include "macros.h"
+
+namespace flutter {
+
+// Scheduling class, nice value and CPU affinity per thread role. Threads apply
+// the policy of their role themselves: the platform thread in main(), the
+// vsync threads when they start and the engine's threads from its thread
+// priority callback (engines which do not have it keep their defaults).
+//
+// Policies which need privileges (SCHED_FIFO/SCHED_RR without CAP_SYS_NICE or
+// RLIMIT_RTPRIO, negative nice values) fall back to what the thread may do
+// and say so in the log.
+//
+// Configured through the environment:
+//   FLUTTER_WAYLAND_THREAD_POLICY - "<role>=<policy>[@<cpus>];..." where
+//     role   is platform, ui, raster, io or vsync,
+//     policy is nice:<n>, fifo:<priority>, rr:<priority> or other,
+//     cpus   is a list like 0-1,3
+//   e.g. "raster=fifo:10@2-3;ui=nice:-10@2-3;io=nice:10@0-1;vsync=rr:20"
+class ThreadPolicy {
+public:
+  enum class Role { PLATFORM, UI, RASTER, IO, VSYNC, COUNT };
+
+  static ThreadPolicy &Instance();
+
+  bool Load(const std::string &config);
+
+  // Applies the policy of role to the calling thread.
+  void Apply(Role role) const;
+
+  // Whether any of the engine's thread roles is configured.
+  bool HasEngineRoles() const;
+
+private:
+  ThreadPolicy() = default;
+
+  struct Policy {
+    bool configured  = false;
+    int sched_policy = SCHED_OTHER;
+    int priority     = 0;
+    bool set_nice    = false;
+    int nice         = 0;
+    bool set_cpus    = false;
+    cpu_set_t cpus;
+  };
+
+  Policy policies_[static_cast<size_t>(Role::COUNT)];
+
+  static const char *RoleName(Role role);
+  static bool ParseCpus(const std::string &cpus, cpu_set_t *set);
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(ThreadPolicy)
+};
+
+} // namespace flutter
@@ -0,0 +1,137 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+namespace flutter {
+
+std::atomic<bool> Trace::enabled_ = false;
+
+Trace &Trace::Instance() {
+  static Trace trace;
+  return trace;
+}
+
+bool Trace::Start(const std::string &path, size_t events_per_thread) {
+  if (path.empty()) {
+    return true;
+  }
+
+  if (events_per_thread == 0) {
+    FL_ERROR("FLUTTER_WAYLAND_TRACE_EVENTS must not be 0");
+    return false;
+  }
+
+  path_              = path;
+  events_per_thread_ = events_per_thread;
+  enabled_           = true;
+
+  FL_INFO("Tracing to %s, %zu events per thread", path_.c_str(), events_per_thread_);
+
+  return true;
+}
+
+Trace::Buffer *Trace::ThreadBuffer() {
+  // buffers outlive their threads, they are only written out in Stop()
+  static thread_local Buffer *buffer = nullptr;
+
+  if (buffer == nullptr) {
+    auto new_buffer = std::make_unique<Buffer>();
+    char name[16]   = "";
+
+    pthread_getname_np(pthread_self(), name, sizeof(name));
+
+    new_buffer->tid         = static_cast<pid_t>(syscall(SYS_gettid));
+    new_buffer->thread_name = name;
+    new_buffer->events      = std::make_unique<Event[]>(events_per_thread_);
+    new_buffer->capacity    = events_per_thread_;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffer = new_buffer.get();
+    buffers_.push_back(std::move(new_buffer));
+  }
+
+  return buffer;
+}
+
+void Trace::Record(const char *name, uint64_t start_ns, uint64_t end_ns) {
+  Buffer *buffer     = ThreadBuffer();
+  const size_t index = buffer->count.load(std::memory_order_relaxed);
+
+  if (index == buffer->capacity) {
+    buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  buffer->events[index] = {name, start_ns, end_ns};
+  buffer->count.store(index + 1, std::memory_order_release);
+}
+
+void Trace::Complete(const char *name, uint64_t start_ns, uint64_t end_ns) {
+  Record(name, start_ns, end_ns);
+}
+
+void Trace::Instant(const char *name) {
+  Record(name, FlutterEngineGetCurrentTime(), 0);
+}
+
+void Trace::Stop() {
+  if (!enabled_.exchange(false)) {
+    return;
+  }
+
+  FILE *file = fopen(path_.c_str(), "w");
+
+  if (file == nullptr) {
+    FL_ERROR("Could not write the trace file %s: %s", path_.c_str(), strerror(errno));
+    return;
+  }
+
+  const pid_t pid       = getpid();
+  size_t total          = 0;
+  size_t dropped        = 0;
+  const char *separator = "";
+
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  for (const auto &buffer : buffers_) {
+    // a thread still inside a scope may add events, they are not written
+    const size_t count = buffer->count.load(std::memory_order_acquire);
+
+    fprintf(file, "%s\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", separator, pid, buffer->tid, buffer->thread_name.c_str());
+    separator = ",";
+
+    for (size_t i = 0; i < count; i++) {
+      const Event &event = buffer->events[i];
+
+      if (event.end_ns == 0) {
+        fprintf(file, ",\n{\"ph\":\"i\",\"s\":\"t\",\"cat\":\"embedder\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f}", event.name, pid, buffer->tid, event.start_ns / 1e3);
+      } else {
+        fprintf(file, ",\n{\"ph\":\"X\",\"cat\":\"embedder\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", event.name, pid, buffer->tid, event.start_ns / 1e3, (event.end_ns - event.start_ns) / 1e3);
+      }
+    }
+
+    total += count;
+    dropped += buffer->dropped.load(std::memory_order_relaxed);
+  }
+
+  fprintf(file, "\n]}\n");
+  fclose(file);
+
+  if (dropped != 0) {
+    FL_WARN("Trace: %zu events dropped, raise FLUTTER_WAYLAND_TRACE_EVENTS", dropped);
+  }
+
+  FL_INFO("Trace: %zu events from %zu threads written to %s", total, buffers_.size(), path_.c_str());
+}
+
+} // namespace flutter
@@ -0,0 +1,114 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <flutter_embedder.h>
+
+#include "macros.h"
+
+namespace flutter {
+
+// Trace events of the embedder itself, written as a Chrome JSON trace
+// (chrome://tracing, ui.perfetto.dev) when the process exits.
+//
+// Every thread records into its own fixed size buffer, without locks; a full
+// buffer drops further events and counts them. Timestamps come from
+// FlutterEngineGetCurrentTime(), the clock of the engine's timeline, and the
+// events carry the real pid and thread ids, so they line up with the engine's
+// --trace-to-file or DevTools trace of the same run. With tracing disabled a
+// scope costs one predicted branch.
+//
+// Configured through the environment:
+//   FLUTTER_WAYLAND_TRACE        - trace file to write, tracing is off when unset
+//   FLUTTER_WAYLAND_TRACE_EVENTS - events per thread (default: 65536)
+class Trace {
+public:
+  static Trace &Instance();
+
+  bool Start(const std::string &path, size_t events_per_thread);
+
+  // Stops recording and writes the trace file.
+  void Stop();
+
+  static bool IsEnabled() {
+    return __builtin_expect(enabled_.load(std::memory_order_relaxed), false);
+  }
+
+  // name must outlive the trace, a string literal.
+  void Complete(const char *name, uint64_t start_ns, uint64_t end_ns);
+  void Instant(const char *name);
+
+private:
+  Trace() = default;
+
+  struct Event {
+    const char *name;
+    uint64_t start_ns;
+    uint64_t end_ns; // 0 for an instant event
+  };
+
+  struct Buffer {
+    pid_t tid;
+    std::string thread_name;
+    std::unique_ptr<Event[]> events;
+    size_t capacity;
+    std::atomic<size_t> count   = 0; // published by the owning thread
+    std::atomic<size_t> dropped = 0;
+  };
+
+  static std::atomic<bool> enabled_;
+
+  std::string path_;
+  size_t events_per_thread_ = 0;
+  std::mutex mutex_; // guards buffers_, taken once per thread
+  std::vector<std::unique_ptr<Buffer>> buffers_;
+
+  Buffer *ThreadBuffer();
+  void Record(const char *name, uint64_t start_ns, uint64_t end_ns);
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(Trace)
+};
+
+class TraceScope {
+public:
+  explicit TraceScope(const char *name) : name_(name), start_ns_(Trace::IsEnabled() ? FlutterEngineGetCurrentTime() : 0) {
+  }
+
+  ~TraceScope() {
+    if (start_ns_ != 0) {
+      Trace::Instance().Complete(name_, start_ns_, FlutterEngineGetCurrentTime());
+    }
+  }
+
+private:
+  const char *name_;
+  const uint64_t start_ns_;
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(TraceScope)
+};
+
+} // namespace flutter
+
+#define FLWAY_TRACE_CONCAT_(a, b) a##b
+#define FLWAY_TRACE_CONCAT(a, b) FLWAY_TRACE_CONCAT_(a, b)
+
+// Traces the rest of the enclosing scope.
+#define FLWAY_TRACE_SCOPE(name) ::flutter::TraceScope FLWAY_TRACE_CONCAT(flway_trace_scope_, __LINE__)(name)
+
+#define FLWAY_TRACE_INSTANT(name)                                                                                                                                                                                                              \
+  do {                                                                                                                                                                                                                                         \
+    if (::flutter::Trace::IsEnabled()) {                                                                                                                                                                                                       \
+      ::flutter::Trace::Instance().Instant(name);                                                                                                                                                                                              \
+    }                                                                                                                                                                                                                                          \
+  } while (0)
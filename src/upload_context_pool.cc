@@ -0,0 +1,119 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <pthread.h>
+
+#include <algorithm>
+
+#include "utils.h"
+#include "egl_utils.h"
+#include "upload_context_pool.h"
+
+namespace flutter {
+
+UploadContextPool::UploadContextPool() : size_(std::max(0., getEnv("FLUTTER_WAYLAND_UPLOAD_CONTEXTS", 2.))) {
+}
+
+UploadContextPool::~UploadContextPool() {
+  Stop();
+}
+
+bool UploadContextPool::IsRunning() const {
+  return !workers_.empty();
+}
+
+bool UploadContextPool::Start(EGLDisplay display, EGLConfig config, EGLContext share_context, bool surfaceless) {
+  const EGLint ctx_attribs[]     = {EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE};
+  const EGLint pbuffer_attribs[] = {EGL_HEIGHT, 1, EGL_WIDTH, 1, EGL_NONE};
+
+  display_ = display;
+
+  for (size_t i = 0; i < size_; i++) {
+    auto worker     = std::make_unique<Worker>();
+    worker->context = eglCreateContext(display, config, share_context, ctx_attribs);
+
+    if (worker->context == EGL_NO_CONTEXT) {
+      LogLastEGLError();
+      FL_WARN("Could only create %zu of %zu upload contexts", i, size_);
+      break;
+    }
+
+    if (!surfaceless) {
+      worker->surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+    }
+
+    worker->thread = std::thread(&UploadContextPool::Run, this, worker.get());
+    workers_.push_back(std::move(worker));
+  }
+
+  if (size_ != 0) {
+    FL_INFO("Texture uploads: %zu upload contexts (%s)", workers_.size(), surfaceless ? "surfaceless" : "pbuffer");
+  }
+
+  return IsRunning();
+}
+
+void UploadContextPool::Stop() {
+  for (auto &worker : workers_) {
+    {
+      std::lock_guard<std::mutex> lock(worker->mutex);
+      worker->stopping = true;
+    }
+
+    worker->condition.notify_one();
+    worker->thread.join();
+
+    eglDestroyContext(display_, worker->context);
+
+    if (worker->surface != EGL_NO_SURFACE) {
+      eglDestroySurface(display_, worker->surface);
+    }
+  }
+
+  workers_.clear();
+}
+
+void UploadContextPool::Post(size_t key, Task task) {
+  Worker *worker = workers_[key % workers_.size()].get();
+
+  {
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    worker->tasks.push_back(std::move(task));
+  }
+
+  worker->condition.notify_one();
+}
+
+void UploadContextPool::Run(Worker *worker) {
+  pthread_setname_np(pthread_self(), "upload");
+
+  if (eglMakeCurrent(display_, worker->surface, worker->surface, worker->context) != EGL_TRUE) {
+    LogLastEGLError();
+    FL_ERROR("Could not make an upload context current");
+  }
+
+  // pending tasks still run on stop, they hold frames the producers wait for
+  while (true) {
+    Task task;
+
+    {
+      std::unique_lock<std::mutex> lock(worker->mutex);
+      worker->condition.wait(lock, [worker] { return worker->stopping || !worker->tasks.empty(); });
+
+      if (worker->tasks.empty()) {
+        break;
+      }
+
+      task = std::move(worker->tasks.front());
+      worker->tasks.pop_front();
+    }
+
+    task();
+  }
+
+  eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglReleaseThread();
+}
+
+} // namespace flutter
@@ -0,0 +1,63 @@
+// Copyright 2018 The Flutter Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <EGL/egl.h>
+
+#include "macros.h"
+
+namespace flutter {
+
+// Worker threads, each with an EGL context in the share group of the onscreen
+// context, for texture uploads off the raster thread. Tasks posted with the
+// same key run on the same worker, in order.
+//
+// Configured through the environment:
+//   FLUTTER_WAYLAND_UPLOAD_CONTEXTS - number of upload contexts, 0 disables the pool (default: 2)
+class UploadContextPool {
+public:
+  using Task = std::function<void()>;
+
+  UploadContextPool();
+
+  ~UploadContextPool();
+
+  // surfaceless: EGL_KHR_surfaceless_context works, otherwise every context gets a pbuffer.
+  bool Start(EGLDisplay display, EGLConfig config, EGLContext share_context, bool surfaceless);
+  void Stop();
+
+  bool IsRunning() const;
+
+  void Post(size_t key, Task task);
+
+private:
+  struct Worker {
+    EGLContext context = EGL_NO_CONTEXT;
+    EGLSurface surface = EGL_NO_SURFACE;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<Task> tasks;
+    bool stopping = false;
+  };
+
+  size_t size_;
+  EGLDisplay display_ = EGL_NO_DISPLAY;
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  void Run(Worker *worker);
+
+  FLWAY_DISALLOW_COPY_AND_ASSIGN(UploadContextPool)
+};
+
+} // namespace flutter
@@ -2,11 +2,14 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <map>
 #include <sstream>
+#include <string_view>
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
 
+#include "metrics.h"
 #include "utils.h"
 
 namespace flutter {
@@ -121,9 +124,13 @@ std::string FlutterGetAppAotElfName() {
   return std::string("../../lib/libapp.so"); // assumes 'flutter build' directory layout
 }
 
-bool FlutterSendMessage(FlutterEngine engine, const char *channel, const uint8_t *message, const size_t message_size) {
+bool FlutterSendMessage(FlutterEngine engine, const char *channel, const uint8_t *message, const size_t message_size, FlutterDataCallback reply, void *user_data) {
   FlutterPlatformMessageResponseHandle *response_handle = nullptr;
 
+  if (reply != nullptr && FlutterPlatformMessageCreateResponseHandle(engine, reply, user_data, &response_handle) != kSuccess) {
+    return false;
+  }
+
   FlutterPlatformMessage platform_message = {
       .struct_size     = sizeof(FlutterPlatformMessage),
       .channel         = channel,
@@ -134,6 +141,16 @@ bool FlutterSendMessage(FlutterEngine engine, const char *channel, const uint8_t
 
   FlutterEngineResult message_result = FlutterEngineSendPlatformMessage(engine, &platform_message);
 
+  // per thread, so a message only takes the registry lock on a new channel
+  thread_local std::map<std::string, Counter *, std::less<>> channel_bytes;
+  auto it = channel_bytes.find(std::string_view(channel));
+
+  if (it == channel_bytes.end()) {
+    it = channel_bytes.emplace(channel, Metrics::Instance().GetCounter("flutter_wayland_platform_message_bytes_total", "Platform message bytes sent to the engine.", Metrics::Label("channel", channel))).first;
+  }
+
+  it->second->Add(message_size);
+
   if (response_handle != nullptr) {
     FlutterPlatformMessageReleaseResponseHandle(engine, response_handle);
   }
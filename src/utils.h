@@ -23,7 +23,8 @@ bool FlutterAssetBundleIsValid(const std::string &bundle_path);
 
 std::string FlutterGetAppAotElfName();
 
-bool FlutterSendMessage(FlutterEngine engine, const char *channel, const uint8_t *message, const size_t message_size);
+// reply, when given, is called on the platform thread with the response, unless sending failed.
+bool FlutterSendMessage(FlutterEngine engine, const char *channel, const uint8_t *message, const size_t message_size, FlutterDataCallback reply = nullptr, void *user_data = nullptr);
 
 template <typename T> T getEnv(const char *variable, T default_value);
 } // namespace flutter
@@ -11,6 +11,7 @@
 #include <sys/socket.h>
 #include <sys/time.h>
 
+#include <algorithm>
 #include <chrono>
 #include <sstream>
 #include <vector>
@@ -27,10 +28,16 @@
 #include <sys/mman.h>
 #include <linux/input-event-codes.h>
 
-#include "cify.h"
 #include "keys.h"
+#include "input_log.h"
+#include "keymap_cache.h"
+#include "metrics.h"
+#include "platform_task_runner.h"
+#include "semantics.h"
 #include "utils.h"
 #include "egl_utils.h"
+#include "thread_policy.h"
+#include "trace.h"
 #include "wayland_display.h"
 
 namespace flutter {
@@ -47,14 +54,24 @@ static inline WaylandDisplay *get_wayland_display(void *data, const bool check_n
   return wd;
 }
 
+// shared by all displays, updated from the vsync threads
+static Counter *const frames_presented_metric = Metrics::Instance().GetCounter("flutter_wayland_frames_presented_total", "Frames the compositor presented.");
+static Counter *const frames_discarded_metric = Metrics::Instance().GetCounter("flutter_wayland_frames_discarded_total", "Frames the compositor discarded.");
+static Counter *const vsync_serviced_metric   = Metrics::Instance().GetCounter("flutter_wayland_vsync_batons_total", "Vsync batons answered.");
+static Counter *const vsync_late_metric       = Metrics::Instance().GetCounter("flutter_wayland_vsync_batons_late_total", "Vsync batons answered a quarter period or more after their scheduled time.");
+static Histogram *const vsync_wait_metric     = Metrics::Instance().GetHistogram("flutter_wayland_vsync_baton_wait_seconds", "Time from the engine's vsync request to its answer.", {0.001, 0.002, 0.004, 0.008, 0.016, 0.033, 0.066, 0.1, 1.0});
+
 const wl_registry_listener WaylandDisplay::kRegistryListener = {
     .global = [](void *data, struct wl_registry *wl_registry, uint32_t name, const char *interface, uint32_t version) -> void {
+      FLWAY_TRACE_SCOPE("wl_registry.global");
       WaylandDisplay *const wd = get_wayland_display(data);
 
       FL_INFO("AnnounceRegistryInterface(registry:%p, name:%2u, interface:%s, version:%u)", static_cast<void *>(wl_registry), name, interface, version);
 
       if (strcmp(interface, "wl_compositor") == 0) {
-        wd->compositor_ = static_cast<decltype(compositor_)>(wl_registry_bind(wl_registry, name, &wl_compositor_interface, 1));
+        // wl_surface_set_buffer_transform() needs at least version 2
+        wd->compositor_version_ = std::min(version, 3u);
+        wd->compositor_         = static_cast<decltype(compositor_)>(wl_registry_bind(wl_registry, name, &wl_compositor_interface, wd->compositor_version_));
         return;
       }
 
@@ -69,8 +86,9 @@ const wl_registry_listener WaylandDisplay::kRegistryListener = {
         return;
       }
 
+      // version 2 has the scale, for the cursor theme
       if (strcmp(interface, "wl_output") == 0) {
-        wd->output_ = static_cast<decltype(output_)>(wl_registry_bind(wl_registry, name, &wl_output_interface, 1));
+        wd->output_ = static_cast<decltype(output_)>(wl_registry_bind(wl_registry, name, &wl_output_interface, std::min(version, 2u)));
         wl_output_add_listener(wd->output_, &kOutputListener, wd);
         return;
       }
@@ -81,10 +99,31 @@ const wl_registry_listener WaylandDisplay::kRegistryListener = {
         return;
       }
 
+      if (strcmp(interface, wp_viewporter_interface.name) == 0) {
+        wd->viewporter_ = static_cast<decltype(viewporter_)>(wl_registry_bind(wl_registry, name, &wp_viewporter_interface, 1));
+        return;
+      }
+
       if (strcmp(interface, zwp_xwayland_keyboard_grab_manager_v1_interface.name) == 0) {
         wd->kbd_grab_manager_ = static_cast<decltype(kbd_grab_manager_)>(wl_registry_bind(wl_registry, name, &zwp_xwayland_keyboard_grab_manager_v1_interface, 1));
         return;
       }
+
+      if (strcmp(interface, "wl_shm") == 0) {
+        wd->shm_ = static_cast<decltype(shm_)>(wl_registry_bind(wl_registry, name, &wl_shm_interface, 1));
+        return;
+      }
+
+      // version 3 has drag and drop actions
+      if (strcmp(interface, "wl_data_device_manager") == 0 && version >= 3) {
+        wd->data_device_manager_ = static_cast<decltype(data_device_manager_)>(wl_registry_bind(wl_registry, name, &wl_data_device_manager_interface, 3));
+        return;
+      }
+
+      if (strcmp(interface, zwp_text_input_manager_v3_interface.name) == 0) {
+        wd->text_input_manager_ = static_cast<decltype(text_input_manager_)>(wl_registry_bind(wl_registry, name, &zwp_text_input_manager_v3_interface, 1));
+        return;
+      }
     },
 
     .global_remove = [](void *data, struct wl_registry *wl_registry, uint32_t name) -> void {
@@ -108,8 +147,10 @@ const wl_shell_surface_listener WaylandDisplay::kShellSurfaceListener = {
       if (wd->window_ == nullptr)
         return;
 
-      wl_egl_window_resize(wd->window_, wd->screen_width_ = width, wd->screen_height_ = height, 0, 0);
-      wd->application->sendWindowMetrics(wd->physical_width_, wd->physical_height_, wd->screen_width_, wd->screen_height_);
+      wd->screen_width_  = width;
+      wd->screen_height_ = height;
+      wd->ResizeWindow();
+      wd->application->sendWindowMetrics(wd->physical_width_, wd->physical_height_, wd->RenderWidth(), wd->RenderHeight(), wd->render_scale_);
     },
 
     .popup_done = [](void *data, struct wl_shell_surface *wl_shell_surface) -> void {
@@ -118,34 +159,92 @@ const wl_shell_surface_listener WaylandDisplay::kShellSurfaceListener = {
 };
 
 const wl_pointer_listener WaylandDisplay::kPointerListener = {
-    .enter = [](void *data, struct wl_pointer *wl_pointer, uint32_t serial, struct wl_surface *surface, wl_fixed_t surface_x, wl_fixed_t surface_y) {},
+    .enter =
+        [](void *data, struct wl_pointer *wl_pointer, uint32_t serial, struct wl_surface *surface, wl_fixed_t surface_x, wl_fixed_t surface_y) {
+          WaylandDisplay *const wd = get_wayland_display(data);
+
+          wd->pointer_focused_ = surface == wd->surface_;
+          wd->data_device_.SetInputSerial(serial);
+
+          if (!wd->pointer_focused_) {
+            return;
+          }
+
+          wd->mouse_cursor_.Enter(wl_pointer, serial);
+
+          // the pointer stream uses the engine's clock, enter and leave carry no time
+          const uint32_t time = static_cast<uint32_t>(FlutterEngineGetCurrentTime() / 1000000);
+
+          // a button held on leave was released elsewhere, e.g. during a compositor grab,
+          // and Wayland does not send held buttons on enter
+          if (wd->pointer_buttons_ > 0) {
+            wd->pointer_buttons_ = 0;
+            wd->application->onPointerEvent(FlutterPointerPhase::kCancel, time, wl_fixed_to_double(wd->surface_x), wl_fixed_to_double(wd->surface_y));
+          }
+
+          // hovering starts right away, the framework asks for the cursor under the pointer
+          wd->surface_x = surface_x;
+          wd->surface_y = surface_y;
+          wd->application->onPointerEvent(FlutterPointerPhase::kHover, time, wl_fixed_to_double(surface_x), wl_fixed_to_double(surface_y));
+        },
 
     .leave =
         [](void *data, struct wl_pointer *wl_pointer, uint32_t serial, struct wl_surface *surface) {
           WaylandDisplay *const wd = get_wayland_display(data);
 
-          wd->key_modifiers = static_cast<GdkModifierType>(0);
+          if (surface != wd->surface_) {
+            return;
+          }
+
+          wd->pointer_focused_ = false;
+          wd->key_modifiers    = static_cast<GdkModifierType>(0);
+          wd->mouse_cursor_.Leave();
+
+          // hover effects end, a pressed pointer is still dragging
+          if (wd->pointer_buttons_ == 0) {
+            wd->application->onPointerEvent(FlutterPointerPhase::kRemove, static_cast<uint32_t>(FlutterEngineGetCurrentTime() / 1000000), wl_fixed_to_double(wd->surface_x), wl_fixed_to_double(wd->surface_y));
+          }
         },
 
     .motion =
         [](void *data, struct wl_pointer *wl_pointer, uint32_t time, wl_fixed_t surface_x, wl_fixed_t surface_y) {
           WaylandDisplay *const wd = get_wayland_display(data);
 
-          // just store raw values
+          if (!wd->pointer_focused_) {
+            return;
+          }
+
           wd->surface_x = surface_x;
           wd->surface_y = surface_y;
+
+          wd->frame_scheduler_.InputReceived(wd->application->getCurrentTime());
+          wd->application->onPointerEvent(wd->pointer_buttons_ > 0 ? FlutterPointerPhase::kMove : FlutterPointerPhase::kHover, static_cast<uint32_t>(FlutterEngineGetCurrentTime() / 1000000), wl_fixed_to_double(surface_x),
+                                          wl_fixed_to_double(surface_y));
         },
 
     .button =
         [](void *data, struct wl_pointer *wl_pointer, uint32_t serial, uint32_t time, uint32_t button, uint32_t state) {
           WaylandDisplay *const wd = get_wayland_display(data);
 
+          if (!wd->pointer_focused_) {
+            return;
+          }
+
+          wd->frame_scheduler_.InputReceived(wd->application->getCurrentTime());
+          wd->data_device_.SetInputSerial(serial);
+
+          if (state == WL_POINTER_BUTTON_STATE_PRESSED) {
+            wd->pointer_buttons_++;
+          } else if (wd->pointer_buttons_ > 0) {
+            wd->pointer_buttons_--;
+          }
+
           // uint32_t button_number = button - BTN_LEFT;
           // button_number          = button_number == 1 ? 2 : button_number == 2 ? 1 : button_number;
 
           wd->application->onPointerEvent(
             state == WL_POINTER_BUTTON_STATE_PRESSED ? FlutterPointerPhase::kDown : FlutterPointerPhase::kUp,
-            time,
+            static_cast<uint32_t>(FlutterEngineGetCurrentTime() / 1000000),
             wl_fixed_to_double(wd->surface_x),
             wl_fixed_to_double(wd->surface_y)
           );
@@ -170,22 +269,64 @@ const wl_keyboard_listener WaylandDisplay::kKeyboardListener = {
 
           wd->keymap_format         = static_cast<wl_keyboard_keymap_format>(format);
           char *const keymap_string = reinterpret_cast<char *const>(mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0));
+          close(fd);
+
+          if (keymap_string == MAP_FAILED) {
+            FL_ERROR("Could not map the keymap: %s", strerror(errno));
+            wd->keymap_format = WL_KEYBOARD_KEYMAP_FORMAT_NO_KEYMAP;
+            return;
+          }
+
           xkb_keymap_unref(wd->keymap);
-          wd->keymap = xkb_keymap_new_from_string(wd->xkb_context, keymap_string, XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
+          wd->keymap = KeymapCache::Instance().Get(wd->xkb_context, keymap_string, size, &wd->modifier_table_);
           munmap(keymap_string, size);
-          close(fd);
+
           xkb_state_unref(wd->xkb_state);
+          wd->xkb_state = nullptr;
+
+          if (wd->keymap == nullptr) {
+            FL_ERROR("Could not compile the keymap");
+            wd->keymap_format = WL_KEYBOARD_KEYMAP_FORMAT_NO_KEYMAP;
+            return;
+          }
+
           wd->xkb_state = xkb_state_new(wd->keymap);
         },
 
-    .enter = [](void *data, struct wl_keyboard *wl_keyboard, uint32_t serial, struct wl_surface *surface, struct wl_array *keys) { FL_DEBUG("keyboard enter"); },
+    .enter =
+        [](void *data, struct wl_keyboard *wl_keyboard, uint32_t serial, struct wl_surface *surface, struct wl_array *keys) {
+          WaylandDisplay *const wd = get_wayland_display(data);
+
+          wd->keyboard_focused_ = surface == wd->surface_;
+          wd->data_device_.SetInputSerial(serial);
+          FL_DEBUG("keyboard enter");
+        },
+
+    .leave =
+        [](void *data, struct wl_keyboard *wl_keyboard, uint32_t serial, struct wl_surface *surface) {
+          WaylandDisplay *const wd = get_wayland_display(data);
+
+          if (surface != wd->surface_) {
+            return;
+          }
 
-    .leave = [](void *data, struct wl_keyboard *wl_keyboard, uint32_t serial, struct wl_surface *surface) { FL_DEBUG("keyboard leave"); },
+          wd->keyboard_focused_ = false;
+
+          if (wd->key_repeat_timer_handle_) {
+            uv_timer_stop(wd->key_repeat_timer_handle_);
+          }
+
+          FL_DEBUG("keyboard leave");
+        },
 
     .key =
         [](void *data, struct wl_keyboard *wl_keyboard, uint32_t serial, uint32_t time, uint32_t key, uint32_t state_w) {
           WaylandDisplay *const wd = get_wayland_display(data);
 
+          if (!wd->keyboard_focused_) {
+            return;
+          }
+
           if (wd->keymap_format == WL_KEYBOARD_KEYMAP_FORMAT_NO_KEYMAP) {
             FL_WARN("Hmm - no keymap, no key event");
             return;
@@ -200,33 +341,34 @@ const wl_keyboard_listener WaylandDisplay::kKeyboardListener = {
           }
 
           xkb_mod_mask_t mods = xkb_state_serialize_mods(wd->xkb_state, XKB_STATE_MODS_EFFECTIVE);
-          wd->key_modifiers   = toGDKModifiers(wd->keymap, mods);
+          wd->key_modifiers   = wd->modifier_table_.ToGDK(mods);
 
           // Remove lock states from state mask.
           guint state = wd->key_modifiers & ~(GDK_LOCK_MASK | GDK_MOD2_MASK);
 
-          static bool shift_lock_pressed = false;
-          static bool caps_lock_pressed  = false;
-          static bool num_lock_pressed   = false;
-
           const GdkEventType type = state_w == WL_KEYBOARD_KEY_STATE_PRESSED ? GDK_KEY_PRESS : GDK_KEY_RELEASE;
 
+          if (type == GDK_KEY_PRESS) {
+            wd->frame_scheduler_.InputReceived(wd->application->getCurrentTime());
+            wd->data_device_.SetInputSerial(serial);
+          }
+
           switch (keysym) {
           case GDK_KEY_Num_Lock:
-            num_lock_pressed = type == GDK_KEY_PRESS;
+            wd->num_lock_pressed_ = type == GDK_KEY_PRESS;
             break;
           case GDK_KEY_Caps_Lock:
-            caps_lock_pressed = type == GDK_KEY_PRESS;
+            wd->caps_lock_pressed_ = type == GDK_KEY_PRESS;
             break;
           case GDK_KEY_Shift_Lock:
-            shift_lock_pressed = type == GDK_KEY_PRESS;
+            wd->shift_lock_pressed_ = type == GDK_KEY_PRESS;
             break;
           }
 
           // Add back in the state matching the actual pressed state of the lock keys,
           // not the lock states.
-          state |= (shift_lock_pressed || caps_lock_pressed) ? GDK_LOCK_MASK : 0x0;
-          state |= num_lock_pressed ? GDK_MOD2_MASK : 0x0;
+          state |= (wd->shift_lock_pressed_ || wd->caps_lock_pressed_) ? GDK_LOCK_MASK : 0x0;
+          state |= wd->num_lock_pressed_ ? GDK_MOD2_MASK : 0x0;
 
           const uint32_t utf32 = xkb_keysym_to_utf32(keysym); // TODO: double check if it fully mimics gdk_keyval_to_unicode()
 
@@ -240,12 +382,12 @@ const wl_keyboard_listener WaylandDisplay::kKeyboardListener = {
               wd->last_utf32 = utf32;
 
               uv_timer_start(wd->key_repeat_timer_handle_,
-                            cify([wd](uv_timer_t* handle) {
-                              wd->application->keyboardKey(GDK_KEY_RELEASE, wd->last_hardware_keycode, wd->last_keysym, wd->last_keystate, wd->last_utf32);
-                              wd->application->keyboardKey(GDK_KEY_PRESS, wd->last_hardware_keycode, wd->last_keysym, wd->last_keystate, wd->last_utf32);
-                            }),
+                            [](uv_timer_t* handle) {
+                              WaylandDisplay *const wd = get_wayland_display(handle->data);
+                              wd->application->keyboardKey(GDK_KEY_PRESS, wd->last_hardware_keycode, wd->last_keysym, wd->last_keystate, wd->last_utf32, true);
+                            },
                             wd->repeat_delay_, 1000 / wd->repeat_rate_);
-            } else if (state == WL_KEYBOARD_KEY_STATE_RELEASED &&
+            } else if (state_w == WL_KEYBOARD_KEY_STATE_RELEASED &&
                    hardware_keycode == wd->last_hardware_keycode) {
               uv_timer_stop(wd->key_repeat_timer_handle_);
             }
@@ -300,16 +442,93 @@ const wl_seat_listener WaylandDisplay::kSeatListener = {
         },
 };
 
+const zwp_text_input_v3_listener WaylandDisplay::kTextInputListener = {
+    .enter =
+        [](void *data, struct zwp_text_input_v3 *text_input, struct wl_surface *surface) {
+          WaylandDisplay *const wd = get_wayland_display(data);
+
+          if (surface != wd->surface_) {
+            return;
+          }
+
+          wd->text_input_entered_ = true;
+
+          if (wd->application && wd->application->isStarted()) {
+            wd->UpdateTextInput(wd->application->textInput(), ZWP_TEXT_INPUT_V3_CHANGE_CAUSE_OTHER);
+          }
+        },
+
+    .leave =
+        [](void *data, struct zwp_text_input_v3 *text_input, struct wl_surface *surface) {
+          WaylandDisplay *const wd = get_wayland_display(data);
+
+          if (surface != wd->surface_) {
+            return;
+          }
+
+          wd->text_input_entered_ = false;
+          wd->DisableTextInput();
+        },
+
+    .preedit_string =
+        [](void *data, struct zwp_text_input_v3 *text_input, const char *text, int32_t cursor_begin, int32_t cursor_end) {
+          WaylandDisplay *const wd = get_wayland_display(data);
+
+          wd->text_input_pending_.preedit              = text ? text : "";
+          wd->text_input_pending_.preedit_cursor_begin = cursor_begin;
+          wd->text_input_pending_.preedit_cursor_end   = cursor_end;
+        },
+
+    .commit_string =
+        [](void *data, struct zwp_text_input_v3 *text_input, const char *text) {
+          WaylandDisplay *const wd = get_wayland_display(data);
+
+          wd->text_input_pending_.commit = text ? text : "";
+        },
+
+    .delete_surrounding_text =
+        [](void *data, struct zwp_text_input_v3 *text_input, uint32_t before_length, uint32_t after_length) {
+          WaylandDisplay *const wd = get_wayland_display(data);
+
+          wd->text_input_pending_.delete_before = before_length;
+          wd->text_input_pending_.delete_after  = after_length;
+        },
+
+    .done =
+        [](void *data, struct zwp_text_input_v3 *text_input, uint32_t serial) {
+          FLWAY_TRACE_SCOPE("zwp_text_input_v3.done");
+          WaylandDisplay *const wd = get_wayland_display(data);
+
+          // every event is double-buffered, what done did not see is reset
+          const TextInputPlugin::InputMethodEdit edit = std::move(wd->text_input_pending_);
+          wd->text_input_pending_                     = {};
+
+          if (wd->application == nullptr || !wd->application->isStarted() || !wd->text_input_enabled_) {
+            return;
+          }
+
+          wd->application->textInput()->ApplyInputMethodEdit(edit);
+
+          // an outdated serial means more requests are on their way, the input method must not see a state in between
+          if (serial == wd->text_input_commits_) {
+            wd->UpdateTextInput(wd->application->textInput(), ZWP_TEXT_INPUT_V3_CHANGE_CAUSE_INPUT_METHOD);
+          }
+        },
+};
+
 const wl_output_listener WaylandDisplay::kOutputListener = {
     .geometry =
         [](void *data, struct wl_output *wl_output, int32_t x, int32_t y, int32_t physical_width, int32_t physical_height, int32_t subpixel, const char *make, const char *model, int32_t transform) {
           WaylandDisplay *const wd = get_wayland_display(data);
 
-          wd->physical_width_  = physical_width;
-          wd->physical_height_ = physical_height;
+          wd->physical_width_   = physical_width;
+          wd->physical_height_  = physical_height;
+          wd->output_transform_ = static_cast<wl_output_transform>(transform);
 
           FL_DEBUG("output.geometry(data:%p, wl_output:%p, x:%d, y:%d, physical_width:%d, physical_height:%d, subpixel:%d, make:%s, model:%s, transform:%d)", data, static_cast<void *>(wl_output), x, y, physical_width, physical_height,
                  subpixel, make, model, transform);
+
+          wd->ApplyBufferTransform();
         },
     .mode =
         [](void *data, struct wl_output *wl_output, uint32_t flags, int32_t width, int32_t height, int32_t refresh) {
@@ -319,16 +538,27 @@ const wl_output_listener WaylandDisplay::kOutputListener = {
 
           FL_DEBUG("output.mode(data:%p, wl_output:%p, flags:%d, width:%d->%d, height:%d->%d, refresh:%d)", data, static_cast<void *>(wl_output), flags, wd->screen_width_, width, wd->screen_height_, height, refresh);
 
+          // mode is reported in the output's native orientation, the surface is laid out in the transformed one
+          if (wd->TransformSwapsAxes()) {
+            std::swap(width, height);
+          }
+
           if (wd->application && wd->application->isStarted()) {
-            wd->application->sendWindowMetrics(wd->physical_width_, wd->physical_height_, (wd->screen_width_ = width), (wd->screen_height_ = height));
-            wl_egl_window_resize(wd->window_, wd->screen_width_, wd->screen_height_, 0, 0);
+            wd->screen_width_  = width;
+            wd->screen_height_ = height;
+            wd->application->sendWindowMetrics(wd->physical_width_, wd->physical_height_, wd->RenderWidth(), wd->RenderHeight(), wd->render_scale_);
+            wd->ResizeWindow();
           } else {
             wd->window_metrix_skipped_ = true;
             FL_INFO("Window resized: %dx%d status: skipped", wd->screen_width_, wd->screen_width_);
           }
         },
-    .done  = [](void *data, struct wl_output *wl_output) { FL_DEBUG("output.done(data:%p, wl_output:%p)", data, static_cast<void *>(wl_output)); },
-    .scale = [](void *data, struct wl_output *wl_output, int32_t factor) { FL_DEBUG("output.scale(data:%p, wl_output:%p, factor:%d)", data, static_cast<void *>(wl_output), factor); },
+    .done = [](void *data, struct wl_output *wl_output) { FL_DEBUG("output.done(data:%p, wl_output:%p)", data, static_cast<void *>(wl_output)); },
+    .scale =
+        [](void *data, struct wl_output *wl_output, int32_t factor) {
+          FL_DEBUG("output.scale(data:%p, wl_output:%p, factor:%d)", data, static_cast<void *>(wl_output), factor);
+          get_wayland_display(data)->mouse_cursor_.SetScale(factor);
+        },
 };
 
 const struct wp_presentation_feedback_listener WaylandDisplay::kPresentationFeedbackListener = {
@@ -349,10 +579,15 @@ const struct wp_presentation_feedback_listener WaylandDisplay::kPresentationFeed
           }
 
           wd->last_frame_ = new_last_frame_ns;
+          frames_presented_metric->Add();
+
+          if (wd->presentation_clk_id_ == CLOCK_MONOTONIC) {
+            wd->frame_scheduler_.FrameShown(new_last_frame_ns);
+          }
         },
     .discarded =
         [](void *data, struct wp_presentation_feedback *wp_presentation_feedback) {
-          // TODO: remove it
+          frames_discarded_metric->Add();
           FL_DEBUG("presentation.frame dropped");
         },
 }; // namespace flutter
@@ -368,10 +603,13 @@ const struct wp_presentation_listener WaylandDisplay::kPresentationListener = {
         },
 };
 
-WaylandDisplay::WaylandDisplay(size_t width, size_t height)
+WaylandDisplay::WaylandDisplay(size_t width, size_t height, const EGLFramebufferConfig &framebuffer_config, WaylandDisplay *share_connection)
     : xkb_context(xkb_context_new(XKB_CONTEXT_NO_FLAGS))
     , screen_width_(width)
-    , screen_height_(height) {
+    , screen_height_(height)
+    , framebuffer_config_(framebuffer_config)
+    , hidden_timeout_ms_(std::max(20., getEnv("FLUTTER_WAYLAND_HIDDEN_TIMEOUT_MS", 500.)))
+    , skia_cache_bytes_on_pressure_(getEnv("FLUTTER_WAYLAND_MEMORY_PRESSURE_SKIA_CACHE_BYTES", 16. * 1024 * 1024)) {
   if (screen_width_ == 0 || screen_height_ == 0) {
     FL_ERROR("Invalid screen dimensions.");
     return;
@@ -382,7 +620,14 @@ WaylandDisplay::WaylandDisplay(size_t width, size_t height)
     return;
   }
 
-  display_ = wl_display_connect(nullptr);
+  if (share_connection) {
+    display_         = share_connection->display_;
+    owns_connection_ = false;
+  } else {
+    // the last keymap compiles while we connect, the seat sends its keymap right after
+    KeymapCache::Instance().Prewarm();
+    display_ = wl_display_connect(nullptr);
+  }
 
   if (!display_) {
     FL_ERROR("Could not connect to the wayland display.");
@@ -400,18 +645,81 @@ WaylandDisplay::WaylandDisplay(size_t width, size_t height)
 
   wl_display_roundtrip(display_);
 
+  if (text_input_manager_ && seat_) {
+    text_input_ = zwp_text_input_manager_v3_get_text_input(text_input_manager_, seat_);
+    zwp_text_input_v3_add_listener(text_input_, &kTextInputListener, this);
+  }
+
   if (!SetupEGL()) {
     FL_ERROR("Could not setup EGL.");
     return;
   }
+
+  if (!SetupVsyncQueue()) {
+    FL_ERROR("Could not setup the vsync event queue.");
+    return;
+  }
+
+  data_device_.Bind(data_device_manager_, seat_, surface_);
+  data_device_manager_ = nullptr;
+
+  // the output's scale arrived with the roundtrips above
+  mouse_cursor_.Bind(compositor_, compositor_version_, shm_);
+  shm_ = nullptr;
 }
 
 void WaylandDisplay::onEngineStarted() {
   if (window_metrix_skipped_) {
-    application->sendWindowMetrics(physical_width_, physical_height_, screen_width_, screen_height_);
+    application->sendWindowMetrics(physical_width_, physical_height_, RenderWidth(), RenderHeight(), render_scale_);
   }
 
+  application->sendLifecycleState(AppLifecycleState::resumed);
+  texture_registry_.Attach(application, egl_display_, &upload_contexts_);
+
+  data_device_.Start(application);
+  application->setPlatformMessageHandler("flutter/platform", [this](const FlutterPlatformMessage *message) { data_device_.HandleMessage(message); });
+  application->setPlatformMessageHandler(MouseCursor::kChannel, [this](const FlutterPlatformMessage *message) { mouse_cursor_.HandleMessage(application, message); });
+
   valid_ = true;
+
+  {
+    std::lock_guard<std::mutex> lock(engine_mutex_);
+    engine_running_ = true;
+  }
+
+  // a baton the engine sent while starting was held back
+  if (baton_ != 0) {
+    sendNotifyData();
+  }
+}
+
+// The surface, its last frame and the EGL contexts stay, the next engine
+// renders into them.
+void WaylandDisplay::onEngineStopping() {
+  restart_started_ns_ = FlutterEngineGetCurrentTime();
+
+  if (key_repeat_timer_handle_) {
+    uv_timer_stop(key_repeat_timer_handle_);
+  }
+
+  // the text field goes with the engine
+  DisableTextInput();
+  data_device_.Stop();
+
+  // producers and upload workers may still be calling into the old application
+  texture_registry_.Detach();
+
+  // the raster thread only uses the engine's clock, the vsync thread checks
+  // engine_running_; the next application sets itself before its engine runs
+  std::lock_guard<std::mutex> lock(engine_mutex_);
+  engine_running_ = false;
+  application     = nullptr;
+}
+
+void WaylandDisplay::onEngineStopped() {
+  // the engine is gone, so is the frame it waited for
+  baton_                 = 0;
+  window_metrix_skipped_ = true;
 }
 
 FlutterRendererConfig WaylandDisplay::renderEngineConfig() {
@@ -421,6 +729,10 @@ FlutterRendererConfig WaylandDisplay::renderEngineConfig() {
   config.open_gl.make_current  = [](void *data) -> bool {
     WaylandDisplay *const wd = get_wayland_display(data);
 
+    if (wd->resolution_governor_.IsEnabled()) {
+      wd->resolution_governor_.FrameBegin(FlutterEngineGetCurrentTime());
+    }
+
     if (eglMakeCurrent(wd->egl_display_, wd->egl_surface_, wd->egl_surface_, wd->egl_context_) != EGL_TRUE) {
       LogLastEGLError();
       FL_ERROR("Could not make the onscreen context current");
@@ -443,15 +755,54 @@ FlutterRendererConfig WaylandDisplay::renderEngineConfig() {
   config.open_gl.present = [](void *data) -> bool {
     WaylandDisplay *const wd = get_wayland_display(data);
 
-    if (eglSwapBuffers(wd->egl_display_, wd->egl_surface_) != EGL_TRUE) {
-      LogLastEGLError();
-      FL_ERROR("Could not swap the EGL buffer.");
-      return false;
+    wd->texture_registry_.CollectGarbage();
+    wd->texture_registry_.FrameSubmitted();
+    wd->RequestFrameCallback();
+
+    if (wd->frame_capture_.IsEnabled()) {
+      EGLint width = 0, height = 0;
+      eglQuerySurface(wd->egl_display_, wd->egl_surface_, EGL_WIDTH, &width);
+      eglQuerySurface(wd->egl_display_, wd->egl_surface_, EGL_HEIGHT, &height);
+
+      wd->frame_capture_.OnPresent(width, height, FlutterEngineGetCurrentTime());
+    }
+
+    {
+      FLWAY_TRACE_SCOPE("eglSwapBuffers");
+
+      if (eglSwapBuffers(wd->egl_display_, wd->egl_surface_) != EGL_TRUE) {
+        LogLastEGLError();
+        FL_ERROR("Could not swap the EGL buffer.");
+        return false;
+      }
+    }
+
+    wd->frame_scheduler_.FrameSwapped(FlutterEngineGetCurrentTime());
+    InputReplay::FramePresented();
+
+    const uint64_t restart_started_ns = wd->restart_started_ns_.exchange(0);
+
+    if (restart_started_ns != 0) {
+      FL_INFO("Engine restart: first frame %.1f ms after the shutdown started", (FlutterEngineGetCurrentTime() - restart_started_ns) / 1e6);
+    }
+
+    if (wd->resolution_governor_.IsEnabled() && wd->resolution_governor_.FrameEnd(FlutterEngineGetCurrentTime(), wd->vblank_time_ns_) && wd->render_scale_async_) {
+      uv_async_send(wd->render_scale_async_);
     }
 
     return true;
   };
   config.open_gl.fbo_callback          = [](void *data) -> uint32_t { return 0; };
+  config.open_gl.gl_external_texture_frame_callback = [](void *data, int64_t texture_id, size_t width, size_t height, FlutterOpenGLTexture *texture_out) -> bool {
+    WaylandDisplay *const wd = get_wayland_display(data);
+
+    return wd->texture_registry_.PopulateTexture(texture_id, width, height, texture_out);
+  };
+  config.open_gl.surface_transformation = [](void *data) -> FlutterTransformation {
+    WaylandDisplay *const wd = get_wayland_display(data);
+
+    return wd->SurfaceTransformation();
+  };
   config.open_gl.make_resource_current = [](void *data) -> bool {
     WaylandDisplay *const wd = get_wayland_display(data);
 
@@ -486,6 +837,58 @@ FlutterRendererConfig WaylandDisplay::renderEngineConfig() {
 }
 
 WaylandDisplay::~WaylandDisplay() {
+  // pending uploads still run, their textures are collected with the registry
+  upload_contexts_.Stop();
+  frame_capture_.Stop();
+
+  if (vsync_presentation_wrapper_) {
+    wl_proxy_wrapper_destroy(vsync_presentation_wrapper_);
+    vsync_presentation_wrapper_ = nullptr;
+  }
+
+  if (vsync_surface_wrapper_) {
+    wl_proxy_wrapper_destroy(vsync_surface_wrapper_);
+    vsync_surface_wrapper_ = nullptr;
+  }
+
+  if (vsync_queue_) {
+    wl_event_queue_destroy(vsync_queue_);
+    vsync_queue_ = nullptr;
+  }
+
+  if (viewport_) {
+    wp_viewport_destroy(viewport_);
+    viewport_ = nullptr;
+  }
+
+  if (viewporter_) {
+    wp_viewporter_destroy(viewporter_);
+    viewporter_ = nullptr;
+  }
+
+  data_device_.Unbind();
+  mouse_cursor_.Unbind();
+
+  if (data_device_manager_) {
+    wl_data_device_manager_destroy(data_device_manager_);
+    data_device_manager_ = nullptr;
+  }
+
+  if (shm_) {
+    wl_shm_destroy(shm_);
+    shm_ = nullptr;
+  }
+
+  if (text_input_) {
+    zwp_text_input_v3_destroy(text_input_);
+    text_input_ = nullptr;
+  }
+
+  if (text_input_manager_) {
+    zwp_text_input_manager_v3_destroy(text_input_manager_);
+    text_input_manager_ = nullptr;
+  }
+
   if (shell_surface_) {
     wl_shell_surface_destroy(shell_surface_);
     shell_surface_ = nullptr;
@@ -511,8 +914,21 @@ WaylandDisplay::~WaylandDisplay() {
     egl_surface_ = nullptr;
   }
 
+  if (resource_egl_surface_ != EGL_NO_SURFACE) {
+    eglDestroySurface(egl_display_, resource_egl_surface_);
+    resource_egl_surface_ = EGL_NO_SURFACE;
+  }
+
+  if (resource_egl_context_ != EGL_NO_CONTEXT) {
+    eglDestroyContext(egl_display_, resource_egl_context_);
+    resource_egl_context_ = EGL_NO_CONTEXT;
+  }
+
   if (egl_display_) {
-    eglTerminate(egl_display_);
+    // shared with the other displays on the connection
+    if (owns_connection_) {
+      eglTerminate(egl_display_);
+    }
     egl_display_ = nullptr;
   }
 
@@ -538,13 +954,18 @@ WaylandDisplay::~WaylandDisplay() {
 
   if (display_) {
     wl_display_flush(display_);
-    wl_display_disconnect(display_);
+    if (owns_connection_) {
+      wl_display_disconnect(display_);
+    }
     display_ = nullptr;
   }
 }
 
 void WaylandDisplay::vsync_callback(void *data, intptr_t baton)
 {
+  FLWAY_TRACE_INSTANT("vsync_callback");
+
+  baton_ns_ = FlutterEngineGetCurrentTime();
   if (baton_ != 0) {
     FL_ERROR("vsync.wait: New baton arrived, but old was not sent.");
     exit(1);
@@ -557,23 +978,130 @@ void WaylandDisplay::vsync_callback(void *data, intptr_t baton)
   }
 }
 
+void WaylandDisplay::onTextInputChanged(TextInputPlugin *text_input) {
+  UpdateTextInput(text_input, ZWP_TEXT_INPUT_V3_CHANGE_CAUSE_OTHER);
+}
+
+void WaylandDisplay::UpdateTextInput(TextInputPlugin *text_input, zwp_text_input_v3_change_cause cause) {
+  if (text_input_ == nullptr) {
+    return;
+  }
+
+  if (!text_input_entered_ || !text_input->IsActive()) {
+    DisableTextInput();
+    return;
+  }
+
+  // enable resets the state, so everything is sent every time
+  if (!text_input_enabled_) {
+    zwp_text_input_v3_enable(text_input_);
+    text_input_enabled_ = true;
+  }
+
+  // the protocol limits the surrounding text to 4000 bytes
+  std::string surrounding;
+  uint32_t cursor, anchor;
+  text_input->SurroundingText(4000, &surrounding, &cursor, &anchor);
+  zwp_text_input_v3_set_surrounding_text(text_input_, surrounding.c_str(), cursor, anchor);
+  zwp_text_input_v3_set_text_change_cause(text_input_, cause);
+
+  static const struct {
+    const char *input_type;
+    zwp_text_input_v3_content_purpose purpose;
+  } kPurposes[] = {
+      {"TextInputType.number", ZWP_TEXT_INPUT_V3_CONTENT_PURPOSE_NUMBER},
+      {"TextInputType.phone", ZWP_TEXT_INPUT_V3_CONTENT_PURPOSE_PHONE},
+      {"TextInputType.datetime", ZWP_TEXT_INPUT_V3_CONTENT_PURPOSE_DATETIME},
+      {"TextInputType.emailAddress", ZWP_TEXT_INPUT_V3_CONTENT_PURPOSE_EMAIL},
+      {"TextInputType.url", ZWP_TEXT_INPUT_V3_CONTENT_PURPOSE_URL},
+      {"TextInputType.visiblePassword", ZWP_TEXT_INPUT_V3_CONTENT_PURPOSE_PASSWORD},
+      {"TextInputType.name", ZWP_TEXT_INPUT_V3_CONTENT_PURPOSE_NAME},
+  };
+
+  uint32_t purpose = ZWP_TEXT_INPUT_V3_CONTENT_PURPOSE_NORMAL;
+  uint32_t hint    = ZWP_TEXT_INPUT_V3_CONTENT_HINT_NONE;
+
+  for (const auto &entry : kPurposes) {
+    if (text_input->InputType() == entry.input_type) {
+      purpose = entry.purpose;
+    }
+  }
+
+  if (text_input->InputType() == "TextInputType.multiline") {
+    hint |= ZWP_TEXT_INPUT_V3_CONTENT_HINT_MULTILINE;
+  }
+
+  if (text_input->Autocorrect()) {
+    hint |= ZWP_TEXT_INPUT_V3_CONTENT_HINT_COMPLETION | ZWP_TEXT_INPUT_V3_CONTENT_HINT_SPELLCHECK;
+  }
+
+  if (text_input->ObscureText()) {
+    purpose = ZWP_TEXT_INPUT_V3_CONTENT_PURPOSE_PASSWORD;
+    hint    = ZWP_TEXT_INPUT_V3_CONTENT_HINT_HIDDEN_TEXT | ZWP_TEXT_INPUT_V3_CONTENT_HINT_SENSITIVE_DATA;
+  }
+
+  zwp_text_input_v3_set_content_type(text_input_, hint, purpose);
+
+  int32_t x, y, width, height;
+  text_input->CursorRectangle(&x, &y, &width, &height);
+  zwp_text_input_v3_set_cursor_rectangle(text_input_, x, y, width, height);
+
+  zwp_text_input_v3_commit(text_input_);
+  text_input_commits_++;
+}
+
+void WaylandDisplay::DisableTextInput() {
+  if (!text_input_enabled_) {
+    return;
+  }
+
+  zwp_text_input_v3_disable(text_input_);
+  zwp_text_input_v3_commit(text_input_);
+  text_input_commits_++;
+  text_input_enabled_ = false;
+}
+
+TextureRegistry *WaylandDisplay::textureRegistry() {
+  return &texture_registry_;
+}
+
 bool WaylandDisplay::IsValid() const {
   return valid_;
 }
 
 ssize_t WaylandDisplay::vSyncHandler() {
-  if (baton_ == 0) {
+  FLWAY_TRACE_SCOPE("vSyncHandler");
+  std::lock_guard<std::mutex> lock(engine_mutex_);
+
+  if (baton_ == 0 || !engine_running_) {
+    return 0;
+  }
+
+  const auto t_now_ns = application->getCurrentTime();
+
+  // a slot stays until its delivery time, which may come a little late, unless its frame is already due
+  if (!vsync_slot_pending_ || vsync_slot_.frame_target_ns <= t_now_ns) {
+    vsync_slot_         = frame_scheduler_.Schedule(t_now_ns, last_frame_, vblank_time_ns_);
+    vsync_slot_pending_ = true;
+  }
+
+  if (vsync_slot_.deliver_ns > t_now_ns) {
+    // the vsync thread wakes up in time for it
     return 0;
   }
 
-  const auto t_now_ns                      = application->getCurrentTime();
-  const uint64_t after_vsync_time_ns       = (t_now_ns - last_frame_) % vblank_time_ns_;
-  const uint64_t before_next_vsync_time_ns = vblank_time_ns_ - after_vsync_time_ns;
-  const uint64_t current_ns                = t_now_ns + before_next_vsync_time_ns;
-  const uint64_t finish_time_ns            = current_ns + vblank_time_ns_;
-  intptr_t baton                           = baton_.exchange(0);
+  vsync_slot_pending_ = false;
+  intptr_t baton      = baton_.exchange(0);
 
-  const auto status = application->onVsync(baton, current_ns, finish_time_ns);
+  vsync_serviced_metric->Add();
+  vsync_wait_metric->Observe((t_now_ns - baton_ns_) / 1e9);
+
+  if (t_now_ns > vsync_slot_.deliver_ns + vblank_time_ns_ / 4) {
+    vsync_late_metric->Add();
+  }
+
+  const auto status = application->onVsync(baton, vsync_slot_.frame_start_ns, vsync_slot_.frame_target_ns);
+  frame_scheduler_.FrameDelivered(t_now_ns);
 
   if (status != kSuccess) {
     FL_ERROR("vsync.ntfy: FlutterEngineOnVsync failed(%d): baton: %p now_ns: %ju", status, reinterpret_cast<void *>(baton), t_now_ns);
@@ -586,16 +1114,74 @@ ssize_t WaylandDisplay::vSyncHandler() {
 const struct wl_callback_listener WaylandDisplay::kFrameListener = {.done = [](void *data, struct wl_callback *cb, uint32_t callback_data) {
   WaylandDisplay *const wd = get_wayland_display(data);
 
+  wl_callback_destroy(cb);
+  wd->frame_callback_requested_ns_ = 0;
+
   /* check if we presentation time extension interface working */
-  if (wd->presentation_clk_id_ != UINT32_MAX) {
-    return;
+  if (wd->presentation_clk_id_ == UINT32_MAX) {
+    wd->last_frame_ = FlutterEngineGetCurrentTime(); // the application may be restarting
+    wd->frame_scheduler_.FrameShown(wd->last_frame_);
   }
 
-  wd->last_frame_ = wd->application->getCurrentTime();
-  wl_callback_destroy(cb);
-  wl_callback_add_listener(wl_surface_frame(wd->surface_), &kFrameListener, data);
+  if (wd->surface_hidden_.exchange(false)) {
+    uv_async_send(wd->surface_visibility_async_);
+
+    // service the baton held back while we were hidden
+    wd->vSyncHandler();
+  }
 }};
 
+// Called on the raster thread right before eglSwapBuffers(), so the frame request
+// is committed together with the frame it is about.
+void WaylandDisplay::RequestFrameCallback() {
+  if (frame_callback_requested_ns_ != 0) {
+    return;
+  }
+
+  frame_callback_requested_ns_ = FlutterEngineGetCurrentTime();
+  wl_callback_add_listener(wl_surface_frame(vsync_surface_wrapper_), &kFrameListener, this);
+}
+
+// Compositors stop sending frame callbacks for surfaces nobody can see (occluded,
+// minimized, output off), a callback outstanding for too long means we are hidden.
+void WaylandDisplay::CheckSurfaceVisibility() {
+  const uint64_t requested_ns = frame_callback_requested_ns_;
+
+  if (requested_ns == 0 || surface_hidden_) {
+    return;
+  }
+
+  if (FlutterEngineGetCurrentTime() - requested_ns > hidden_timeout_ms_ * 1000000) {
+    surface_hidden_ = true;
+    OnSurfaceVisibilityChanged();
+  }
+}
+
+// Tells the application about the visibility the vsync thread and the
+// visibility timer settled on, on the platform thread.
+void WaylandDisplay::OnSurfaceVisibilityChanged() {
+  const bool hidden = surface_hidden_;
+
+  if (lifecycle_paused_ == hidden) {
+    return;
+  }
+
+  lifecycle_paused_ = hidden;
+
+  FL_INFO("Surface %s", hidden ? "hidden, pausing" : "visible, resuming");
+
+  if (hidden) {
+    if (key_repeat_timer_handle_) {
+      uv_timer_stop(key_repeat_timer_handle_);
+    }
+
+    application->sendLifecycleState(AppLifecycleState::paused);
+    return;
+  }
+
+  application->sendLifecycleState(AppLifecycleState::resumed);
+}
+
 ssize_t WaylandDisplay::readNotifyData() {
   ssize_t rv;
 
@@ -628,118 +1214,545 @@ ssize_t WaylandDisplay::sendNotifyData() {
   return rv;
 }
 
+// Never blocks on the compositor socket. The poll handle's readiness may be
+// stale, a vsync thread can have read the socket empty since, and then
+// wl_display_read_events would wait for that thread's next read while it
+// sleeps on the empty socket. So after preparing, the fd is checked again.
 void WaylandDisplay::ProcessWaylandEvents(uv_poll_t* handle,
                                           int status,
                                           int events) {
+  FLWAY_TRACE_SCOPE("ProcessWaylandEvents");
+
+  if (status < 0) {
+    FL_ERROR("Wayland socket poll failed: %s", uv_strerror(status));
+    uv_stop(loop_);
+    return;
+  }
+
+  if (events & UV_WRITABLE) {
+    FlushWaylandRequests();
+  }
 
-  wl_display_dispatch(display_);
+  if (events & UV_READABLE) {
+    // events queued by another thread must be dispatched before we may read
+    while (wl_display_prepare_read(display_) != 0) {
+      if (wl_display_dispatch_pending(display_) == -1) {
+        CheckDisplayError();
+        return;
+      }
+    }
+
+    struct pollfd fd = {.fd = wl_display_get_fd(display_), .events = POLLIN, .revents = 0};
+
+    if (poll(&fd, 1, 0) != 1) {
+      wl_display_cancel_read(display_);
+    } else if (wl_display_read_events(display_) == -1 && errno != EAGAIN) {
+      CheckDisplayError();
+      return;
+    }
+
+    if (wl_display_dispatch_pending(display_) == -1) {
+      CheckDisplayError();
+    }
+  }
 }
 
-void WaylandDisplay::ProcessNotifyEvents(uv_poll_t* handle,
-                                          int status,
-                                          int events) {
-  auto rv = readNotifyData();
+// Runs before the loop sleeps, so requests from event handlers and from the
+// notify path (frame callbacks, presentation feedback) reach the compositor
+// without waiting for the next swap.
+void WaylandDisplay::FlushWaylandRequests() {
+  FLWAY_TRACE_SCOPE("FlushWaylandRequests");
+  const bool blocked = wl_display_flush(display_) == -1 && errno == EAGAIN;
 
-  if (rv != 1) {
-    FL_ERROR("Can't read notify data");
+  if (!blocked && CheckDisplayError()) {
     return;
   }
 
-  if (presentation_clk_id_ != UINT32_MAX && presentation_ != nullptr) {
-    wp_presentation_feedback_add_listener(::wp_presentation_feedback(presentation_, surface_), &kPresentationFeedbackListener, this);
-    wl_display_dispatch_pending(display_);
+  if (blocked != wl_write_blocked_) {
+    // the rest of the buffer goes out once the compositor drained its socket
+    wl_write_blocked_ = blocked;
+    uv_poll_start(wl_events_poll_handle_display_, blocked ? UV_READABLE | UV_WRITABLE : UV_READABLE, [](uv_poll_t *handle, int status, int events) { get_wayland_display(handle->data)->ProcessWaylandEvents(handle, status, events); });
   }
+}
 
-  rv = vSyncHandler();
+bool WaylandDisplay::CheckDisplayError() {
+  const int error = wl_display_get_error(display_);
 
-  if (rv != 1) {
-    FL_ERROR("VSync failed");
-    return;
+  if (error == 0) {
+    return false;
   }
+
+  FL_ERROR("Wayland connection failed: %s", strerror(error));
+  uv_stop(loop_);
+  return true;
 }
 
-void WaylandDisplay::SignalHandler(int signum) {
-  if(application_stopping_)
+bool WaylandDisplay::SetupVsyncQueue() {
+  vsync_queue_ = wl_display_create_queue(display_);
+
+  if (!vsync_queue_) {
+    return false;
+  }
+
+  // objects created through the wrappers get their events on the vsync queue
+  vsync_surface_wrapper_ = static_cast<wl_surface *>(wl_proxy_create_wrapper(surface_));
+
+  if (!vsync_surface_wrapper_) {
+    return false;
+  }
+
+  wl_proxy_set_queue(reinterpret_cast<wl_proxy *>(vsync_surface_wrapper_), vsync_queue_);
+
+  if (presentation_) {
+    vsync_presentation_wrapper_ = static_cast<wp_presentation *>(wl_proxy_create_wrapper(presentation_));
+
+    if (!vsync_presentation_wrapper_) {
+      return false;
+    }
+
+    wl_proxy_set_queue(reinterpret_cast<wl_proxy *>(vsync_presentation_wrapper_), vsync_queue_);
+  }
+
+  return true;
+}
+
+// Reads the wl_display fd alongside the platform thread (both take part in
+// prepare_read/read_events) but only dispatches the vsync queue, so input,
+// keymap and output events never delay frame timing. What it reads for the
+// default queue is handed to the platform thread through wl_dispatch_async_,
+// the socket it came from may not be readable again for a while.
+void WaylandDisplay::VsyncThreadMain() {
+  pthread_setname_np(pthread_self(), "vsync");
+  ThreadPolicy::Instance().Apply(ThreadPolicy::Role::VSYNC);
+
+  while (!vsync_thread_stop_) {
+    while (wl_display_prepare_read_queue(display_, vsync_queue_) != 0) {
+      wl_display_dispatch_queue_pending(display_, vsync_queue_);
+    }
+
+    wl_display_flush(display_);
+
+    struct pollfd fds[] = {
+        {.fd = wl_display_get_fd(display_), .events = POLLIN, .revents = 0},
+        {.fd = sv_[SOCKET_READER], .events = POLLIN, .revents = 0},
+    };
+
+    // sleeps until the delivery time of a held back vsync answer at the latest
+    struct timespec timeout;
+    const bool deliver_later = vsync_slot_pending_ && baton_ != 0;
+
+    if (deliver_later) {
+      const uint64_t now_ns   = FlutterEngineGetCurrentTime();
+      const uint64_t delay_ns = vsync_slot_.deliver_ns > now_ns ? vsync_slot_.deliver_ns - now_ns : 0;
+      timeout.tv_sec          = delay_ns / 1000000000;
+      timeout.tv_nsec         = delay_ns % 1000000000;
+    }
+
+    if (ppoll(fds, std::size(fds), deliver_later ? &timeout : nullptr, nullptr) == -1 && errno != EINTR) {
+      wl_display_cancel_read(display_);
+      FL_ERROR("vsync thread poll failed: %s", strerror(errno));
+      break;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      if (wl_display_read_events(display_) == -1) {
+        FL_ERROR("vsync thread could not read events: %s", strerror(errno));
+        break;
+      }
+
+      uv_async_send(wl_dispatch_async_);
+    } else {
+      wl_display_cancel_read(display_);
+    }
+
+    if (fds[0].revents & (POLLERR | POLLHUP)) {
+      break;
+    }
+
+    wl_display_dispatch_queue_pending(display_, vsync_queue_);
+
+    if (fds[1].revents & POLLIN) {
+      if (readNotifyData() != 1) {
+        FL_ERROR("Can't read notify data");
+        continue;
+      }
+
+      if (!vsync_thread_stop_) {
+        OnVsyncRequest();
+      }
+    } else if (deliver_later && !surface_hidden_) {
+      vSyncHandler();
+    }
+  }
+}
+
+void WaylandDisplay::OnVsyncRequest() {
+  FLWAY_TRACE_SCOPE("OnVsyncRequest");
+  if (presentation_clk_id_ != UINT32_MAX && vsync_presentation_wrapper_ != nullptr) {
+    wp_presentation_feedback_add_listener(::wp_presentation_feedback(vsync_presentation_wrapper_, surface_), &kPresentationFeedbackListener, this);
+  }
+
+  if (surface_hidden_) {
+    // keep the baton until the compositor asks for frames again
     return;
+  }
 
-  FL_INFO("stop signal = %d", signum);
-  
-  if (signum == SIGINT || signum == SIGTERM) {
-    application_stopping_ = true;
-    uv_async_send(signal_event_async_);
+  if (vSyncHandler() == -1) {
+    FL_ERROR("VSync failed");
   }
 }
 
-void WaylandDisplay::AsyncSignalHandler(uv_async_t* handle) {
-  uv_stop(loop_);
+void WaylandDisplay::OnMemoryPressure() {
+  if (application == nullptr) {
+    return;
+  }
+
+  size_t rss = 0;
+  uv_resident_set_memory(&rss);
+  FL_INFO("Memory pressure: RSS before trimming: %zu kB", rss / 1024);
+
+  application->notifyLowMemory(skia_cache_bytes_on_pressure_);
+
+  // the engine trims its caches asynchronously on the raster and UI threads
+  uv_timer_start(memory_report_timer_handle_,
+                 [](uv_timer_t *handle) {
+                   size_t rss = 0;
+                   uv_resident_set_memory(&rss);
+                   FL_INFO("Memory pressure: RSS after trimming: %zu kB", rss / 1024);
+                 },
+                 1000, 0);
 }
 
-bool WaylandDisplay::Run() {
+bool WaylandDisplay::Attach(uv_loop_t *loop) {
   if (!valid_) {
     FL_ERROR("Could not run an invalid display.");
     return false;
   }
 
-  wl_callback_add_listener(wl_surface_frame(surface_), &kFrameListener, this);
-
   if (kbd_grab_manager_ && getEnv("FLUTTER_WAYLAND_MAIN_UI", 0.) != 0.) {
     /* It's the main UI application, so check if we can receive all keys */
     FL_INFO("kbd_grab_manager: grabbing keyboard...");
     xwayland_keyboard_grab = zwp_xwayland_keyboard_grab_manager_v1_grab_keyboard(kbd_grab_manager_, surface_, seat_);
   }
 
-  signal(SIGINT,
-         cify([self = this](int signum) { self->SignalHandler(signum); }));
-  signal(SIGTERM,
-         cify([self = this](int signum) { self->SignalHandler(signum); }));
-
-  loop_ = new uv_loop_t;
-  uv_loop_init(loop_);
-
-  uv_poll_t* wl_events_poll_handle_display = new uv_poll_t;
-  uv_poll_init(loop_, wl_events_poll_handle_display, wl_display_get_fd(display_));
-  uv_poll_start(wl_events_poll_handle_display, UV_READABLE,
-    cify([self = this](uv_poll_t* handle, int status, int events) {
-      self->ProcessWaylandEvents(handle, status, events);
-    })
-  );
-
-  uv_poll_t* wl_events_poll_handle_notify = new uv_poll_t;
-  uv_poll_init(loop_, wl_events_poll_handle_notify, sv_[SOCKET_READER]);
-  uv_poll_start(wl_events_poll_handle_notify, UV_READABLE,
-    cify([self = this](uv_poll_t* handle, int status, int events) {
-      self->ProcessNotifyEvents(handle, status, events);
-    })
-  );
-
-  signal_event_async_ = new uv_async_t;
-  uv_async_init(loop_, signal_event_async_,
-                cify([self = this](uv_async_t* handle) {
-                  self->AsyncSignalHandler(handle);
-                }));
-
-  key_repeat_timer_handle_ = new uv_timer_t;
+  loop_ = loop;
+
+  // Handles carry the display in their data field, so several displays can share a loop.
+  if (owns_connection_) {
+    wl_events_poll_handle_display_       = new uv_poll_t;
+    wl_events_poll_handle_display_->data = this;
+    uv_poll_init(loop_, wl_events_poll_handle_display_, wl_display_get_fd(display_));
+    uv_poll_start(wl_events_poll_handle_display_, UV_READABLE, [](uv_poll_t *handle, int status, int events) { get_wayland_display(handle->data)->ProcessWaylandEvents(handle, status, events); });
+
+    wl_flush_prepare_handle_       = new uv_prepare_t;
+    wl_flush_prepare_handle_->data = this;
+    uv_prepare_init(loop_, wl_flush_prepare_handle_);
+    uv_prepare_start(wl_flush_prepare_handle_, [](uv_prepare_t *handle) { get_wayland_display(handle->data)->FlushWaylandRequests(); });
+  }
+
+  surface_visibility_async_       = new uv_async_t;
+  surface_visibility_async_->data = this;
+  uv_async_init(loop_, surface_visibility_async_, [](uv_async_t *handle) { get_wayland_display(handle->data)->OnSurfaceVisibilityChanged(); });
+
+  wl_dispatch_async_       = new uv_async_t;
+  wl_dispatch_async_->data = this;
+  uv_async_init(loop_, wl_dispatch_async_, [](uv_async_t *handle) {
+    WaylandDisplay *const wd = get_wayland_display(handle->data);
+
+    if (wl_display_dispatch_pending(wd->display_) == -1) {
+      wd->CheckDisplayError();
+    }
+  });
+
+  vsync_thread_stop_ = false;
+  vsync_thread_      = std::thread(&WaylandDisplay::VsyncThreadMain, this);
+
+  key_repeat_timer_handle_       = new uv_timer_t;
+  key_repeat_timer_handle_->data = this;
   uv_timer_init(loop_, key_repeat_timer_handle_);
 
+  surface_visibility_timer_handle_       = new uv_timer_t;
+  surface_visibility_timer_handle_->data = this;
+  uv_timer_init(loop_, surface_visibility_timer_handle_);
+  uv_timer_start(surface_visibility_timer_handle_, [](uv_timer_t *handle) { get_wayland_display(handle->data)->CheckSurfaceVisibility(); }, hidden_timeout_ms_, hidden_timeout_ms_ / 2);
+
+  memory_report_timer_handle_ = new uv_timer_t;
+  uv_timer_init(loop_, memory_report_timer_handle_);
+  memory_pressure_watcher_.Start(
+      loop_, [this]() { OnMemoryPressure(); },
+      [this]() {
+        if (application) {
+          application->notifyMemoryRelieved();
+        }
+      });
+
+  render_scale_async_       = new uv_async_t;
+  render_scale_async_->data = this;
+  uv_async_init(loop_, render_scale_async_, [](uv_async_t *handle) { get_wayland_display(handle->data)->ApplyRenderScale(); });
+
+  data_device_.Attach(loop_);
+  mouse_cursor_.Attach(loop_);
+
   wl_display_dispatch_pending(display_);
-  uv_run(loop_, UV_RUN_DEFAULT);
 
+  // a socket asked for and not served is a configuration error, Detach() cleans up
+  return frame_capture_.Attach(loop_, [this]() {
+    if (application && application->isStarted()) {
+      application->scheduleFrame();
+    }
+  });
+}
+
+void WaylandDisplay::Detach() {
+  if (loop_ == nullptr) {
+    return;
+  }
+
+  // handles are freed once closed, RunAll spins the loop after detaching
   uv_timer_stop(key_repeat_timer_handle_);
-  delete key_repeat_timer_handle_;
+  uv_close(reinterpret_cast<uv_handle_t *>(key_repeat_timer_handle_), [](uv_handle_t *handle) { delete reinterpret_cast<uv_timer_t *>(handle); });
+  key_repeat_timer_handle_ = nullptr;
 
-  uv_close((uv_handle_t*)signal_event_async_, NULL);
-  delete signal_event_async_;
+  uv_timer_stop(surface_visibility_timer_handle_);
+  uv_close(reinterpret_cast<uv_handle_t *>(surface_visibility_timer_handle_), [](uv_handle_t *handle) { delete reinterpret_cast<uv_timer_t *>(handle); });
+  surface_visibility_timer_handle_ = nullptr;
 
-  uv_poll_stop(wl_events_poll_handle_notify);
-  delete wl_events_poll_handle_notify;
+  memory_pressure_watcher_.Stop();
+  uv_timer_stop(memory_report_timer_handle_);
+  uv_close(reinterpret_cast<uv_handle_t *>(memory_report_timer_handle_), [](uv_handle_t *handle) { delete reinterpret_cast<uv_timer_t *>(handle); });
+  memory_report_timer_handle_ = nullptr;
 
-  uv_poll_stop(wl_events_poll_handle_display);
-  delete wl_events_poll_handle_display;
+  frame_capture_.Detach();
 
-  uv_loop_close(loop_);
-  delete loop_;
-  
-  return true;
+  data_device_.Detach();
+  mouse_cursor_.Detach();
+
+  uv_close(reinterpret_cast<uv_handle_t *>(render_scale_async_), [](uv_handle_t *handle) { delete reinterpret_cast<uv_async_t *>(handle); });
+  render_scale_async_ = nullptr;
+
+  if (vsync_thread_.joinable()) {
+    vsync_thread_stop_ = true;
+    sendNotifyData();
+    vsync_thread_.join();
+  }
+
+  uv_close(reinterpret_cast<uv_handle_t *>(surface_visibility_async_), [](uv_handle_t *handle) { delete reinterpret_cast<uv_async_t *>(handle); });
+  surface_visibility_async_ = nullptr;
+
+  uv_close(reinterpret_cast<uv_handle_t *>(wl_dispatch_async_), [](uv_handle_t *handle) { delete reinterpret_cast<uv_async_t *>(handle); });
+  wl_dispatch_async_ = nullptr;
+
+  if (wl_flush_prepare_handle_) {
+    uv_prepare_stop(wl_flush_prepare_handle_);
+    uv_close(reinterpret_cast<uv_handle_t *>(wl_flush_prepare_handle_), [](uv_handle_t *handle) { delete reinterpret_cast<uv_prepare_t *>(handle); });
+    wl_flush_prepare_handle_ = nullptr;
+  }
+
+  if (wl_events_poll_handle_display_) {
+    uv_poll_stop(wl_events_poll_handle_display_);
+    uv_close(reinterpret_cast<uv_handle_t *>(wl_events_poll_handle_display_), [](uv_handle_t *handle) { delete reinterpret_cast<uv_poll_t *>(handle); });
+    wl_events_poll_handle_display_ = nullptr;
+  }
+
+  loop_ = nullptr;
+}
+
+bool WaylandDisplay::Run() {
+  return RunAll({this});
+}
+
+bool WaylandDisplay::RunAll(const std::vector<WaylandDisplay *> &displays, const std::function<bool()> &restart) {
+  uv_loop_t loop;
+  uv_loop_init(&loop);
+
+  uv_signal_t signal_handles[2];
+  const int signums[] = {SIGINT, SIGTERM};
+
+  for (size_t i = 0; i < std::size(signal_handles); i++) {
+    uv_signal_init(&loop, &signal_handles[i]);
+    uv_signal_start(&signal_handles[i],
+                    [](uv_signal_t *handle, int signum) {
+                      FL_INFO("stop signal = %d", signum);
+                      uv_stop(handle->loop);
+                    },
+                    signums[i]);
+  }
+
+  uv_signal_t restart_handle;
+  restart_handle.data = const_cast<std::function<bool()> *>(&restart);
+  uv_signal_init(&loop, &restart_handle);
+
+  if (restart) {
+    uv_signal_start(&restart_handle,
+                    [](uv_signal_t *handle, int signum) {
+                      FL_INFO("restart signal = %d", signum);
+
+                      if (!(*static_cast<std::function<bool()> *>(handle->data))()) {
+                        uv_stop(handle->loop);
+                      }
+                    },
+                    SIGHUP);
+  }
+
+  bool success = true;
+
+  for (auto display : displays) {
+    success = success && display->Attach(&loop);
+  }
+
+  // the engines' platform tasks, for all windows
+  PlatformTaskRunner::Instance().Attach(&loop);
+
+  // process wide, served by the first loop
+  MetricsServer metrics_server;
+
+  // a recorded session goes into the first window
+  InputReplay input_replay;
+
+  if (success) {
+    // a socket asked for and not served is a configuration error
+    success = metrics_server.Start(&loop);
+  }
+
+  if (success) {
+    SemanticsServer::Instance().Start(&loop);
+    success = input_replay.Start(&loop, displays.front());
+  }
+
+  if (success) {
+    uv_run(&loop, UV_RUN_DEFAULT);
+  }
+
+  input_replay.Stop();
+  SemanticsServer::Instance().Stop();
+  metrics_server.Stop();
+  PlatformTaskRunner::Instance().Detach();
+
+  for (auto display : displays) {
+    display->Detach();
+  }
+
+  for (auto &handle : signal_handles) {
+    uv_signal_stop(&handle);
+    uv_close(reinterpret_cast<uv_handle_t *>(&handle), nullptr);
+  }
+
+  uv_signal_stop(&restart_handle);
+  uv_close(reinterpret_cast<uv_handle_t *>(&restart_handle), nullptr);
+
+  uv_run(&loop, UV_RUN_NOWAIT); // let the signal handles close
+  uv_loop_close(&loop);
+
+  return success;
+}
+
+bool WaylandDisplay::TransformSwapsAxes() const {
+  switch (output_transform_.load()) {
+  case WL_OUTPUT_TRANSFORM_90:
+  case WL_OUTPUT_TRANSFORM_270:
+  case WL_OUTPUT_TRANSFORM_FLIPPED_90:
+  case WL_OUTPUT_TRANSFORM_FLIPPED_270:
+    return true;
+  default:
+    return false;
+  }
+}
+
+int WaylandDisplay::BufferWidth() const {
+  return TransformSwapsAxes() ? RenderHeight() : RenderWidth();
+}
+
+int WaylandDisplay::BufferHeight() const {
+  return TransformSwapsAxes() ? RenderWidth() : RenderHeight();
+}
+
+// Lets the compositor scan out our buffer as is instead of rotating every frame.
+// Input stays untouched: wl_pointer reports surface coordinates which already match
+// the untransformed Flutter view.
+void WaylandDisplay::ApplyBufferTransform() {
+  if (surface_ == nullptr) {
+    return;
+  }
+
+  if (compositor_version_ < WL_SURFACE_SET_BUFFER_TRANSFORM_SINCE_VERSION) {
+    FL_WARN("wl_compositor v%u can't set buffer transform, compositor will rotate", compositor_version_);
+    output_transform_ = WL_OUTPUT_TRANSFORM_NORMAL;
+    return;
+  }
+
+  FL_INFO("Rendering pre-rotated, buffer transform: %d buffer: %dx%d", output_transform_.load(), BufferWidth(), BufferHeight());
+
+  wl_surface_set_buffer_transform(surface_, output_transform_);
+
+  if (window_) {
+    wl_egl_window_resize(window_, BufferWidth(), BufferHeight(), 0, 0);
+  }
+}
+
+int WaylandDisplay::RenderWidth() const {
+  return std::max(1, static_cast<int>(screen_width_ * render_scale_));
+}
+
+int WaylandDisplay::RenderHeight() const {
+  return std::max(1, static_cast<int>(screen_height_ * render_scale_));
+}
+
+// The buffer is rendered at RenderWidth() x RenderHeight(), the viewport scales it back
+// to the logical surface size.
+void WaylandDisplay::ResizeWindow() {
+  UpdateOpaqueRegion();
+
+  if (viewport_) {
+    wp_viewport_set_destination(viewport_, screen_width_, screen_height_);
+  }
+
+  if (window_) {
+    wl_egl_window_resize(window_, BufferWidth(), BufferHeight(), 0, 0);
+  }
+}
+
+// Spares the compositor from blending our surface with whatever is below it.
+void WaylandDisplay::UpdateOpaqueRegion() {
+  if (!framebuffer_config_.opaque || surface_ == nullptr) {
+    return;
+  }
+
+  wl_region *region = wl_compositor_create_region(compositor_);
+  wl_region_add(region, 0, 0, screen_width_, screen_height_);
+  wl_surface_set_opaque_region(surface_, region);
+  wl_region_destroy(region);
+}
+
+void WaylandDisplay::ApplyRenderScale() {
+  render_scale_ = resolution_governor_.Scale();
+
+  ResizeWindow();
+  application->sendWindowMetrics(physical_width_, physical_height_, RenderWidth(), RenderHeight(), render_scale_);
+}
+
+// Maps view (surface) coordinates to buffer coordinates, mirrors weston_transformed_coord().
+FlutterTransformation WaylandDisplay::SurfaceTransformation() const {
+  const double w = RenderWidth();
+  const double h = RenderHeight();
+
+  switch (output_transform_.load()) {
+  case WL_OUTPUT_TRANSFORM_90:
+    return {0, 1, 0, -1, 0, w, 0, 0, 1};
+  case WL_OUTPUT_TRANSFORM_180:
+    return {-1, 0, w, 0, -1, h, 0, 0, 1};
+  case WL_OUTPUT_TRANSFORM_270:
+    return {0, -1, h, 1, 0, 0, 0, 0, 1};
+  case WL_OUTPUT_TRANSFORM_FLIPPED:
+    return {-1, 0, w, 0, 1, 0, 0, 0, 1};
+  case WL_OUTPUT_TRANSFORM_FLIPPED_90:
+    return {0, 1, 0, 1, 0, 0, 0, 0, 1};
+  case WL_OUTPUT_TRANSFORM_FLIPPED_180:
+    return {1, 0, 0, 0, -1, h, 0, 0, 1};
+  case WL_OUTPUT_TRANSFORM_FLIPPED_270:
+    return {0, -1, h, -1, 0, w, 0, 0, 1};
+  default:
+    return {1, 0, 0, 0, 1, 0, 0, 0, 1};
+  }
 }
 
 bool WaylandDisplay::SetupEGL() {
@@ -763,37 +1776,14 @@ bool WaylandDisplay::SetupEGL() {
     return false;
   }
 
-  EGLConfig egl_config = nullptr;
+  FL_INFO("EGL framebuffer: %s", framebuffer_config_.ToString().c_str());
 
   // Choose an EGL config to use for the surface and context.
-  {
-    EGLint attribs[] = {
-        // clang-format off
-      EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
-      EGL_SURFACE_TYPE,    EGL_WINDOW_BIT,
-      EGL_RED_SIZE,        8,
-      EGL_GREEN_SIZE,      8,
-      EGL_BLUE_SIZE,       8,
-      EGL_ALPHA_SIZE,      8,
-      EGL_DEPTH_SIZE,      0,
-      EGL_STENCIL_SIZE,    0,
-      EGL_NONE,            // termination sentinel
-        // clang-format on
-    };
+  EGLConfig egl_config = ChooseEGLConfig(egl_display_, framebuffer_config_);
 
-    EGLint config_count = 0;
-
-    if (eglChooseConfig(egl_display_, attribs, &egl_config, 1, &config_count) != EGL_TRUE) {
-      LogLastEGLError();
-      FL_ERROR("Error when attempting to choose an EGL surface config.");
-      return false;
-    }
-
-    if (config_count == 0 || egl_config == nullptr) {
-      LogLastEGLError();
-      FL_ERROR("No matching configs.");
-      return false;
-    }
+  if (egl_config == nullptr) {
+    FL_ERROR("Could not choose an EGL config.");
+    return false;
   }
 
   const EGLint ctx_attribs[] = {EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE};
@@ -834,17 +1824,61 @@ bool WaylandDisplay::SetupEGL() {
 
   wl_shell_surface_set_toplevel(shell_surface_);
 
-  window_ = wl_egl_window_create(surface_, screen_width_, screen_height_);
+  ApplyBufferTransform();
+  UpdateOpaqueRegion();
+
+  if (resolution_governor_.IsEnabled()) {
+    if (viewporter_) {
+      viewport_ = wp_viewporter_get_viewport(viewporter_, surface_);
+      wp_viewport_set_destination(viewport_, screen_width_, screen_height_);
+    } else {
+      FL_WARN("Dynamic resolution needs wp_viewporter, disabled.");
+      resolution_governor_.Disable();
+    }
+  }
+
+  window_ = wl_egl_window_create(surface_, BufferWidth(), BufferHeight());
 
   if (!window_) {
     FL_ERROR("Could not create EGL window.");
     return false;
   }
 
-  const EGLint pbuffer_config_attribs[] = {EGL_HEIGHT, 64, EGL_WIDTH, 64, EGL_NONE};
-
   resource_egl_context_ = eglCreateContext(egl_display_, egl_config, egl_context_ /* share group */, ctx_attribs);
-  resource_egl_surface_ = eglCreatePbufferSurface(egl_display_, egl_config, pbuffer_config_attribs);
+
+  if (resource_egl_context_ == EGL_NO_CONTEXT) {
+    LogLastEGLError();
+    FL_ERROR("Could not create the resource context.");
+    return false;
+  }
+
+  // The resource context only uploads, it does not need the pbuffer some drivers
+  // still allocate a full buffer for. Checked here, the extension alone does not
+  // guarantee the driver accepts EGL_NO_SURFACE for this config.
+  bool surfaceless = false;
+
+  if (HasEGLExtension(egl_display_, "EGL_KHR_surfaceless_context")) {
+    surfaceless = eglMakeCurrent(egl_display_, EGL_NO_SURFACE, EGL_NO_SURFACE, resource_egl_context_) == EGL_TRUE;
+    eglMakeCurrent(egl_display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  }
+
+  if (surfaceless) {
+    resource_egl_surface_ = EGL_NO_SURFACE;
+  } else {
+    const EGLint pbuffer_config_attribs[] = {EGL_HEIGHT, 1, EGL_WIDTH, 1, EGL_NONE};
+
+    resource_egl_surface_ = eglCreatePbufferSurface(egl_display_, egl_config, pbuffer_config_attribs);
+
+    if (resource_egl_surface_ == EGL_NO_SURFACE) {
+      LogLastEGLError();
+      FL_ERROR("Could not create the resource pbuffer.");
+      return false;
+    }
+  }
+
+  FL_INFO("Resource context: %s", surfaceless ? "surfaceless" : "1x1 pbuffer");
+
+  upload_contexts_.Start(egl_display_, egl_config, egl_context_, surfaceless);
 
   // Create an EGL window surface with the matched config.
   {
@@ -11,34 +11,62 @@
 #include <wayland-client.h>
 #include <wayland-egl.h>
 
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 #include <time.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <wayland-presentation-time-client-protocol.h>
+#include <wayland-text-input-unstable-v3-client-protocol.h>
+#include <wayland-viewporter-client-protocol.h>
 #include <wayland-xwayland-keyboard-grab-client-protocol.h>
 
 #include <uv.h>
 
 #include "macros.h"
+#include "data_device.h"
+#include "egl_utils.h"
 #include "flutter_application.h"
+#include "frame_capture.h"
+#include "frame_scheduler.h"
+#include "keys.h"
+#include "memory_pressure.h"
+#include "mouse_cursor.h"
+#include "resolution_governor.h"
+#include "texture_registry.h"
 
 namespace flutter {
 
 class WaylandDisplay : public RenderDisplay {
 public:
-  WaylandDisplay(size_t width, size_t height);
+  // With share_connection set, the new display opens another surface on the
+  // wl_display and EGL display of share_connection, which must outlive it.
+  WaylandDisplay(size_t width, size_t height, const EGLFramebufferConfig &framebuffer_config = {}, WaylandDisplay *share_connection = nullptr);
 
   ~WaylandDisplay();
 
   bool IsValid() const;
   void onEngineStarted() override;
+  void onEngineStopping() override;
+  void onEngineStopped() override;
   void vsync_callback(void *data, intptr_t baton) override;
+  void onTextInputChanged(TextInputPlugin *text_input) override;
   bool Run();
 
+  // Runs several displays sharing one connection on a single loop. With
+  // restart set, SIGHUP calls it to restart the engines in place; the loop
+  // stops when it returns false.
+  static bool RunAll(const std::vector<WaylandDisplay *> &displays, const std::function<bool()> &restart = nullptr);
+
   FlutterRendererConfig renderEngineConfig() override;
 
+  // Entry point for plugins feeding camera/video frames into the UI.
+  TextureRegistry *textureRegistry();
+
 private:
   static const wl_registry_listener kRegistryListener;
   static const wl_shell_surface_listener kShellSurfaceListener;
@@ -60,8 +88,16 @@ private:
   struct xkb_keymap *keymap               = nullptr;
   struct xkb_context *xkb_context         = nullptr;
   GdkModifierType key_modifiers           = static_cast<GdkModifierType>(0);
+  ModifierTable modifier_table_;
+  bool shift_lock_pressed_ = false; // physical state of the lock keys, not the lock state
+  bool caps_lock_pressed_  = false;
+  bool num_lock_pressed_   = false;
 
   bool valid_ = false;
+  bool owns_connection_ = true;
+  bool pointer_focused_ = false; // all displays sharing a connection see each other's input
+  uint32_t pointer_buttons_ = 0;  // pressed, motion is a move rather than a hover
+  bool keyboard_focused_ = false;
   int screen_width_;
   int screen_height_;
   int physical_width_                                      = 0;
@@ -75,6 +111,11 @@ private:
   wl_output *output_                                       = nullptr;
   wp_presentation *presentation_                           = nullptr;
   zwp_xwayland_keyboard_grab_manager_v1 *kbd_grab_manager_ = nullptr;
+  wp_viewporter *viewporter_                               = nullptr;
+  wp_viewport *viewport_                                   = nullptr;
+  zwp_text_input_manager_v3 *text_input_manager_           = nullptr;
+  wl_data_device_manager *data_device_manager_             = nullptr; // owned by data_device_ once bound
+  wl_shm *shm_                                             = nullptr; // owned by mouse_cursor_ once bound
   wl_shell_surface *shell_surface_                         = nullptr;
   wl_surface *surface_                                     = nullptr;
   wl_egl_window *window_                                   = nullptr;
@@ -82,16 +123,75 @@ private:
   EGLSurface egl_surface_                                  = nullptr;
   EGLContext egl_context_                                  = EGL_NO_CONTEXT;
 
-  EGLSurface resource_egl_surface_ = nullptr;
+  EGLSurface resource_egl_surface_ = EGL_NO_SURFACE; // stays EGL_NO_SURFACE with EGL_KHR_surfaceless_context
   EGLContext resource_egl_context_ = EGL_NO_CONTEXT;
+  UploadContextPool upload_contexts_;
+
+  const EGLFramebufferConfig framebuffer_config_;
+  TextureRegistry texture_registry_;
+  FrameCapture frame_capture_;
+  void UpdateOpaqueRegion();
+
+  // output rotation {
+  std::atomic<wl_output_transform> output_transform_ = WL_OUTPUT_TRANSFORM_NORMAL;
+  uint32_t compositor_version_                       = 0;
+  bool TransformSwapsAxes() const;
+  int BufferWidth() const;
+  int BufferHeight() const;
+  void ApplyBufferTransform();
+  FlutterTransformation SurfaceTransformation() const;
+  // }
+
+  DataDevice data_device_;
+  MouseCursor mouse_cursor_;
+
+  // text input {
+  // The compositor's input method edits the focused text field through
+  // zwp_text_input_v3, its edits are applied when done arrives.
+  static const zwp_text_input_v3_listener kTextInputListener;
+  zwp_text_input_v3 *text_input_ = nullptr;
+  bool text_input_entered_       = false; // the input method is on our surface
+  bool text_input_enabled_       = false;
+  uint32_t text_input_commits_   = 0;
+  TextInputPlugin::InputMethodEdit text_input_pending_;
+  void UpdateTextInput(TextInputPlugin *text_input, zwp_text_input_v3_change_cause cause);
+  void DisableTextInput();
+  // }
+
+  // dynamic resolution {
+  ResolutionGovernor resolution_governor_;
+  std::atomic<double> render_scale_ = 1.0;
+  uv_async_t *render_scale_async_   = nullptr;
+  int RenderWidth() const;
+  int RenderHeight() const;
+  void ResizeWindow();
+  void ApplyRenderScale();
+  // }
 
   bool SetupEGL();
 
   bool StopRunning();
 
   // vsync related {
+  // Frame callbacks and presentation feedback live on their own queue,
+  // dispatched by the vsync thread which also answers the engine's batons.
+  wl_event_queue *vsync_queue_                = nullptr;
+  wl_surface *vsync_surface_wrapper_          = nullptr;
+  wp_presentation *vsync_presentation_wrapper_ = nullptr;
+  std::thread vsync_thread_;
+  std::atomic<bool> vsync_thread_stop_        = false;
+  bool SetupVsyncQueue();
+  void VsyncThreadMain();
+  void OnVsyncRequest();
+  FrameScheduler frame_scheduler_;
+  FrameScheduler::Slot vsync_slot_ = {}; // vsync thread only
+  bool vsync_slot_pending_         = false;
+  std::mutex engine_mutex_;     // held while the vsync thread calls into the engine
+  bool engine_running_ = false; // guarded by engine_mutex_
+  std::atomic<uint64_t> restart_started_ns_ = 0;
   uint32_t presentation_clk_id_     = UINT32_MAX;
   std::atomic<intptr_t> baton_      = 0;
+  std::atomic<uint64_t> baton_ns_   = 0; // when the engine asked for the baton_
   std::atomic<uint64_t> last_frame_ = 0;
   uint64_t vblank_time_ns_          = 1000000000000 / 60000;
   ssize_t vSyncHandler();
@@ -101,9 +201,23 @@ private:
   ssize_t readNotifyData();
   // }
 
+  // occlusion {
+  std::atomic<uint64_t> frame_callback_requested_ns_ = 0; // 0 when no frame callback is outstanding
+  std::atomic<bool> surface_hidden_                  = false; // cleared on the vsync thread
+  bool lifecycle_paused_                             = false; // what the application was told
+  const uint64_t hidden_timeout_ms_;
+  uv_timer_t *surface_visibility_timer_handle_       = nullptr;
+  uv_async_t *surface_visibility_async_              = nullptr;
+  void RequestFrameCallback();
+  void CheckSurfaceVisibility();
+  void OnSurfaceVisibilityChanged();
+  // }
+
   uv_loop_t* loop_ = nullptr;
-  uv_async_t* signal_event_async_ = nullptr;
-  bool application_stopping_ = false;
+  uv_poll_t *wl_events_poll_handle_display_ = nullptr; // only the connection owner polls the wl_display fd
+  uv_prepare_t *wl_flush_prepare_handle_    = nullptr; // flushes requests before the loop sleeps
+  bool wl_write_blocked_                    = false;   // socket buffer full, polling for UV_WRITABLE
+  uv_async_t *wl_dispatch_async_            = nullptr; // the vsync thread read events for the default queue
   uint64_t repeat_rate_ = 10;    // characters per second
   uint64_t repeat_delay_ = 400;  // in milliseconds
   uv_timer_t* key_repeat_timer_handle_ = nullptr;
@@ -113,14 +227,18 @@ private:
   guint last_keystate = 0;
   uint32_t last_utf32 = 0;
 
-  void SignalHandler(int signum);
-  void AsyncSignalHandler(uv_async_t* handle);
+  MemoryPressureWatcher memory_pressure_watcher_;
+  uv_timer_t *memory_report_timer_handle_ = nullptr;
+  size_t skia_cache_bytes_on_pressure_; // FLUTTER_WAYLAND_MEMORY_PRESSURE_SKIA_CACHE_BYTES, 0 keeps the cache size
+  void OnMemoryPressure();
+
+  bool Attach(uv_loop_t *loop);
+  void Detach();
+  void FlushWaylandRequests();
+  bool CheckDisplayError();
   void ProcessWaylandEvents(uv_poll_t* handle,
                                           int status,
                                           int events);
-  void ProcessNotifyEvents(uv_poll_t* handle,
-                                          int status,
-                                          int events);
 
   FLWAY_DISALLOW_COPY_AND_ASSIGN(WaylandDisplay)
 };